@@ -1,2 +1,3 @@
 TARGET_ARCH=avr32
+TARGET_SUPPORTS_MTTCG=y
 TARGET_XML_FILES= gdb-xml/avr32a-cpu.xml
\ No newline at end of file
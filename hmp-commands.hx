@@ -1503,6 +1503,41 @@ SRST
   Inject an MCE on the given CPU (x86 only).
 ERST
 
+#if defined(TARGET_AVR32)
+
+    {
+        .name       = "avr32_checkpoint",
+        .args_type  = "",
+        .params     = "",
+        .help       = "take an in-memory checkpoint of the AVR32 MCU",
+        .cmd        = hmp_avr32_checkpoint,
+    },
+
+#endif
+SRST
+``avr32_checkpoint``
+  Take an in-memory checkpoint of the AVR32 MCU, replacing the previous one.
+  CPU, interrupt controller and RAM are copied without serialisation (AVR32
+  only).
+ERST
+
+#if defined(TARGET_AVR32)
+
+    {
+        .name       = "avr32_restore",
+        .args_type  = "",
+        .params     = "",
+        .help       = "reset the AVR32 MCU to the last checkpoint",
+        .cmd        = hmp_avr32_restore,
+    },
+
+#endif
+SRST
+``avr32_restore``
+  Reset the AVR32 MCU to the state of the last ``avr32_checkpoint``
+  (AVR32 only).
+ERST
+
 #ifdef CONFIG_POSIX
     {
         .name       = "getfd",
@@ -0,0 +1,217 @@
+/*
+ * QEMU AVR32 interrupt controller
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+
+/*
+ * Every peripheral line belongs to one of AVR32_INTC_GROUPS groups. A group
+ * has a single priority register holding its interrupt level (INT0-INT3) and
+ * the autovector, i.e. the handler offset from EVBA. Among all groups with a
+ * pending line the highest level wins, and within a level the lowest group
+ * number. The winner is handed to the CPU, which takes it at the next TB
+ * boundary if SR allows it.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qapi/error.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+#include "avr32_intc.h"
+
+#define INTC_IPR_BASE       0x000
+#define INTC_IRR_BASE       0x100
+#define INTC_ICR_BASE       0x200
+#define INTC_MMIO_SIZE      0x400
+
+#define INTC_IPR_LEVEL_SHIFT    30
+#define INTC_IPR_AUTOVECTOR     0x3fff
+
+void avr32_intc_update(AVR32IntcState *s)
+{
+    int best_level = -1;
+    int best_group = -1;
+
+    for (int level = 0; level < AVR32_INTC_LEVELS; level++) {
+        s->icr[level] = 0;
+    }
+
+    // Walk backwards so the lowest group of each level ends up in icr[]
+    for (int grp = AVR32_INTC_GROUPS - 1; grp >= 0; grp--) {
+        int level;
+
+        if (!s->irr[grp]) {
+            continue;
+        }
+        level = s->ipr[grp] >> INTC_IPR_LEVEL_SHIFT;
+        s->icr[level] = grp;
+        if (level >= best_level) {
+            best_level = level;
+            best_group = grp;
+        }
+    }
+
+    if (!s->cpu) {
+        return;
+    }
+    if (best_level < 0) {
+        avr32_cpu_set_irq_level(s->cpu, -1, 0, -1);
+    } else {
+        avr32_cpu_set_irq_level(s->cpu, best_level,
+                                s->ipr[best_group] & INTC_IPR_AUTOVECTOR,
+                                best_group);
+    }
+}
+
+static void avr32_intc_set_irq(void *opaque, int irq, int level)
+{
+    AVR32IntcState *s = opaque;
+    int grp = irq / AVR32_INTC_LINES_PER_GROUP;
+    uint32_t mask = 1u << (irq % AVR32_INTC_LINES_PER_GROUP);
+
+    if (level) {
+        s->irr[grp] |= mask;
+    } else {
+        s->irr[grp] &= ~mask;
+    }
+    avr32_intc_update(s);
+}
+
+static uint64_t avr32_intc_read(void *opaque, hwaddr addr, unsigned size)
+{
+    AVR32IntcState *s = opaque;
+
+    if (addr < INTC_IPR_BASE + 4 * AVR32_INTC_GROUPS) {
+        return s->ipr[(addr - INTC_IPR_BASE) / 4];
+    }
+    if (addr >= INTC_IRR_BASE && addr < INTC_IRR_BASE + 4 * AVR32_INTC_GROUPS) {
+        return s->irr[(addr - INTC_IRR_BASE) / 4];
+    }
+    if (addr >= INTC_ICR_BASE && addr < INTC_ICR_BASE + 4 * AVR32_INTC_LEVELS) {
+        // ICR3 comes first
+        return s->icr[AVR32_INTC_LEVELS - 1 - (addr - INTC_ICR_BASE) / 4];
+    }
+
+    qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                  __func__, addr);
+    return 0;
+}
+
+static void avr32_intc_write(void *opaque, hwaddr addr, uint64_t val,
+                             unsigned size)
+{
+    AVR32IntcState *s = opaque;
+
+    if (addr < INTC_IPR_BASE + 4 * AVR32_INTC_GROUPS) {
+        s->ipr[(addr - INTC_IPR_BASE) / 4] =
+            val & ((3u << INTC_IPR_LEVEL_SHIFT) | INTC_IPR_AUTOVECTOR);
+        avr32_intc_update(s);
+        return;
+    }
+
+    // IRR and ICR are read-only
+    qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                  __func__, addr);
+}
+
+static const MemoryRegionOps avr32_intc_ops = {
+    .read = avr32_intc_read,
+    .write = avr32_intc_write,
+    .endianness = DEVICE_BIG_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+static void avr32_intc_reset(DeviceState *dev)
+{
+    AVR32IntcState *s = AVR32_INTC(dev);
+
+    memset(s->ipr, 0, sizeof(s->ipr));
+    memset(s->icr, 0, sizeof(s->icr));
+    // irr follows the input lines and is not touched by reset
+    avr32_intc_update(s);
+}
+
+static void avr32_intc_init(Object *obj)
+{
+    AVR32IntcState *s = AVR32_INTC(obj);
+
+    memory_region_init_io(&s->mmio, obj, &avr32_intc_ops, s,
+                          TYPE_AVR32_INTC, INTC_MMIO_SIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->mmio);
+    qdev_init_gpio_in(DEVICE(obj), avr32_intc_set_irq,
+                      AVR32_INTC_GROUPS * AVR32_INTC_LINES_PER_GROUP);
+}
+
+static void avr32_intc_realize(DeviceState *dev, Error **errp)
+{
+    AVR32IntcState *s = AVR32_INTC(dev);
+
+    if (!s->cpu) {
+        error_setg(errp, "%s: 'cpu' link not set", TYPE_AVR32_INTC);
+    }
+}
+
+static int avr32_intc_post_load(void *opaque, int version_id)
+{
+    // The pending request held by the CPU is not migrated, hand it over again
+    avr32_intc_update(opaque);
+    return 0;
+}
+
+static const VMStateDescription vmstate_avr32_intc = {
+    .name = TYPE_AVR32_INTC,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = avr32_intc_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(ipr, AVR32IntcState, AVR32_INTC_GROUPS),
+        VMSTATE_UINT32_ARRAY(irr, AVR32IntcState, AVR32_INTC_GROUPS),
+        VMSTATE_UINT32_ARRAY(icr, AVR32IntcState, AVR32_INTC_LEVELS),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property avr32_intc_properties[] = {
+    DEFINE_PROP_LINK("cpu", AVR32IntcState, cpu, TYPE_AVR32A_CPU, AVR32ACPU *),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void avr32_intc_class_init(ObjectClass *oc, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(oc);
+
+    dc->realize = avr32_intc_realize;
+    dc->reset = avr32_intc_reset;
+    dc->vmsd = &vmstate_avr32_intc;
+    device_class_set_props(dc, avr32_intc_properties);
+}
+
+static const TypeInfo avr32_intc_types[] = {
+        {
+                .name           = TYPE_AVR32_INTC,
+                .parent         = TYPE_SYS_BUS_DEVICE,
+                .instance_size  = sizeof(AVR32IntcState),
+                .instance_init  = avr32_intc_init,
+                .class_init     = avr32_intc_class_init,
+        }
+};
+
+DEFINE_TYPES(avr32_intc_types)
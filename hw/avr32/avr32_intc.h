@@ -0,0 +1,59 @@
+/*
+ * QEMU AVR32 interrupt controller
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+#ifndef HW_AVR32_AVR32_INTC_H
+#define HW_AVR32_AVR32_INTC_H
+
+#include "target/avr32/cpu.h"
+#include "qom/object.h"
+#include "hw/sysbus.h"
+
+#define TYPE_AVR32_INTC "avr32-intc"
+
+typedef struct AVR32IntcState AVR32IntcState;
+DECLARE_INSTANCE_CHECKER(AVR32IntcState, AVR32_INTC, TYPE_AVR32_INTC)
+
+#define AVR32_INTC_GROUPS           64
+#define AVR32_INTC_LINES_PER_GROUP  32
+#define AVR32_INTC_LEVELS           4
+
+// Input line n is line n % 32 of group n / 32
+#define AVR32_INTC_IRQ(group, line) \
+    ((group) * AVR32_INTC_LINES_PER_GROUP + (line))
+
+struct AVR32IntcState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+
+    /*< public >*/
+    MemoryRegion mmio;
+    AVR32ACPU *cpu;
+
+    // Interrupt Priority Registers: INTLEVEL[31:30], AUTOVECTOR[13:0]
+    uint32_t ipr[AVR32_INTC_GROUPS];
+    // Interrupt Request Registers, one bit per input line
+    uint32_t irr[AVR32_INTC_GROUPS];
+    // Interrupt Cause Registers, highest priority group per level
+    uint32_t icr[AVR32_INTC_LEVELS];
+};
+
+// Recompute the ICRs and hand the winning request to the CPU
+void avr32_intc_update(AVR32IntcState *s);
+
+#endif // HW_AVR32_AVR32_INTC_H
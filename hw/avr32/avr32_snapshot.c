@@ -0,0 +1,322 @@
+/*
+ * QEMU AVR32 in-memory checkpoints
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+
+/*
+ * Checkpoints for fuzzing loops that go back to the same post-boot state
+ * over and over. Unlike savevm they keep everything in host memory: the
+ * CPU and interrupt controller state is copied as is and RAM regions are
+ * copied straight from their host buffers. Flash is saved too, but the
+ * FLASHC tracks the pages the guest programmed or erased, and a restore
+ * only copies and invalidates those. The TBs translated from the rest of
+ * the flash stay valid.
+ *
+ * The FLASHC, PDCA and USART state is small but spread over many fields,
+ * FIFOs and a timer, so their vmstate is written to a memory buffer and
+ * loaded back from it rather than copied field by field.
+ *
+ * COUNT is saved as a value rather than as the clock offset, so after a
+ * restore it continues from the checkpoint instead of jumping by the time
+ * that passed in between. Pending USART RX timeouts are moved along the
+ * same way.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "exec/memory.h"
+#include "exec/exec-all.h"
+#include "hw/core/cpu.h"
+#include "io/channel-buffer.h"
+#include "migration/qemu-file.h"
+#include "migration/vmstate.h"
+#include "qapi/error.h"
+#include "qemu/error-report.h"
+#include "qemu/timer.h"
+#include "monitor/monitor.h"
+#include "monitor/hmp-target.h"
+#include "avr32_snapshot.h"
+
+typedef struct AVR32SnapshotRam {
+    MemoryRegion *mr;
+    void *data;
+} AVR32SnapshotRam;
+
+typedef struct AVR32SnapshotDevice {
+    DeviceState *dev;
+    GByteArray *state;
+} AVR32SnapshotDevice;
+
+struct AVR32Snapshot {
+    // env up to compare_timer, which must stay its last field
+    uint8_t env[offsetof(CPUAVR32AState, compare_timer)];
+    uint32_t count;
+    bool halted;
+
+    uint32_t ipr[AVR32_INTC_GROUPS];
+    uint32_t irr[AVR32_INTC_GROUPS];
+    uint32_t icr[AVR32_INTC_LEVELS];
+
+    GArray *ram;
+
+    GArray *devices;
+    // QEMU_CLOCK_VIRTUAL at save, the device timers hold absolute times
+    int64_t now;
+
+    uint8_t *flash;
+    // Tags the flash contents for the FLASHC written bitmap
+    uint64_t flash_tag;
+};
+
+static uint64_t avr32_snapshot_flash_tag;
+
+static void avr32_snapshot_collect_ram(AVR32Snapshot *snap, MemoryRegion *mr)
+{
+    MemoryRegion *sub;
+
+    if (memory_region_is_ram(mr) && !memory_region_is_rom(mr) && !mr->alias) {
+        AVR32SnapshotRam ram = {
+            .mr = mr,
+            .data = g_memdup2(memory_region_get_ram_ptr(mr),
+                              memory_region_size(mr)),
+        };
+        g_array_append_val(snap->ram, ram);
+    }
+
+    QTAILQ_FOREACH(sub, &mr->subregions, subregions_link) {
+        avr32_snapshot_collect_ram(snap, sub);
+    }
+}
+
+static void avr32_snapshot_save_device(AVR32Snapshot *snap, DeviceState *dev)
+{
+    QIOChannelBuffer *bioc = qio_channel_buffer_new(256);
+    QEMUFile *f = qemu_file_new_output(QIO_CHANNEL(bioc));
+    AVR32SnapshotDevice device = { .dev = dev, .state = g_byte_array_new() };
+
+    vmstate_save_state(f, qdev_get_vmsd(dev), dev, NULL);
+    qemu_fflush(f);
+    // Closing the file closes the channel, which frees its data
+    g_byte_array_append(device.state, bioc->data, bioc->usage);
+    qemu_fclose(f);
+    object_unref(OBJECT(bioc));
+
+    g_array_append_val(snap->devices, device);
+}
+
+static void avr32_snapshot_restore_device(const AVR32SnapshotDevice *device)
+{
+    const VMStateDescription *vmsd = qdev_get_vmsd(device->dev);
+    QIOChannelBuffer *bioc = qio_channel_buffer_new(device->state->len);
+    QEMUFile *f;
+    int ret;
+
+    qio_channel_write_all(QIO_CHANNEL(bioc), (char *)device->state->data,
+                          device->state->len, &error_abort);
+    qio_channel_io_seek(QIO_CHANNEL(bioc), 0, SEEK_SET, &error_abort);
+    f = qemu_file_new_input(QIO_CHANNEL(bioc));
+
+    ret = vmstate_load_state(f, vmsd, device->dev, vmsd->version_id);
+    if (ret < 0) {
+        error_report("avr32: failed to restore %s: %s", vmsd->name,
+                     strerror(-ret));
+    }
+    qemu_fclose(f);
+    object_unref(OBJECT(bioc));
+}
+
+static void avr32_snapshot_shift_timer(QEMUTimer *timer, int64_t delta)
+{
+    if (timer_pending(timer)) {
+        timer_mod(timer, timer_expire_time_ns(timer) + delta);
+    }
+}
+
+AVR32Snapshot *avr32_snapshot_save(AVR32EXPMcuState *s)
+{
+    AVR32Snapshot *snap = g_new0(AVR32Snapshot, 1);
+    CPUAVR32AState *env = &s->cpu.env;
+
+    memcpy(snap->env, env, sizeof(snap->env));
+    snap->count = avr32_cpu_get_count(env);
+    snap->halted = CPU(&s->cpu)->halted;
+
+    memcpy(snap->ipr, s->intc.ipr, sizeof(snap->ipr));
+    memcpy(snap->irr, s->intc.irr, sizeof(snap->irr));
+    memcpy(snap->icr, s->intc.icr, sizeof(snap->icr));
+
+    snap->ram = g_array_new(false, false, sizeof(AVR32SnapshotRam));
+    avr32_snapshot_collect_ram(snap, &s->bus);
+
+    snap->devices = g_array_new(false, false, sizeof(AVR32SnapshotDevice));
+    avr32_snapshot_save_device(snap, DEVICE(&s->flashc));
+    avr32_snapshot_save_device(snap, DEVICE(&s->pdca));
+    for (int i = 0; i < AVR32EXP_NUM_USARTS; i++) {
+        avr32_snapshot_save_device(snap, DEVICE(&s->usart[i]));
+    }
+    snap->now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    snap->flash = g_memdup2(s->flashc.storage, s->flashc.flash_size);
+    snap->flash_tag = ++avr32_snapshot_flash_tag;
+    avr32_flashc_reset_written(&s->flashc, snap->flash_tag);
+    return snap;
+}
+
+static void avr32_snapshot_restore_flash(AVR32FlashcState *f,
+                                         const AVR32Snapshot *snap)
+{
+    uint32_t pages = f->flash_size / AVR32_FLASHC_PAGE_SIZE;
+    uint32_t page;
+
+    if (f->written_tag == snap->flash_tag) {
+        // Still based on this snapshot, only the pages written since differ
+        for (page = find_first_bit(f->written, pages); page < pages;
+             page = find_next_bit(f->written, pages, page + 1)) {
+            avr32_flashc_restore_page(f, page,
+                    snap->flash + page * AVR32_FLASHC_PAGE_SIZE);
+        }
+    } else {
+        for (page = 0; page < pages; page++) {
+            size_t offset = page * AVR32_FLASHC_PAGE_SIZE;
+
+            if (memcmp(f->storage + offset, snap->flash + offset,
+                       AVR32_FLASHC_PAGE_SIZE)) {
+                avr32_flashc_restore_page(f, page, snap->flash + offset);
+            }
+        }
+    }
+    avr32_flashc_reset_written(f, snap->flash_tag);
+}
+
+void avr32_snapshot_restore(AVR32EXPMcuState *s, const AVR32Snapshot *snap)
+{
+    CPUState *cs = CPU(&s->cpu);
+    CPUAVR32AState *env = &s->cpu.env;
+    int64_t elapsed = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - snap->now;
+
+    memcpy(env, snap->env, sizeof(snap->env));
+    avr32_cpu_set_count(env, snap->count);
+    avr32_cpu_set_compare(env, env->sysr[AVR32_SYSR_COMPARE]);
+    cs->halted = snap->halted;
+    cs->exception_index = -1;
+
+    for (guint i = 0; i < snap->ram->len; i++) {
+        AVR32SnapshotRam *ram = &g_array_index(snap->ram, AVR32SnapshotRam, i);
+        uint64_t size = memory_region_size(ram->mr);
+        ram_addr_t addr = memory_region_get_ram_addr(ram->mr);
+
+        memcpy(memory_region_get_ram_ptr(ram->mr), ram->data, size);
+        memory_region_set_dirty(ram->mr, 0, size);
+        // Code may have been translated from RAM since the checkpoint
+        tb_invalidate_phys_range(addr, addr + size - 1);
+    }
+    avr32_snapshot_restore_flash(&s->flashc, snap);
+
+    for (guint i = 0; i < snap->devices->len; i++) {
+        avr32_snapshot_restore_device(&g_array_index(snap->devices,
+                                                     AVR32SnapshotDevice, i));
+    }
+    // The array was not loaded from the vmstate, the written bitmap holds
+    s->flashc.written_tag = snap->flash_tag;
+    for (int i = 0; i < AVR32EXP_NUM_USARTS; i++) {
+        avr32_snapshot_shift_timer(s->usart[i].rx_timeout_timer, elapsed);
+    }
+
+    // Restored last, it hands the pending request back to the CPU
+    memcpy(s->intc.ipr, snap->ipr, sizeof(snap->ipr));
+    memcpy(s->intc.irr, snap->irr, sizeof(snap->irr));
+    memcpy(s->intc.icr, snap->icr, sizeof(snap->icr));
+    avr32_intc_update(&s->intc);
+
+    tlb_flush(cs);
+}
+
+void avr32_snapshot_free(AVR32Snapshot *snap)
+{
+    if (!snap) {
+        return;
+    }
+    for (guint i = 0; i < snap->ram->len; i++) {
+        g_free(g_array_index(snap->ram, AVR32SnapshotRam, i).data);
+    }
+    g_array_free(snap->ram, true);
+    for (guint i = 0; i < snap->devices->len; i++) {
+        g_byte_array_unref(g_array_index(snap->devices,
+                                         AVR32SnapshotDevice, i).state);
+    }
+    g_array_free(snap->devices, true);
+    g_free(snap->flash);
+    g_free(snap);
+}
+
+// The checkpoint used by the avr32_checkpoint and avr32_restore commands
+static AVR32Snapshot *avr32_checkpoint;
+static AVR32EXPMcuState *avr32_checkpoint_mcu;
+
+// The MCU of the monitor's current CPU, see the "cpu" command
+static AVR32EXPMcuState *avr32_snapshot_find_mcu(Monitor *mon)
+{
+    CPUState *cs = mon_get_cpu(mon);
+    Object *obj = cs ? object_dynamic_cast(OBJECT(cs)->parent,
+                                           TYPE_AVR32EXP_MCU) : NULL;
+
+    if (!obj) {
+        monitor_printf(mon, "No AVR32 MCU found\n");
+        return NULL;
+    }
+    return AVR32EXP_MCU(obj);
+}
+
+static void avr32_checkpoint_save_work(CPUState *cs, run_on_cpu_data data)
+{
+    AVR32EXPMcuState *s = data.host_ptr;
+
+    avr32_snapshot_free(avr32_checkpoint);
+    avr32_checkpoint = avr32_snapshot_save(s);
+    avr32_checkpoint_mcu = s;
+}
+
+static void avr32_checkpoint_restore_work(CPUState *cs, run_on_cpu_data data)
+{
+    avr32_snapshot_restore(data.host_ptr, avr32_checkpoint);
+}
+
+void hmp_avr32_checkpoint(Monitor *mon, const QDict *qdict)
+{
+    AVR32EXPMcuState *s = avr32_snapshot_find_mcu(mon);
+
+    if (s) {
+        run_on_cpu(CPU(&s->cpu), avr32_checkpoint_save_work,
+                   RUN_ON_CPU_HOST_PTR(s));
+    }
+}
+
+void hmp_avr32_restore(Monitor *mon, const QDict *qdict)
+{
+    AVR32EXPMcuState *s = avr32_snapshot_find_mcu(mon);
+
+    if (!s) {
+        return;
+    }
+    if (!avr32_checkpoint || avr32_checkpoint_mcu != s) {
+        monitor_printf(mon, "No checkpoint taken on this MCU\n");
+        return;
+    }
+    run_on_cpu(CPU(&s->cpu), avr32_checkpoint_restore_work,
+               RUN_ON_CPU_HOST_PTR(s));
+}
@@ -0,0 +1,53 @@
+/*
+ * QEMU AVR32 in-memory checkpoints
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+#ifndef HW_AVR32_AVR32_SNAPSHOT_H
+#define HW_AVR32_AVR32_SNAPSHOT_H
+
+#include "avr32exp.h"
+
+typedef struct AVR32Snapshot AVR32Snapshot;
+
+/**
+ * avr32_snapshot_save:   capture the state of an MCU in host memory
+ *
+ * @s:  The MCU, its vCPU must not be running, e.g. call from run_on_cpu()
+ *
+ * Captures the CPU, the interrupt controller, every writable RAM region
+ * the MCU owns on its bus, the flash array and the FLASHC, PDCA and USART
+ * registers. RAM shared with other MCUs is mapped as an alias and left
+ * out. Only the peripherals are serialised, so restoring is bounded by a
+ * memcpy of the RAM and of the flash pages the guest programmed or erased
+ * since.
+ *
+ * Returns: the snapshot, release it with avr32_snapshot_free().
+ */
+AVR32Snapshot *avr32_snapshot_save(AVR32EXPMcuState *s);
+
+/**
+ * avr32_snapshot_restore:   reset an MCU to a snapshot
+ *
+ * @s:      The MCU the snapshot was taken from, its vCPU must not be running
+ * @snap:   The snapshot, it can be restored any number of times
+ */
+void avr32_snapshot_restore(AVR32EXPMcuState *s, const AVR32Snapshot *snap);
+
+void avr32_snapshot_free(AVR32Snapshot *snap);
+
+#endif // HW_AVR32_AVR32_SNAPSHOT_H
@@ -0,0 +1,77 @@
+/*
+ * QEMU AVR32 test device
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "sysemu/runstate.h"
+#include "avr32_testdev.h"
+
+static uint64_t avr32_testdev_read(void *opaque, hwaddr addr, unsigned size)
+{
+    return 0;
+}
+
+static void avr32_testdev_write(void *opaque, hwaddr addr, uint64_t val,
+                                unsigned size)
+{
+    switch (addr) {
+    case AVR32_TESTDEV_EXIT:
+        // Runs the atexit handlers, so plugins still report their results
+        exit(val);
+    case AVR32_TESTDEV_RESET:
+        qemu_system_reset_request(SHUTDOWN_CAUSE_GUEST_RESET);
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, addr);
+        break;
+    }
+}
+
+static const MemoryRegionOps avr32_testdev_ops = {
+    .read = avr32_testdev_read,
+    .write = avr32_testdev_write,
+    .endianness = DEVICE_BIG_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+static void avr32_testdev_init(Object *obj)
+{
+    AVR32TestdevState *s = AVR32_TESTDEV(obj);
+
+    memory_region_init_io(&s->mmio, obj, &avr32_testdev_ops, s,
+                          TYPE_AVR32_TESTDEV, AVR32_TESTDEV_MMIO_SIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->mmio);
+}
+
+static const TypeInfo avr32_testdev_types[] = {
+        {
+                .name           = TYPE_AVR32_TESTDEV,
+                .parent         = TYPE_SYS_BUS_DEVICE,
+                .instance_size  = sizeof(AVR32TestdevState),
+                .instance_init  = avr32_testdev_init,
+        }
+};
+
+DEFINE_TYPES(avr32_testdev_types)
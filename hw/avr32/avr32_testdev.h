@@ -0,0 +1,46 @@
+/*
+ * QEMU AVR32 test device
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+#ifndef HW_AVR32_AVR32_TESTDEV_H
+#define HW_AVR32_AVR32_TESTDEV_H
+
+#include "hw/sysbus.h"
+#include "qom/object.h"
+
+#define TYPE_AVR32_TESTDEV "avr32-testdev"
+OBJECT_DECLARE_SIMPLE_TYPE(AVR32TestdevState, AVR32_TESTDEV)
+
+/*
+ * Not part of any real part. Bare-metal tests under tests/tcg/avr32 write
+ * their result to EXIT, which terminates QEMU with that exit status. Any
+ * write to RESET requests a system reset, e.g. to check what survives it.
+ */
+#define AVR32_TESTDEV_EXIT      0x00
+#define AVR32_TESTDEV_RESET     0x04
+#define AVR32_TESTDEV_MMIO_SIZE 0x08
+
+struct AVR32TestdevState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+
+    /*< public >*/
+    MemoryRegion mmio;
+};
+
+#endif // HW_AVR32_AVR32_TESTDEV_H
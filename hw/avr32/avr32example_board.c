@@ -20,17 +20,20 @@
 #include "qemu/osdep.h"
 #include "qemu/units.h"
 #include "qapi/error.h"
+#include "exec/address-spaces.h"
 #include "avr32exp.h"
+#include "avr32_testdev.h"
 #include "boot.h"
 #include "qom/object.h"
 #include "hw/boards.h"
+#include "hw/qdev-properties.h"
 
 struct AVR32ExampleBoardMachineState {
     /*< private >*/
     MachineState parent_obj;
     /*< public >*/
     AVR32EXPMcuState mcu;
-
+    AVR32TestdevState testdev;
 };
 typedef struct AVR32ExampleBoardMachineState AVR32ExampleBoardMachineState;
 
@@ -38,6 +41,7 @@ struct AVR32ExampleBoardMachineClass {
     /*< private >*/
     MachineClass parent_class;
     /*< public >*/
+    const char *mcu_type;
 };
 typedef struct AVR32ExampleBoardMachineClass AVR32ExampleBoardMachineClass;
 
@@ -47,15 +51,32 @@ typedef struct AVR32ExampleBoardMachineClass AVR32ExampleBoardMachineClass;
 DECLARE_OBJ_CHECKERS(AVR32ExampleBoardMachineState, AVR32ExampleBoardMachineClass,
         AVR32EXAMPLE_BOARD_MACHINE, TYPE_AVR32EXAMPLE_BOARD_MACHINE)
 
+#define TYPE_AVR32EXAMPLE_AP7000_BOARD_MACHINE \
+        MACHINE_TYPE_NAME("avr32example-ap7000-board")
+
+// Unused PBB address, above the catch-all window
+#define AVR32EXAMPLE_TESTDEV_BASE       0xfffef000
+
 
 static void avr32example_board_init(MachineState *machine)
 {
     AVR32ExampleBoardMachineState* m_state = AVR32EXAMPLE_BOARD_MACHINE(machine);
+    AVR32ExampleBoardMachineClass *amc =
+        AVR32EXAMPLE_BOARD_MACHINE_GET_CLASS(machine);
 
     printf("Setting up board...\n");
 
-    object_initialize_child(OBJECT(machine), "mcu", &m_state->mcu, TYPE_AVR32EXPS_MCU);
+    object_initialize_child(OBJECT(machine), "mcu", &m_state->mcu, amc->mcu_type);
     sysbus_realize(SYS_BUS_DEVICE(&m_state->mcu), &error_abort);
+    // The only bus master, so its view is the system memory
+    memory_region_add_subregion(get_system_memory(), 0, &m_state->mcu.bus);
+
+    // Exit path for the tests/tcg/avr32 firmware
+    object_initialize_child(OBJECT(machine), "testdev", &m_state->testdev,
+                            TYPE_AVR32_TESTDEV);
+    sysbus_realize(SYS_BUS_DEVICE(&m_state->testdev), &error_abort);
+    memory_region_add_subregion(&m_state->mcu.bus, AVR32EXAMPLE_TESTDEV_BASE,
+            sysbus_mmio_get_region(SYS_BUS_DEVICE(&m_state->testdev), 0));
 
 
     printf("Board setup complete\n");
@@ -63,7 +84,8 @@ static void avr32example_board_init(MachineState *machine)
 
     if (machine->firmware) {
         if (!avr32_load_firmware(&m_state->mcu.cpu, machine,
-                                 &m_state->mcu.flash, machine->firmware)) {
+                                 &m_state->mcu.flashc.flash,
+                                 machine->firmware)) {
             exit(1);
         }
     }
@@ -72,7 +94,9 @@ static void avr32example_board_init(MachineState *machine)
 static void avr32example_board_class_init(ObjectClass *oc, void *data)
 {
     MachineClass *mc = MACHINE_CLASS(oc);
+    AVR32ExampleBoardMachineClass *amc = AVR32EXAMPLE_BOARD_MACHINE_CLASS(oc);
 
+    amc->mcu_type = TYPE_AVR32EXPS_MCU;
     mc->desc = "AVR32 Example Board";
     mc->alias = "avr32example-board";
     mc->init = avr32example_board_init;
@@ -84,6 +108,90 @@ static void avr32example_board_class_init(ObjectClass *oc, void *data)
     mc->no_parallel = 1;
 }
 
+/*
+ * The same board around an AP7000, for the AVR32B core and its MMU. The
+ * testdev and USARTs are in P4, which stays mapped one to one.
+ */
+static void avr32example_ap7000_board_class_init(ObjectClass *oc, void *data)
+{
+    MachineClass *mc = MACHINE_CLASS(oc);
+    AVR32ExampleBoardMachineClass *amc = AVR32EXAMPLE_BOARD_MACHINE_CLASS(oc);
+
+    amc->mcu_type = TYPE_AP7000_MCU;
+    mc->desc = "AVR32 Example Board with an AP7000 MCU";
+    mc->alias = NULL;
+}
+
+/*
+ * Several MCUs on one bus: every MCU keeps its own flash, SRAM and
+ * peripherals, and they all see a shared RAM at the same address. One MCU
+ * is created per -smp CPU, each runs the same firmware on its own vCPU
+ * thread, so they run in parallel under MTTCG.
+ */
+#define AVR32EXAMPLE_MULTI_MAX_MCUS     8
+#define AVR32EXAMPLE_SHARED_RAM_BASE    0x10000000
+
+struct AVR32ExampleMultiBoardMachineState {
+    /*< private >*/
+    MachineState parent_obj;
+    /*< public >*/
+    AVR32EXPMcuState mcu[AVR32EXAMPLE_MULTI_MAX_MCUS];
+    MemoryRegion shared_ram_alias[AVR32EXAMPLE_MULTI_MAX_MCUS];
+};
+typedef struct AVR32ExampleMultiBoardMachineState AVR32ExampleMultiBoardMachineState;
+
+#define TYPE_AVR32EXAMPLE_MULTI_BOARD_MACHINE MACHINE_TYPE_NAME("avr32example-multi-board")
+DECLARE_INSTANCE_CHECKER(AVR32ExampleMultiBoardMachineState,
+        AVR32EXAMPLE_MULTI_BOARD_MACHINE, TYPE_AVR32EXAMPLE_MULTI_BOARD_MACHINE)
+
+static void avr32example_multi_board_init(MachineState *machine)
+{
+    AVR32ExampleMultiBoardMachineState *m_state =
+        AVR32EXAMPLE_MULTI_BOARD_MACHINE(machine);
+    unsigned int n_mcus = machine->smp.cpus;
+
+    memory_region_add_subregion(get_system_memory(),
+                                AVR32EXAMPLE_SHARED_RAM_BASE, machine->ram);
+
+    for (unsigned int i = 0; i < n_mcus; i++) {
+        AVR32EXPMcuState *mcu = &m_state->mcu[i];
+        g_autofree char *name = g_strdup_printf("mcu[%u]", i);
+
+        object_initialize_child(OBJECT(machine), name, mcu, TYPE_AVR32EXPS_MCU);
+        qdev_prop_set_uint32(DEVICE(mcu), "serial-base",
+                             i * AVR32EXP_NUM_USARTS);
+        sysbus_realize(SYS_BUS_DEVICE(mcu), &error_abort);
+
+        memory_region_init_alias(&m_state->shared_ram_alias[i], OBJECT(mcu),
+                                 "shared-ram", machine->ram, 0,
+                                 memory_region_size(machine->ram));
+        memory_region_add_subregion(&mcu->bus, AVR32EXAMPLE_SHARED_RAM_BASE,
+                                    &m_state->shared_ram_alias[i]);
+
+        if (machine->firmware &&
+            !avr32_load_firmware(&mcu->cpu, machine, &mcu->flashc.flash,
+                                 machine->firmware)) {
+            exit(1);
+        }
+    }
+}
+
+static void avr32example_multi_board_class_init(ObjectClass *oc, void *data)
+{
+    MachineClass *mc = MACHINE_CLASS(oc);
+
+    mc->desc = "AVR32 Example Board, one AVR32EXPS MCU per CPU on a shared bus";
+    mc->init = avr32example_multi_board_init;
+    mc->default_cpus = 2;
+    mc->min_cpus = 1;
+    mc->max_cpus = AVR32EXAMPLE_MULTI_MAX_MCUS;
+    mc->default_ram_size = 1 * MiB;
+    mc->default_ram_id = "avr32.shared-ram";
+    mc->no_floppy = 1;
+    mc->no_cdrom = 1;
+    mc->no_parallel = 1;
+}
+
 static const TypeInfo avr32example_board_machine_types[] = {
         {
                 .name           = TYPE_AVR32EXAMPLE_BOARD_MACHINE,
@@ -91,6 +199,15 @@ static const TypeInfo avr32example_board_machine_types[] = {
                 .instance_size  = sizeof(AVR32ExampleBoardMachineState),
                 .class_size     = sizeof(AVR32ExampleBoardMachineClass),
                 .class_init     = avr32example_board_class_init,
+        }, {
+                .name           = TYPE_AVR32EXAMPLE_AP7000_BOARD_MACHINE,
+                .parent         = TYPE_AVR32EXAMPLE_BOARD_MACHINE,
+                .class_init     = avr32example_ap7000_board_class_init,
+        }, {
+                .name           = TYPE_AVR32EXAMPLE_MULTI_BOARD_MACHINE,
+                .parent         = TYPE_MACHINE,
+                .instance_size  = sizeof(AVR32ExampleMultiBoardMachineState),
+                .class_init     = avr32example_multi_board_class_init,
         }
 };
 
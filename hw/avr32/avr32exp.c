@@ -23,9 +23,9 @@
 #include "qemu/units.h"
 #include "qapi/error.h"
 #include "exec/memory.h"
-#include "exec/address-spaces.h"
 #include "sysemu/sysemu.h"
 #include "hw/qdev-properties.h"
+#include "hw/qdev-properties-system.h"
 #include "hw/sysbus.h"
 #include "qom/object.h"
 #include "hw/misc/unimp.h"
@@ -38,7 +38,10 @@ struct AVR32EXPMcuClass {
     /*< public >*/
     const char *cpu_type;
 
+    hwaddr flash_base;
     size_t flash_size;
+    hwaddr sram_base;
+    size_t sram_size;
 };
 
 typedef struct AVR32EXPMcuClass AVR32EXPMcuClass;
@@ -46,6 +49,104 @@ typedef struct AVR32EXPMcuClass AVR32EXPMcuClass;
 DECLARE_CLASS_CHECKERS(AVR32EXPMcuClass, AVR32EXP_MCU,
         TYPE_AVR32EXP_MCU)
 
+#define AVR32EXP_SRAM_BASE  0x00000000
+#define AVR32EXP_FLASH_BASE 0xd0000000
+#define AVR32EXP_PBB_BASE   0xfffe0000
+#define AVR32EXP_PBA_BASE   0xffff0000
+#define AVR32EXP_PB_SIZE    0x10000
+
+/*
+ * The AVR32B core resets to 0xa0000000, which P2 maps to physical 0, so
+ * the AP7000 has its boot flash there and the internal SRAM further up.
+ * The peripherals keep the layout below.
+ */
+#define AP7000_FLASH_BASE   0x00000000
+#define AP7000_SRAM_BASE    0x24000000
+
+/*
+ * UC3 style peripheral bus layout. Anything without a model is mapped as
+ * an unimplemented device, which logs accesses and reads as zero instead
+ * of faulting. Real models are mapped on top of these.
+ */
+static const struct {
+    const char *name;
+    hwaddr base;
+    hwaddr size;
+} avr32exp_peripherals[] = {
+    // PBB
+    { "usbb",   0xfffe0000, 0x1000 },
+    { "hmatrix", 0xfffe1000, 0x400 },
+    { "flashc", 0xfffe1400, 0x400 },
+    { "macb",   0xfffe1800, 0x400 },
+    { "smc",    0xfffe1c00, 0x400 },
+    { "sdramc", 0xfffe2000, 0x400 },
+    // PBA
+    { "pdca",   0xffff0000, 0x800 },
+    { "pm",     0xffff0c00, 0x100 },
+    { "rtc",    0xffff0d00, 0x30 },
+    { "wdt",    0xffff0d30, 0x50 },
+    { "eic",    0xffff0d80, 0x80 },
+    { "gpio",   0xffff1000, 0x400 },
+    { "usart0", 0xffff1400, 0x400 },
+    { "usart1", 0xffff1800, 0x400 },
+    { "usart2", 0xffff1c00, 0x400 },
+    { "usart3", 0xffff2000, 0x400 },
+    { "spi0",   0xffff2400, 0x400 },
+    { "spi1",   0xffff2800, 0x400 },
+    { "twi",    0xffff2c00, 0x400 },
+    { "pwm",    0xffff3000, 0x400 },
+    { "ssc",    0xffff3400, 0x400 },
+    { "tc",     0xffff3800, 0x400 },
+    { "adc",    0xffff3c00, 0x400 },
+};
+
+static const struct {
+    hwaddr base;
+    int irq_group;
+} avr32exp_usarts[AVR32EXP_NUM_USARTS] = {
+    { 0xffff1400, 5 },
+    { 0xffff1800, 6 },
+    { 0xffff1c00, 7 },
+    { 0xffff2000, 8 },
+};
+
+#define AVR32EXP_PDCA_BASE      0xffff0000
+#define AVR32EXP_PDCA_IRQ_GROUP 2
+
+#define AVR32EXP_FLASHC_BASE        0xfffe1400
+#define AVR32EXP_FLASHC_IRQ_GROUP   9
+
+static const AVR32PdcaPeripheralOps avr32exp_usart_rx_dma = {
+    .read = avr32_usart_dma_read,
+};
+
+static const AVR32PdcaPeripheralOps avr32exp_usart_tx_dma = {
+    .write = avr32_usart_dma_write,
+};
+
+/*
+ * Unimplemented devices are mapped into the MCU bus instead of the system
+ * memory, so several MCUs can coexist.
+ */
+static void avr32exp_create_unimp(AVR32EXPMcuState *s, const char *name,
+                                  hwaddr base, hwaddr size, int priority)
+{
+    DeviceState *dev = qdev_new(TYPE_UNIMPLEMENTED_DEVICE);
+
+    qdev_prop_set_string(dev, "name", name);
+    qdev_prop_set_uint64(dev, "size", size);
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(dev), &error_fatal);
+    memory_region_add_subregion_overlap(&s->bus, base,
+            sysbus_mmio_get_region(SYS_BUS_DEVICE(dev), 0), priority);
+}
+
+static void avr32exp_init(Object *obj)
+{
+    AVR32EXPMcuState *s = AVR32EXP_MCU(obj);
+
+    memory_region_init(&s->bus, obj, "avr32exp-bus", 1ull << 32);
+}
+
 // This functions sets up the device
 static void avr32exp_realize(DeviceState *dev, Error **errp)
 {
@@ -53,22 +154,115 @@ static void avr32exp_realize(DeviceState *dev, Error **errp)
     AVR32EXPMcuState *s = AVR32EXP_MCU(dev);
     const AVR32EXPMcuClass *mc = AVR32EXP_MCU_GET_CLASS(dev);
 
-    /* CPU */
+    /* CPU, it only sees this MCU's bus */
     object_initialize_child(OBJECT(dev), "cpu", &s->cpu, mc->cpu_type);
+    object_property_set_link(OBJECT(&s->cpu), "memory", OBJECT(&s->bus),
+                             &error_abort);
     object_property_set_bool(OBJECT(&s->cpu), "realized", true, &error_abort);
 
-    /* Flash */
-    memory_region_init_rom(&s->flash, OBJECT(dev),
-                           "flash", mc->flash_size, &error_fatal);
-    memory_region_add_subregion(get_system_memory(),
-                                0xd0000000, &s->flash);
+    /* Interrupt controller */
+    object_initialize_child(OBJECT(dev), "intc", &s->intc, TYPE_AVR32_INTC);
+    object_property_set_link(OBJECT(&s->intc), "cpu", OBJECT(&s->cpu),
+                             &error_abort);
+    sysbus_realize(SYS_BUS_DEVICE(&s->intc), &error_abort);
+    memory_region_add_subregion(&s->bus, 0xffff0800,
+            sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->intc), 0));
+
+    /* COUNT/COMPARE match is line 0 of group 0 */
+    qdev_connect_gpio_out_named(DEVICE(&s->cpu), "compare", 0,
+                                qdev_get_gpio_in(DEVICE(&s->intc),
+                                                 AVR32_INTC_IRQ(0, 0)));
+
+    /* Flash, behind the flash controller so firmware can reprogram it */
+    object_initialize_child(OBJECT(dev), "flashc", &s->flashc,
+                            TYPE_AVR32_FLASHC);
+    qdev_prop_set_uint32(DEVICE(&s->flashc), "flash-size", mc->flash_size);
+    sysbus_realize(SYS_BUS_DEVICE(&s->flashc), &error_abort);
+    memory_region_add_subregion(&s->bus, AVR32EXP_FLASHC_BASE,
+            sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->flashc), 0));
+    memory_region_add_subregion(&s->bus, mc->flash_base,
+            sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->flashc), 1));
+    sysbus_connect_irq(SYS_BUS_DEVICE(&s->flashc), 0,
+                       qdev_get_gpio_in(DEVICE(&s->intc),
+                           AVR32_INTC_IRQ(AVR32EXP_FLASHC_IRQ_GROUP, 0)));
+
+    /* SRAM, RAM backed so TCG accesses it directly */
+    memory_region_init_ram(&s->sram, OBJECT(dev), "sram", mc->sram_size,
+                           &error_fatal);
+    memory_region_add_subregion(&s->bus, mc->sram_base, &s->sram);
+
+    /* Peripheral buses, catch-all windows below the single devices */
+    avr32exp_create_unimp(s, "pbb", AVR32EXP_PBB_BASE, AVR32EXP_PB_SIZE, -1001);
+    avr32exp_create_unimp(s, "pba", AVR32EXP_PBA_BASE, AVR32EXP_PB_SIZE, -1001);
+    for (int i = 0; i < ARRAY_SIZE(avr32exp_peripherals); i++) {
+        avr32exp_create_unimp(s, avr32exp_peripherals[i].name,
+                              avr32exp_peripherals[i].base,
+                              avr32exp_peripherals[i].size, -1000);
+    }
+
+    /* PDCA, one interrupt line per channel */
+    object_initialize_child(OBJECT(dev), "pdca", &s->pdca, TYPE_AVR32_PDCA);
+    object_property_set_link(OBJECT(&s->pdca), "dma-mr", OBJECT(&s->bus),
+                             &error_abort);
+    sysbus_realize(SYS_BUS_DEVICE(&s->pdca), &error_abort);
+    memory_region_add_subregion(&s->bus, AVR32EXP_PDCA_BASE,
+            sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->pdca), 0));
+    for (int ch = 0; ch < AVR32_PDCA_CHANNELS; ch++) {
+        sysbus_connect_irq(SYS_BUS_DEVICE(&s->pdca), ch,
+                           qdev_get_gpio_in(DEVICE(&s->intc),
+                               AVR32_INTC_IRQ(AVR32EXP_PDCA_IRQ_GROUP, ch)));
+    }
+
+    /* USARTs, clocked from PBA which runs at the CPU clock */
+    for (int i = 0; i < AVR32EXP_NUM_USARTS; i++) {
+        g_autofree char *name = g_strdup_printf("usart%d", i);
+        SysBusDevice *sbd = SYS_BUS_DEVICE(&s->usart[i]);
+
+        object_initialize_child(OBJECT(dev), name, &s->usart[i],
+                                TYPE_AVR32_USART);
+        qdev_prop_set_chr(DEVICE(sbd), "chardev",
+                          serial_hd(s->serial_base + i));
+        qdev_prop_set_uint32(DEVICE(sbd), "clock-frequency",
+                             s->cpu.clock_speed);
+        sysbus_realize(sbd, &error_abort);
+        memory_region_add_subregion(&s->bus, avr32exp_usarts[i].base,
+                                    sysbus_mmio_get_region(sbd, 0));
+        sysbus_connect_irq(sbd, 0, qdev_get_gpio_in(DEVICE(&s->intc),
+                           AVR32_INTC_IRQ(avr32exp_usarts[i].irq_group, 0)));
+
+        avr32_pdca_connect(&s->pdca, AVR32_PDCA_PID_USART_RX(i),
+                           &avr32exp_usart_rx_dma, &s->usart[i]);
+        avr32_pdca_connect(&s->pdca, AVR32_PDCA_PID_USART_TX(i),
+                           &avr32exp_usart_tx_dma, &s->usart[i]);
+        qdev_connect_gpio_out_named(DEVICE(sbd), "rx-dreq", 0,
+                qdev_get_gpio_in_named(DEVICE(&s->pdca), "dreq",
+                                       AVR32_PDCA_PID_USART_RX(i)));
+        qdev_connect_gpio_out_named(DEVICE(sbd), "tx-dreq", 0,
+                qdev_get_gpio_in_named(DEVICE(&s->pdca), "dreq",
+                                       AVR32_PDCA_PID_USART_TX(i)));
+    }
+}
+
+// The CPU is not on a bus, so a system reset only reaches it through here
+static void avr32exp_reset(DeviceState *dev)
+{
+    AVR32EXPMcuState *s = AVR32EXP_MCU(dev);
+
+    cpu_reset(CPU(&s->cpu));
 }
 
+static Property avr32exp_properties[] = {
+    DEFINE_PROP_UINT32("serial-base", AVR32EXPMcuState, serial_base, 0),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void avr32exp_class_init(ObjectClass *oc, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(oc);
 
     dc->realize = avr32exp_realize;
+    dc->reset = avr32exp_reset;
+    device_class_set_props(dc, avr32exp_properties);
     dc->user_creatable = false;
 }
 
@@ -77,7 +271,21 @@ static void avr32exps_class_init(ObjectClass *oc, void *data){
     AVR32EXPMcuClass* avr32exp = AVR32EXP_MCU_CLASS(oc);
 
     avr32exp->cpu_type = AVR32A_CPU_TYPE_NAME("AVR32EXPC");
+    avr32exp->flash_base = AVR32EXP_FLASH_BASE;
+    avr32exp->flash_size = 1024 * KiB;
+    avr32exp->sram_base = AVR32EXP_SRAM_BASE;
+    avr32exp->sram_size = 64 * KiB;
+}
+
+static void ap7000_class_init(ObjectClass *oc, void *data){
+
+    AVR32EXPMcuClass* avr32exp = AVR32EXP_MCU_CLASS(oc);
+
+    avr32exp->cpu_type = AVR32A_CPU_TYPE_NAME("AP7000");
+    avr32exp->flash_base = AP7000_FLASH_BASE;
     avr32exp->flash_size = 1024 * KiB;
+    avr32exp->sram_base = AP7000_SRAM_BASE;
+    avr32exp->sram_size = 32 * KiB;
 }
 
 static const TypeInfo avr32exp_mcu_types[] = {
@@ -85,10 +293,15 @@ static const TypeInfo avr32exp_mcu_types[] = {
                 .name           = TYPE_AVR32EXPS_MCU,
                 .parent         = TYPE_AVR32EXP_MCU,
                 .class_init     = avr32exps_class_init,
+        }, {
+                .name           = TYPE_AP7000_MCU,
+                .parent         = TYPE_AVR32EXP_MCU,
+                .class_init     = ap7000_class_init,
         }, {
                 .name           = TYPE_AVR32EXP_MCU,
                 .parent         = TYPE_SYS_BUS_DEVICE,
                 .instance_size  = sizeof(AVR32EXPMcuState),
+                .instance_init  = avr32exp_init,
                 .class_size     = sizeof(AVR32EXPMcuClass),
                 .class_init     = avr32exp_class_init,
                 .abstract       = true,
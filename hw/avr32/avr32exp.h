@@ -23,9 +23,16 @@
 #include "target/avr32/cpu.h"
 #include "qom/object.h"
 #include "hw/sysbus.h"
+#include "avr32_intc.h"
+#include "hw/char/avr32_usart.h"
+#include "hw/dma/avr32_pdca.h"
+#include "hw/nvram/avr32_flashc.h"
 
 #define TYPE_AVR32EXP_MCU "AVR32EXP"
 #define TYPE_AVR32EXPS_MCU "AVR32EXPS"
+#define TYPE_AP7000_MCU "AP7000"
+
+#define AVR32EXP_NUM_USARTS 4
 
 typedef struct AVR32EXPMcuState AVR32EXPMcuState;
 DECLARE_INSTANCE_CHECKER(AVR32EXPMcuState, AVR32EXP_MCU, TYPE_AVR32EXP_MCU)
@@ -35,8 +42,17 @@ struct AVR32EXPMcuState {
     SysBusDevice parent_obj;
 
     /*< public >*/
+    // Everything the CPU sees, the board maps it where it needs it
+    MemoryRegion bus;
     AVR32ACPU cpu;
-    MemoryRegion flash;
+    AVR32IntcState intc;
+    AVR32FlashcState flashc;
+    MemoryRegion sram;
+    AVR32PdcaState pdca;
+    AVR32UsartState usart[AVR32EXP_NUM_USARTS];
+
+    // USART n is connected to serial_hd(serial_base + n)
+    uint32_t serial_base;
 };
 
 #endif // HW_AVR32_AVR32EXPC_H
\ No newline at end of file
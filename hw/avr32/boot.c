@@ -23,132 +23,134 @@
 #include "boot.h"
 #include "qemu/error-report.h"
 #include "elf.h"
-#include <string.h>
 #include "hw/core/tcg-cpu-ops.h"
 #include "exec/exec-all.h"
 #include "target/avr32/helper_elf.h"
 
-void avr32_copy_text_section(int e_shnum, FILE* file, Elf32_Shdr** sh_table, char *sh_strtable, FILE* output){
-    int text_section_idx = -1;
-    for(int i= 0; i< e_shnum; i++){
-        if(strcmp(&sh_strtable[sh_table[i]->sh_name], ".text") == 0){
-            text_section_idx = i;
-            break;
-        }
-    }
-    if(text_section_idx >= 0){
-        printf("[AVR32-BOOT] Text section is at index %i\n", text_section_idx);
-    }
-    else{
-        error_report("[AVR32-BOOT] Unable to find .text section!\n");
-        exit(1);
-    }
+/*
+ * Flash behind a controller is a ROM device the guest can reprogram. A ROM
+ * blob would be copied back over it on every reset, so the image is written
+ * into its storage once instead.
+ */
+static bool avr32_load_direct(MemoryRegion *mr, hwaddr addr, uint64_t size)
+{
+    return memory_region_is_romd(mr) && addr >= mr->addr &&
+           size <= memory_region_size(mr) &&
+           addr - mr->addr <= memory_region_size(mr) - size;
+}
 
-    char *buffer = malloc(sh_table[text_section_idx]->sh_size);
-    fseek(file, sh_table[text_section_idx]->sh_offset, SEEK_SET);
-    int res = fread(buffer, 1, sh_table[text_section_idx]->sh_size, file);
-    printf("[AVR32-BOOT] Loaded 0x%x bytes from .text section\n", res);
-    fwrite(buffer, 1, res, output);
-    free(buffer);
+static ssize_t avr32_load_raw_direct(const char *filename, MemoryRegion *mr)
+{
+    int64_t size = get_image_size(filename);
+
+    if (size < 0 || !avr32_load_direct(mr, mr->addr, size) ||
+        load_image_size(filename, memory_region_get_ram_ptr(mr),
+                        size) != size) {
+        return -1;
+    }
+    memory_region_set_dirty(mr, 0, size);
+    return size;
 }
 
-void avr32_copy_data_section(int e_shnum, FILE* file, Elf32_Shdr** sh_table, char *sh_strtable, FILE* output){
-    int data_section_idx = -1;
-    for(int i= 0; i< e_shnum; i++){
-        if(strcmp(&sh_strtable[sh_table[i]->sh_name], ".data") == 0){
-            data_section_idx = i;
-            break;
-        }
+bool avr32_load_elf_file(AVR32ACPU *cpu, const char *filename,
+                         MemoryRegion *program_mr)
+{
+    g_autoptr(GError) err = NULL;
+    GMappedFile *mapped;
+    uint8_t *data;
+    size_t len;
+    Elf32_Ehdr header;
+    Elf32_Phdr phdr;
+    uint32_t image_base = UINT32_MAX;
+    uint64_t image_size = memory_region_size(program_mr);
+    bool ok = false;
+
+    mapped = g_mapped_file_new(filename, FALSE, &err);
+    if (!mapped) {
+        error_report("[AVR32-BOOT] Cannot map firmware image %s: %s",
+                     filename, err->message);
+        return false;
+    }
+    data = (uint8_t *)g_mapped_file_get_contents(mapped);
+    len = g_mapped_file_get_length(mapped);
+
+    if (len < sizeof(header)) {
+        error_report("[AVR32-BOOT] Cannot read firmware image header");
+        goto out;
     }
-    if(data_section_idx >= 0){
-        printf("[AVR32-BOOT] Data section is at index %i\n", data_section_idx);
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.e_ident, ELFMAG, SELFMAG) != 0) {
+        error_report("[AVR32-BOOT] ELF file is not valid!");
+        goto out;
     }
-    else{
-        error_report("[AVR32-BOOT] Unable to find .data section.\n");
-        return;
+    avr32_convert_elf_header(&header);
+    if (header.e_machine != EM_AVR32) {
+        error_report("[AVR32-BOOT] Firmware file is not an AVR32 file!");
+        goto out;
     }
-    if(sh_table[data_section_idx]->sh_size <= 0){
-        printf("[AVR32-BOOT] Data section has size 0, skipping.\n");
-        return;
+    if (header.e_phentsize < sizeof(phdr) ||
+        header.e_phoff > len ||
+        (uint64_t)header.e_phnum * header.e_phentsize > len - header.e_phoff) {
+        error_report("[AVR32-BOOT] Invalid program header table");
+        goto out;
     }
-    int padding_size = sh_table[data_section_idx]->sh_offset - (sh_table[data_section_idx - 1]->sh_offset + sh_table[data_section_idx - 1]->sh_size) - sh_table[data_section_idx]->sh_addr;
-    printf("[AVR32-BOOT] Data section padding size: 0x%x\n", padding_size);
-    char *buffer = malloc(padding_size);
-    memset(buffer, 0, padding_size);
-    fwrite(buffer, 1, padding_size, output);
-    free(buffer);
-
-    buffer = malloc(sh_table[data_section_idx]->sh_size);
-    fseek(file, sh_table[data_section_idx]->sh_offset, SEEK_SET);
-    int res = fread(buffer, 1, sh_table[data_section_idx]->sh_size, file);
-    printf("[AVR32-BOOT] Loaded 0x%x bytes from .data section\n", res);
-    fwrite(buffer, 1, res, output);
-    free(buffer);
-}
-
-void avr32_copy_sections(int e_shnum, FILE* file, Elf32_Shdr** sh_table, char *sh_strtable, MemoryRegion *program_mr){
-    FILE *output = fopen("/tmp/qemu_avr32_tmp_text_sec", "wb");
-    avr32_copy_text_section(e_shnum, file, sh_table, sh_strtable, output);
-    avr32_copy_data_section(e_shnum, file, sh_table, sh_strtable, output);
-    fclose(output);
-
 
-    int bytes_loaded = load_image_mr("/tmp/qemu_avr32_tmp_text_sec", program_mr);
-    if (bytes_loaded < 0) {
-        error_report("[AVR32-BOOT] Unable to load firmware image %s as raw binary",
-                     "/tmp/qemu_avr32_tmp_text_sec");
-        exit(1);
+    // The image is based at its lowest initialised load address
+    for (int i = 0; i < header.e_phnum; i++) {
+        memcpy(&phdr, data + header.e_phoff + i * header.e_phentsize,
+               sizeof(phdr));
+        avr32_convert_elf_program_header(&phdr);
+        if (phdr.p_type == PT_LOAD && phdr.p_filesz) {
+            image_base = MIN(image_base, phdr.p_paddr);
+        }
     }
-    printf("[AVR32-BOOT] Binary data successfully loaded\n");
-    remove("/tmp/qemu_avr32_tmp_text_sec");
-    printf("[AVR32-BOOT] Removed temp firmware file\n");
-}
 
-bool avr32_load_elf_file(AVR32ACPU *cpu, const char *filename, MemoryRegion *program_mr){
-    printf("[AVR32-BOOT] Loading firmware images as ELF file\n");
+    for (int i = 0; i < header.e_phnum; i++) {
+        g_autofree char *name = NULL;
+        hwaddr addr;
 
-    Elf32_Ehdr header;
-    FILE* file = fopen(filename, "rb");
-    char *sh_strtable = 0;
-    Elf32_Shdr** sh_table = 0;
-    if(file) {
-        // read the header
-        int res = fread(&header, 1, sizeof(header), file);
-
-        if(res <= 0){
-            error_report("[AVR32-BOOT] Cannot read firmware image header\n");
-            exit(1);
+        memcpy(&phdr, data + header.e_phoff + i * header.e_phentsize,
+               sizeof(phdr));
+        avr32_convert_elf_program_header(&phdr);
+        if (phdr.p_type != PT_LOAD || !phdr.p_memsz) {
+            continue;
         }
-        // check if it's really an elf file
-        if (memcmp(header.e_ident, ELFMAG, SELFMAG) == 0) {
-            avr32_convert_elf_header(&header);
-            if(header.e_machine == EM_AVR32){
-                sh_table = malloc(header.e_shnum * sizeof (Elf32_Shdr*));
-
-                avr32_elf_read_section_headers(&header, file, sh_table);
-                sh_strtable = (char *)malloc(sh_table[header.e_shstrndx]->sh_size * sizeof(char));
-
-                avr32_elf_read_sh_string_table(&header, file, sh_table, sh_strtable);
-                avr32_copy_sections(header.e_shnum, file, sh_table, sh_strtable, program_mr);
-
-            }
-            else{
-                error_report("[AVR32-BOOT] Firmware file is not an AVR32 file!\n");
-            }
+        if (phdr.p_filesz > phdr.p_memsz ||
+            phdr.p_offset > len || phdr.p_filesz > len - phdr.p_offset) {
+            error_report("[AVR32-BOOT] PT_LOAD segment %d exceeds the file", i);
+            goto out;
         }
-        else{
-            error_report("[AVR32-BOOT] ELF file is not valid!\n");
-            exit(1);
+
+        addr = phdr.p_paddr;
+        if (phdr.p_paddr >= image_base &&
+            phdr.p_paddr - image_base < image_size) {
+            addr = program_mr->addr + (phdr.p_paddr - image_base);
+        }
+
+        if (avr32_load_direct(program_mr, addr, phdr.p_memsz)) {
+            uint8_t *dest = memory_region_get_ram_ptr(program_mr);
+
+            dest += addr - program_mr->addr;
+            memcpy(dest, data + phdr.p_offset, phdr.p_filesz);
+            memset(dest + phdr.p_filesz, 0, phdr.p_memsz - phdr.p_filesz);
+            memory_region_set_dirty(program_mr, addr - program_mr->addr,
+                                    phdr.p_memsz);
+            continue;
         }
-    }
 
-    fclose(file);
-    free(sh_strtable);
-    for(int i= 0; i< header.e_shnum; i++){
-        free(sh_table[i]);
+        name = g_strdup_printf("%s ELF program header segment %d",
+                               filename, i);
+        rom_add_elf_program(name, mapped, data + phdr.p_offset,
+                            phdr.p_filesz, phdr.p_memsz, addr,
+                            CPU(cpu)->as);
     }
-    free(sh_table);
-    return true;
+    avr32_elf_load_symbols(&header, data, len, image_base, image_size,
+                           program_mr->addr);
+    ok = true;
+
+out:
+    g_mapped_file_unref(mapped);
+    return ok;
 }
 
 bool avr32_load_firmware(AVR32ACPU *cpu, MachineState *ms,
@@ -161,12 +163,16 @@ bool avr32_load_firmware(AVR32ACPU *cpu, MachineState *ms,
     }
 
     if(avr32_is_elf_file(AVR32_FIRMWARE_FILE)){
-        //TODO: For some reason QEMU internal ELF-loaders fail to load an AVR32 Elf file. For now we use a custom elf-loader to extract the .text section from an elf-file.
-        avr32_load_elf_file(cpu, AVR32_FIRMWARE_FILE, program_mr);
+        //TODO: For some reason QEMU internal ELF-loaders fail to load an AVR32 Elf file. For now we use a custom elf-loader that walks the program headers.
+        if (!avr32_load_elf_file(cpu, AVR32_FIRMWARE_FILE, program_mr)) {
+            return false;
+        }
     }
     else{
         printf("[AVR32-BOOT]: Loading firmware images as raw binary\n");
-        int bytes_loaded = load_image_mr(AVR32_FIRMWARE_FILE, program_mr);
+        int bytes_loaded = memory_region_is_romd(program_mr) ?
+            avr32_load_raw_direct(AVR32_FIRMWARE_FILE, program_mr) :
+            load_image_mr(AVR32_FIRMWARE_FILE, program_mr);
         if (bytes_loaded < 0) {
             error_report("[AVR32-BOOT] Unable to load firmware image %s as raw binary",
                          firmware);
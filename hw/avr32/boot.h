@@ -39,9 +39,24 @@
  */
 bool avr32_load_firmware(AVR32ACPU *cpu, MachineState *ms,
                          MemoryRegion *mr, const char *firmware);
-bool avr32_load_elf_file(AVR32ACPU *cpu, const char *filename, MemoryRegion *program_mr);
-void avr32_copy_sections(int e_shnum, FILE* file, Elf32_Shdr** sh_table, char *sh_strtable, MemoryRegion *program_mr);
-void avr32_copy_text_section(int e_shnum, FILE* file, Elf32_Shdr** sh_table, char *sh_strtable, FILE* output);
-void avr32_copy_data_section(int e_shnum, FILE* file, Elf32_Shdr** sh_table, char *sh_strtable, FILE* output);
+
+/**
+ * avr32_load_elf_file:   load the PT_LOAD segments of an ELF image
+ *
+ * @cpu:        Handle a AVR CPU object
+ * @filename:   Path to the ELF file
+ * @program_mr: Memory Region the image is linked for
+ *
+ * Every PT_LOAD segment is registered as a ROM blob straight from the
+ * read-only mapped file, the part of p_memsz beyond p_filesz is zeroed.
+ * Segments that fall within the image, counted from its lowest load
+ * address, are placed into @program_mr. All others, e.g. .bss in SRAM,
+ * are loaded at their physical address as seen by @cpu. The function
+ * symbols are registered for lookup_symbol().
+ *
+ * Returns: true on success, false on error.
+ */
+bool avr32_load_elf_file(AVR32ACPU *cpu, const char *filename,
+                         MemoryRegion *program_mr);
 
 #endif // HW_AVR32_BOOT_H
@@ -0,0 +1,561 @@
+/*
+ * QEMU AVR32 USART
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+
+/*
+ * Asynchronous mode of the UC3 USART only. The single RHR/THR holding
+ * registers are backed by FIFOs, so the chardev backend is fed in batches:
+ *
+ * - THR writes are queued and handed to the backend in one write, either
+ *   when the FIFO fills up or from a bottom half once the guest stops
+ *   writing. TXRDY stays set while there is room, TXEMPTY once everything
+ *   went out.
+ * - The backend may push up to a FIFO worth of data at once. RXRDY is set
+ *   while data is queued, but its interrupt only fires once the FIFO holds
+ *   "rx-trigger" bytes, or the line has been idle for 4 character times.
+ *   The TXRDY interrupt fires at or below "tx-trigger" queued bytes.
+ *
+ * All other interrupt sources behave as on hardware, CSR & IMR.
+ *
+ * The "rx-dreq" and "tx-dreq" outputs request PDCA service. The PDCA then
+ * moves whole buffers through avr32_usart_dma_read/write() instead of
+ * one RHR/THR access per character.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/main-loop.h"
+#include "qapi/error.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/qdev-properties-system.h"
+#include "migration/vmstate.h"
+#include "hw/char/avr32_usart.h"
+
+#define USART_CR        0x00
+#define USART_MR        0x04
+#define USART_IER       0x08
+#define USART_IDR       0x0c
+#define USART_IMR       0x10
+#define USART_CSR       0x14
+#define USART_RHR       0x18
+#define USART_THR       0x1c
+#define USART_BRGR      0x20
+#define USART_RTOR      0x24
+#define USART_TTGR      0x28
+#define USART_VERSION   0xfc
+#define USART_MMIO_SIZE 0x400
+
+#define USART_VERSION_VALUE 0x00000440
+
+#define CR_RSTRX        (1u << 2)
+#define CR_RSTTX        (1u << 3)
+#define CR_RXEN         (1u << 4)
+#define CR_RXDIS        (1u << 5)
+#define CR_TXEN         (1u << 6)
+#define CR_TXDIS        (1u << 7)
+#define CR_RSTSTA       (1u << 8)
+
+#define MR_OVER         (1u << 19)
+
+#define CSR_RXRDY       (1u << 0)
+#define CSR_TXRDY       (1u << 1)
+#define CSR_RXBRK       (1u << 2)
+#define CSR_OVRE        (1u << 5)
+#define CSR_FRAME       (1u << 6)
+#define CSR_PARE        (1u << 7)
+#define CSR_TIMEOUT     (1u << 8)
+#define CSR_TXEMPTY     (1u << 9)
+#define CSR_STATIC      (CSR_RXBRK | CSR_OVRE | CSR_FRAME | CSR_PARE | \
+                         CSR_TIMEOUT)
+#define CSR_IRQ_MASK    0x000f3fff
+
+#define BRGR_CD         0xffff
+
+// Used while the baud rate generator is off
+#define USART_DEFAULT_BAUD  115200
+
+static uint32_t avr32_usart_csr(AVR32UsartState *s)
+{
+    uint32_t csr = s->csr & CSR_STATIC;
+
+    if (!fifo8_is_empty(&s->rx_fifo)) {
+        csr |= CSR_RXRDY;
+    }
+    if (s->tx_enabled && s->tx_level < AVR32_USART_FIFO_SIZE) {
+        csr |= CSR_TXRDY;
+    }
+    if (s->tx_enabled && !s->tx_level) {
+        csr |= CSR_TXEMPTY;
+    }
+    return csr;
+}
+
+static void avr32_usart_update_irq(AVR32UsartState *s)
+{
+    uint32_t pending = avr32_usart_csr(s) & s->imr & ~(CSR_RXRDY | CSR_TXRDY);
+    uint32_t rx_level = fifo8_num_used(&s->rx_fifo);
+
+    if ((s->imr & CSR_RXRDY) && rx_level &&
+        (rx_level >= s->rx_trigger || s->rx_timeout)) {
+        pending |= CSR_RXRDY;
+    }
+    if ((s->imr & CSR_TXRDY) && s->tx_enabled &&
+        s->tx_level <= s->tx_trigger) {
+        pending |= CSR_TXRDY;
+    }
+    qemu_set_irq(s->irq, pending != 0);
+
+    qemu_set_irq(s->rx_dreq, !fifo8_is_empty(&s->rx_fifo));
+    qemu_set_irq(s->tx_dreq,
+                 s->tx_enabled && s->tx_level < AVR32_USART_FIFO_SIZE);
+}
+
+// Nanoseconds for one 10 bit character at the programmed baud rate
+static uint64_t avr32_usart_char_time(AVR32UsartState *s)
+{
+    uint32_t cd = s->brgr & BRGR_CD;
+    uint64_t baud = USART_DEFAULT_BAUD;
+
+    if (cd && s->clock_frequency) {
+        baud = s->clock_frequency / ((s->mr & MR_OVER ? 8 : 16) * cd);
+    }
+    return NANOSECONDS_PER_SECOND * 10 / MAX(baud, 1);
+}
+
+static gboolean avr32_usart_xmit(void *do_not_use, GIOCondition cond,
+                                 void *opaque)
+{
+    AVR32UsartState *s = opaque;
+    int ret;
+
+    s->tx_watch = 0;
+
+    // Without a backend the data is dropped right away
+    if (!qemu_chr_fe_backend_connected(&s->chr)) {
+        s->tx_level = 0;
+    } else if (s->tx_level) {
+        ret = qemu_chr_fe_write(&s->chr, s->tx_fifo, s->tx_level);
+        if (ret > 0) {
+            s->tx_level -= ret;
+            memmove(s->tx_fifo, s->tx_fifo + ret, s->tx_level);
+        }
+        if (s->tx_level) {
+            s->tx_watch = qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
+                                                avr32_usart_xmit, s);
+            if (!s->tx_watch) {
+                s->tx_level = 0;
+            }
+        }
+    }
+
+    avr32_usart_update_irq(s);
+    return G_SOURCE_REMOVE;
+}
+
+static void avr32_usart_tx_bh(void *opaque)
+{
+    AVR32UsartState *s = opaque;
+
+    // A pending watch flushes the FIFO once the backend is ready
+    if (!s->tx_watch) {
+        avr32_usart_xmit(NULL, G_IO_OUT, s);
+    }
+}
+
+// Queue as much of @buf as fits, returns the number of bytes taken
+static size_t avr32_usart_queue_tx(AVR32UsartState *s, const uint8_t *buf,
+                                   size_t len)
+{
+    size_t done = 0;
+
+    if (!s->tx_enabled) {
+        return 0;
+    }
+
+    while (done < len) {
+        size_t n = MIN(len - done, AVR32_USART_FIFO_SIZE - s->tx_level);
+
+        if (!n) {
+            break;
+        }
+        memcpy(s->tx_fifo + s->tx_level, buf + done, n);
+        s->tx_level += n;
+        done += n;
+        if (s->tx_level < AVR32_USART_FIFO_SIZE) {
+            break;
+        }
+        // Full, hand it over now and refill from what the backend took
+        avr32_usart_tx_bh(s);
+    }
+
+    if (s->tx_level) {
+        qemu_bh_schedule(s->tx_bh);
+    }
+    avr32_usart_update_irq(s);
+    return done;
+}
+
+static void avr32_usart_write_thr(AVR32UsartState *s, uint8_t c)
+{
+    if (s->tx_enabled && s->tx_level == AVR32_USART_FIFO_SIZE) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: THR written while TXRDY is low\n",
+                      __func__);
+        return;
+    }
+    avr32_usart_queue_tx(s, &c, 1);
+}
+
+size_t avr32_usart_dma_write(void *opaque, const uint8_t *buf, size_t len)
+{
+    return avr32_usart_queue_tx(opaque, buf, len);
+}
+
+static void avr32_usart_rx_timeout_cb(void *opaque)
+{
+    AVR32UsartState *s = opaque;
+
+    s->rx_timeout = true;
+    avr32_usart_update_irq(s);
+}
+
+static int avr32_usart_can_receive(void *opaque)
+{
+    AVR32UsartState *s = opaque;
+
+    return s->rx_enabled ? fifo8_num_free(&s->rx_fifo) : 0;
+}
+
+static void avr32_usart_receive(void *opaque, const uint8_t *buf, int size)
+{
+    AVR32UsartState *s = opaque;
+
+    fifo8_push_all(&s->rx_fifo, buf, size);
+    if (fifo8_num_used(&s->rx_fifo) < s->rx_trigger) {
+        timer_mod(s->rx_timeout_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  4 * avr32_usart_char_time(s));
+    } else {
+        timer_del(s->rx_timeout_timer);
+    }
+    avr32_usart_update_irq(s);
+}
+
+static uint32_t avr32_usart_read_rhr(AVR32UsartState *s)
+{
+    if (fifo8_is_empty(&s->rx_fifo)) {
+        // RHR keeps the last character
+        return s->rhr;
+    }
+
+    s->rhr = fifo8_pop(&s->rx_fifo);
+    if (fifo8_is_empty(&s->rx_fifo)) {
+        s->rx_timeout = false;
+        timer_del(s->rx_timeout_timer);
+    }
+    qemu_chr_fe_accept_input(&s->chr);
+    avr32_usart_update_irq(s);
+    return s->rhr;
+}
+
+size_t avr32_usart_dma_read(void *opaque, uint8_t *buf, size_t len)
+{
+    AVR32UsartState *s = opaque;
+    size_t done = 0;
+
+    while (done < len && !fifo8_is_empty(&s->rx_fifo)) {
+        uint32_t n;
+        const uint8_t *data = fifo8_pop_buf(&s->rx_fifo, len - done, &n);
+
+        memcpy(buf + done, data, n);
+        done += n;
+    }
+    if (!done) {
+        return 0;
+    }
+
+    s->rhr = buf[done - 1];
+    if (fifo8_is_empty(&s->rx_fifo)) {
+        s->rx_timeout = false;
+        timer_del(s->rx_timeout_timer);
+    }
+    qemu_chr_fe_accept_input(&s->chr);
+    avr32_usart_update_irq(s);
+    return done;
+}
+
+static void avr32_usart_reset_rx(AVR32UsartState *s)
+{
+    fifo8_reset(&s->rx_fifo);
+    s->rx_enabled = false;
+    s->rx_timeout = false;
+    timer_del(s->rx_timeout_timer);
+}
+
+static void avr32_usart_reset_tx(AVR32UsartState *s)
+{
+    if (s->tx_watch) {
+        g_source_remove(s->tx_watch);
+        s->tx_watch = 0;
+    }
+    qemu_bh_cancel(s->tx_bh);
+    s->tx_level = 0;
+    s->tx_enabled = false;
+}
+
+static void avr32_usart_write_cr(AVR32UsartState *s, uint32_t val)
+{
+    if (val & CR_RSTRX) {
+        avr32_usart_reset_rx(s);
+    }
+    if (val & CR_RSTTX) {
+        avr32_usart_reset_tx(s);
+    }
+    // Disabling wins over enabling
+    if (val & CR_RXDIS) {
+        s->rx_enabled = false;
+    } else if (val & CR_RXEN) {
+        s->rx_enabled = true;
+        qemu_chr_fe_accept_input(&s->chr);
+    }
+    if (val & CR_TXDIS) {
+        s->tx_enabled = false;
+    } else if (val & CR_TXEN) {
+        s->tx_enabled = true;
+    }
+    if (val & CR_RSTSTA) {
+        s->csr &= ~CSR_STATIC;
+    }
+    avr32_usart_update_irq(s);
+}
+
+static uint64_t avr32_usart_read(void *opaque, hwaddr addr, unsigned size)
+{
+    AVR32UsartState *s = opaque;
+
+    switch (addr) {
+    case USART_MR:
+        return s->mr;
+    case USART_IMR:
+        return s->imr;
+    case USART_CSR:
+        return avr32_usart_csr(s);
+    case USART_RHR:
+        return avr32_usart_read_rhr(s);
+    case USART_BRGR:
+        return s->brgr;
+    case USART_RTOR:
+        return s->rtor;
+    case USART_TTGR:
+        return s->ttgr;
+    case USART_VERSION:
+        return USART_VERSION_VALUE;
+    case USART_CR:
+    case USART_IER:
+    case USART_IDR:
+    case USART_THR:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: write-only offset 0x%" HWADDR_PRIx
+                      "\n", __func__, addr);
+        return 0;
+    default:
+        qemu_log_mask(LOG_UNIMP, "%s: unimplemented offset 0x%" HWADDR_PRIx
+                      "\n", __func__, addr);
+        return 0;
+    }
+}
+
+static void avr32_usart_write(void *opaque, hwaddr addr, uint64_t val,
+                              unsigned size)
+{
+    AVR32UsartState *s = opaque;
+
+    switch (addr) {
+    case USART_CR:
+        avr32_usart_write_cr(s, val);
+        break;
+    case USART_MR:
+        s->mr = val;
+        break;
+    case USART_IER:
+        s->imr |= val & CSR_IRQ_MASK;
+        avr32_usart_update_irq(s);
+        break;
+    case USART_IDR:
+        s->imr &= ~val;
+        avr32_usart_update_irq(s);
+        break;
+    case USART_THR:
+        avr32_usart_write_thr(s, val);
+        break;
+    case USART_BRGR:
+        s->brgr = val;
+        break;
+    case USART_RTOR:
+        s->rtor = val;
+        break;
+    case USART_TTGR:
+        s->ttgr = val;
+        break;
+    case USART_IMR:
+    case USART_CSR:
+    case USART_RHR:
+    case USART_VERSION:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: read-only offset 0x%" HWADDR_PRIx
+                      "\n", __func__, addr);
+        break;
+    default:
+        qemu_log_mask(LOG_UNIMP, "%s: unimplemented offset 0x%" HWADDR_PRIx
+                      "\n", __func__, addr);
+        break;
+    }
+}
+
+static const MemoryRegionOps avr32_usart_ops = {
+    .read = avr32_usart_read,
+    .write = avr32_usart_write,
+    .endianness = DEVICE_BIG_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+static void avr32_usart_reset(DeviceState *dev)
+{
+    AVR32UsartState *s = AVR32_USART(dev);
+
+    avr32_usart_reset_rx(s);
+    avr32_usart_reset_tx(s);
+    s->mr = 0;
+    s->imr = 0;
+    s->csr = 0;
+    s->rhr = 0;
+    s->brgr = 0;
+    s->rtor = 0;
+    s->ttgr = 0;
+    avr32_usart_update_irq(s);
+}
+
+static void avr32_usart_init(Object *obj)
+{
+    AVR32UsartState *s = AVR32_USART(obj);
+
+    memory_region_init_io(&s->mmio, obj, &avr32_usart_ops, s,
+                          TYPE_AVR32_USART, USART_MMIO_SIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->mmio);
+    sysbus_init_irq(SYS_BUS_DEVICE(obj), &s->irq);
+    qdev_init_gpio_out_named(DEVICE(obj), &s->rx_dreq, "rx-dreq", 1);
+    qdev_init_gpio_out_named(DEVICE(obj), &s->tx_dreq, "tx-dreq", 1);
+}
+
+static void avr32_usart_realize(DeviceState *dev, Error **errp)
+{
+    AVR32UsartState *s = AVR32_USART(dev);
+
+    if (!s->rx_trigger || s->rx_trigger > AVR32_USART_FIFO_SIZE) {
+        error_setg(errp, "%s: 'rx-trigger' must be within 1 and %d",
+                   TYPE_AVR32_USART, AVR32_USART_FIFO_SIZE);
+        return;
+    }
+    if (s->tx_trigger >= AVR32_USART_FIFO_SIZE) {
+        error_setg(errp, "%s: 'tx-trigger' must be below %d",
+                   TYPE_AVR32_USART, AVR32_USART_FIFO_SIZE);
+        return;
+    }
+
+    fifo8_create(&s->rx_fifo, AVR32_USART_FIFO_SIZE);
+    s->rx_timeout_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                       avr32_usart_rx_timeout_cb, s);
+    s->tx_bh = qemu_bh_new(avr32_usart_tx_bh, s);
+    qemu_chr_fe_set_handlers(&s->chr, avr32_usart_can_receive,
+                             avr32_usart_receive, NULL, NULL, s, NULL, true);
+}
+
+static int avr32_usart_post_load(void *opaque, int version_id)
+{
+    AVR32UsartState *s = opaque;
+
+    // The FIFO levels and head index buffers, do not trust the stream
+    if (s->tx_level > ARRAY_SIZE(s->tx_fifo) ||
+        s->rx_fifo.head >= s->rx_fifo.capacity ||
+        s->rx_fifo.num > s->rx_fifo.capacity) {
+        return -EINVAL;
+    }
+    // Watches and bottom halves are not migrated, restart the flush
+    if (s->tx_level) {
+        qemu_bh_schedule(s->tx_bh);
+    }
+    return 0;
+}
+
+static const VMStateDescription vmstate_avr32_usart = {
+    .name = TYPE_AVR32_USART,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = avr32_usart_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(mr, AVR32UsartState),
+        VMSTATE_UINT32(imr, AVR32UsartState),
+        VMSTATE_UINT32(csr, AVR32UsartState),
+        VMSTATE_UINT32(brgr, AVR32UsartState),
+        VMSTATE_UINT32(rtor, AVR32UsartState),
+        VMSTATE_UINT32(ttgr, AVR32UsartState),
+        VMSTATE_BOOL(rx_enabled, AVR32UsartState),
+        VMSTATE_BOOL(tx_enabled, AVR32UsartState),
+        VMSTATE_FIFO8(rx_fifo, AVR32UsartState),
+        VMSTATE_UINT32(rhr, AVR32UsartState),
+        VMSTATE_UINT8_ARRAY(tx_fifo, AVR32UsartState, AVR32_USART_FIFO_SIZE),
+        VMSTATE_UINT32(tx_level, AVR32UsartState),
+        VMSTATE_BOOL(rx_timeout, AVR32UsartState),
+        VMSTATE_TIMER_PTR(rx_timeout_timer, AVR32UsartState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property avr32_usart_properties[] = {
+    DEFINE_PROP_CHR("chardev", AVR32UsartState, chr),
+    DEFINE_PROP_UINT32("clock-frequency", AVR32UsartState, clock_frequency,
+                       0),
+    DEFINE_PROP_UINT8("rx-trigger", AVR32UsartState, rx_trigger,
+                      AVR32_USART_FIFO_SIZE / 4),
+    DEFINE_PROP_UINT8("tx-trigger", AVR32UsartState, tx_trigger,
+                      AVR32_USART_FIFO_SIZE / 4),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void avr32_usart_class_init(ObjectClass *oc, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(oc);
+
+    dc->realize = avr32_usart_realize;
+    dc->reset = avr32_usart_reset;
+    dc->vmsd = &vmstate_avr32_usart;
+    device_class_set_props(dc, avr32_usart_properties);
+}
+
+static const TypeInfo avr32_usart_types[] = {
+        {
+                .name           = TYPE_AVR32_USART,
+                .parent         = TYPE_SYS_BUS_DEVICE,
+                .instance_size  = sizeof(AVR32UsartState),
+                .instance_init  = avr32_usart_init,
+                .class_init     = avr32_usart_class_init,
+        }
+};
+
+DEFINE_TYPES(avr32_usart_types)
@@ -0,0 +1,425 @@
+/*
+ * QEMU AVR32 Peripheral DMA Controller (PDCA)
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+
+/*
+ * Transfers are not emulated beat by beat. While a channel is enabled and
+ * its peripheral requests service, the remaining buffer is mapped with
+ * dma_memory_map() and handed to the peripheral in one call, which copies
+ * as much as it can straight into or out of guest RAM. This repeats until
+ * the peripheral stalls or TCR and TCRR are used up. Halfword and word
+ * transfers carry one character per beat and go through a small buffer.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/bswap.h"
+#include "qapi/error.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+#include "sysemu/dma.h"
+#include "hw/dma/avr32_pdca.h"
+
+#define PDCA_CHANNEL_SIZE   0x40
+#define PDCA_MMIO_SIZE      0x800
+
+#define PDCA_MAR    0x00
+#define PDCA_PSR    0x04
+#define PDCA_TCR    0x08
+#define PDCA_MARR   0x0c
+#define PDCA_TCRR   0x10
+#define PDCA_CR     0x14
+#define PDCA_MR     0x18
+#define PDCA_SR     0x1c
+#define PDCA_IER    0x20
+#define PDCA_IDR    0x24
+#define PDCA_IMR    0x28
+#define PDCA_ISR    0x2c
+
+#define PDCA_TCR_MASK   0xffff
+#define PDCA_PSR_MASK   0xff
+#define PDCA_MR_SIZE    0x3
+
+#define CR_TEN      (1u << 0)
+#define CR_TDIS     (1u << 1)
+#define CR_ECLR     (1u << 8)
+
+#define SR_TEN      (1u << 0)
+
+#define ISR_RCZ     (1u << 0)
+#define ISR_TRC     (1u << 1)
+#define ISR_TERR    (1u << 2)
+#define ISR_MASK    (ISR_RCZ | ISR_TRC | ISR_TERR)
+
+// Beats staged per call for halfword and word transfers
+#define PDCA_WIDE_CHUNK 64
+
+static uint32_t avr32_pdca_isr(AVR32PdcaChannel *c)
+{
+    uint32_t isr = 0;
+
+    if (!c->tcrr) {
+        isr |= ISR_RCZ;
+    }
+    if (!c->tcr) {
+        isr |= ISR_TRC;
+    }
+    if (c->terr) {
+        isr |= ISR_TERR;
+    }
+    return isr;
+}
+
+static void avr32_pdca_update_irq(AVR32PdcaState *s, int ch)
+{
+    AVR32PdcaChannel *c = &s->chan[ch];
+
+    qemu_set_irq(s->irq[ch], (avr32_pdca_isr(c) & c->imr) != 0);
+}
+
+// One character per beat, the character is the low byte of the beat
+static size_t avr32_pdca_xfer_wide(AVR32PdcaPeripheral *p, uint8_t *buf,
+                                   size_t beats, int size, bool to_mem)
+{
+    uint8_t tmp[PDCA_WIDE_CHUNK];
+    size_t done = 0;
+
+    while (done < beats) {
+        size_t len = MIN(beats - done, PDCA_WIDE_CHUNK);
+        size_t n;
+
+        if (to_mem) {
+            n = p->ops->read(p->opaque, tmp, len);
+            for (size_t i = 0; i < n; i++) {
+                stn_be_p(buf + (done + i) * size, size, tmp[i]);
+            }
+        } else {
+            for (size_t i = 0; i < len; i++) {
+                tmp[i] = ldn_be_p(buf + (done + i) * size, size);
+            }
+            n = p->ops->write(p->opaque, tmp, len);
+        }
+        done += n;
+        if (n < len) {
+            break;
+        }
+    }
+    return done;
+}
+
+static void avr32_pdca_run(AVR32PdcaState *s, int ch)
+{
+    AVR32PdcaChannel *c = &s->chan[ch];
+    AVR32PdcaPeripheral *p;
+    int shift = MIN(c->mr & PDCA_MR_SIZE, 2);
+    bool to_mem;
+    DMADirection dir;
+
+    if (!c->enabled || c->psr >= AVR32_PDCA_PIDS ||
+        !(s->dreq & (1u << c->psr)) || !s->periph[c->psr].ops) {
+        return;
+    }
+    p = &s->periph[c->psr];
+    to_mem = p->ops->read != NULL;
+    dir = to_mem ? DMA_DIRECTION_FROM_DEVICE : DMA_DIRECTION_TO_DEVICE;
+
+    while (c->enabled && c->tcr) {
+        dma_addr_t len = (dma_addr_t)c->tcr << shift;
+        size_t beats, n;
+        void *buf;
+
+        buf = dma_memory_map(&s->dma_as, c->mar, &len, dir,
+                             MEMTXATTRS_UNSPECIFIED);
+        beats = len >> shift;
+        if (!buf || !beats) {
+            if (buf) {
+                dma_memory_unmap(&s->dma_as, buf, len, dir, 0);
+            }
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: channel %d cannot access "
+                          "0x%08" PRIx32 "\n", __func__, ch, c->mar);
+            c->terr = true;
+            c->enabled = false;
+            break;
+        }
+
+        if (shift) {
+            n = avr32_pdca_xfer_wide(p, buf, beats, 1 << shift, to_mem);
+        } else if (to_mem) {
+            n = p->ops->read(p->opaque, buf, beats);
+        } else {
+            n = p->ops->write(p->opaque, buf, beats);
+        }
+        dma_memory_unmap(&s->dma_as, buf, len, dir, n << shift);
+        if (!n) {
+            break;
+        }
+
+        c->mar += n << shift;
+        c->tcr -= n;
+        if (!c->tcr && c->tcrr) {
+            c->mar = c->marr;
+            c->tcr = c->tcrr;
+            c->tcrr = 0;
+        }
+    }
+    avr32_pdca_update_irq(s, ch);
+}
+
+static void avr32_pdca_run_pid(AVR32PdcaState *s, unsigned int pid)
+{
+    // The peripherals raise their request again from within a transfer
+    if (s->running) {
+        return;
+    }
+    s->running = true;
+    for (int ch = 0; ch < AVR32_PDCA_CHANNELS; ch++) {
+        if (s->chan[ch].psr == pid) {
+            avr32_pdca_run(s, ch);
+        }
+    }
+    s->running = false;
+}
+
+static void avr32_pdca_set_dreq(void *opaque, int pid, int level)
+{
+    AVR32PdcaState *s = opaque;
+
+    if (level) {
+        s->dreq |= 1u << pid;
+        avr32_pdca_run_pid(s, pid);
+    } else {
+        s->dreq &= ~(1u << pid);
+    }
+}
+
+void avr32_pdca_connect(AVR32PdcaState *s, unsigned int pid,
+                        const AVR32PdcaPeripheralOps *ops, void *opaque)
+{
+    assert(pid < AVR32_PDCA_PIDS);
+    s->periph[pid].ops = ops;
+    s->periph[pid].opaque = opaque;
+}
+
+static uint64_t avr32_pdca_read(void *opaque, hwaddr addr, unsigned size)
+{
+    AVR32PdcaState *s = opaque;
+    int ch = addr / PDCA_CHANNEL_SIZE;
+    AVR32PdcaChannel *c;
+
+    if (ch >= AVR32_PDCA_CHANNELS) {
+        qemu_log_mask(LOG_UNIMP, "%s: unimplemented offset 0x%" HWADDR_PRIx
+                      "\n", __func__, addr);
+        return 0;
+    }
+    c = &s->chan[ch];
+
+    switch (addr % PDCA_CHANNEL_SIZE) {
+    case PDCA_MAR:
+        return c->mar;
+    case PDCA_PSR:
+        return c->psr;
+    case PDCA_TCR:
+        return c->tcr;
+    case PDCA_MARR:
+        return c->marr;
+    case PDCA_TCRR:
+        return c->tcrr;
+    case PDCA_MR:
+        return c->mr;
+    case PDCA_SR:
+        return c->enabled ? SR_TEN : 0;
+    case PDCA_IMR:
+        return c->imr;
+    case PDCA_ISR:
+        return avr32_pdca_isr(c);
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, addr);
+        return 0;
+    }
+}
+
+static void avr32_pdca_write(void *opaque, hwaddr addr, uint64_t val,
+                             unsigned size)
+{
+    AVR32PdcaState *s = opaque;
+    int ch = addr / PDCA_CHANNEL_SIZE;
+    AVR32PdcaChannel *c;
+
+    if (ch >= AVR32_PDCA_CHANNELS) {
+        qemu_log_mask(LOG_UNIMP, "%s: unimplemented offset 0x%" HWADDR_PRIx
+                      "\n", __func__, addr);
+        return;
+    }
+    c = &s->chan[ch];
+
+    switch (addr % PDCA_CHANNEL_SIZE) {
+    case PDCA_MAR:
+        c->mar = val;
+        break;
+    case PDCA_PSR:
+        c->psr = val & PDCA_PSR_MASK;
+        break;
+    case PDCA_TCR:
+        c->tcr = val & PDCA_TCR_MASK;
+        break;
+    case PDCA_MARR:
+        c->marr = val;
+        break;
+    case PDCA_TCRR:
+        c->tcrr = val & PDCA_TCR_MASK;
+        break;
+    case PDCA_CR:
+        if (val & CR_ECLR) {
+            c->terr = false;
+        }
+        if (val & CR_TDIS) {
+            c->enabled = false;
+        } else if ((val & CR_TEN) && !c->terr) {
+            c->enabled = true;
+        }
+        break;
+    case PDCA_MR:
+        c->mr = val & PDCA_MR_SIZE;
+        break;
+    case PDCA_IER:
+        c->imr |= val & ISR_MASK;
+        break;
+    case PDCA_IDR:
+        c->imr &= ~val;
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, addr);
+        return;
+    }
+
+    // Any write may enable a channel or give it a new buffer
+    if (!s->running) {
+        s->running = true;
+        avr32_pdca_run(s, ch);
+        s->running = false;
+    }
+    avr32_pdca_update_irq(s, ch);
+}
+
+static const MemoryRegionOps avr32_pdca_ops = {
+    .read = avr32_pdca_read,
+    .write = avr32_pdca_write,
+    .endianness = DEVICE_BIG_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+static void avr32_pdca_reset(DeviceState *dev)
+{
+    AVR32PdcaState *s = AVR32_PDCA(dev);
+
+    memset(s->chan, 0, sizeof(s->chan));
+    // dreq follows the input lines and is not touched by reset
+    for (int ch = 0; ch < AVR32_PDCA_CHANNELS; ch++) {
+        avr32_pdca_update_irq(s, ch);
+    }
+}
+
+static void avr32_pdca_init(Object *obj)
+{
+    AVR32PdcaState *s = AVR32_PDCA(obj);
+
+    memory_region_init_io(&s->mmio, obj, &avr32_pdca_ops, s,
+                          TYPE_AVR32_PDCA, PDCA_MMIO_SIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->mmio);
+    for (int ch = 0; ch < AVR32_PDCA_CHANNELS; ch++) {
+        sysbus_init_irq(SYS_BUS_DEVICE(obj), &s->irq[ch]);
+    }
+    qdev_init_gpio_in_named(DEVICE(obj), avr32_pdca_set_dreq, "dreq",
+                            AVR32_PDCA_PIDS);
+}
+
+static void avr32_pdca_realize(DeviceState *dev, Error **errp)
+{
+    AVR32PdcaState *s = AVR32_PDCA(dev);
+
+    if (!s->dma_mr) {
+        error_setg(errp, "%s: 'dma-mr' link not set", TYPE_AVR32_PDCA);
+        return;
+    }
+    address_space_init(&s->dma_as, s->dma_mr, TYPE_AVR32_PDCA);
+}
+
+static const VMStateDescription vmstate_avr32_pdca_channel = {
+    .name = TYPE_AVR32_PDCA "/channel",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(mar, AVR32PdcaChannel),
+        VMSTATE_UINT32(psr, AVR32PdcaChannel),
+        VMSTATE_UINT32(tcr, AVR32PdcaChannel),
+        VMSTATE_UINT32(marr, AVR32PdcaChannel),
+        VMSTATE_UINT32(tcrr, AVR32PdcaChannel),
+        VMSTATE_UINT32(mr, AVR32PdcaChannel),
+        VMSTATE_UINT32(imr, AVR32PdcaChannel),
+        VMSTATE_BOOL(enabled, AVR32PdcaChannel),
+        VMSTATE_BOOL(terr, AVR32PdcaChannel),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_avr32_pdca = {
+    .name = TYPE_AVR32_PDCA,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT_ARRAY(chan, AVR32PdcaState, AVR32_PDCA_CHANNELS, 1,
+                             vmstate_avr32_pdca_channel, AVR32PdcaChannel),
+        VMSTATE_UINT32(dreq, AVR32PdcaState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property avr32_pdca_properties[] = {
+    DEFINE_PROP_LINK("dma-mr", AVR32PdcaState, dma_mr, TYPE_MEMORY_REGION,
+                     MemoryRegion *),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void avr32_pdca_class_init(ObjectClass *oc, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(oc);
+
+    dc->realize = avr32_pdca_realize;
+    dc->reset = avr32_pdca_reset;
+    dc->vmsd = &vmstate_avr32_pdca;
+    device_class_set_props(dc, avr32_pdca_properties);
+}
+
+static const TypeInfo avr32_pdca_types[] = {
+        {
+                .name           = TYPE_AVR32_PDCA,
+                .parent         = TYPE_SYS_BUS_DEVICE,
+                .instance_size  = sizeof(AVR32PdcaState),
+                .instance_init  = avr32_pdca_init,
+                .class_init     = avr32_pdca_class_init,
+        }
+};
+
+DEFINE_TYPES(avr32_pdca_types)
@@ -0,0 +1,445 @@
+/*
+ * QEMU AVR32 Flash Controller (FLASHC)
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+
+/*
+ * The flash array is a ROM device in ROMD mode, so instruction fetches and
+ * loads hit its RAM directly. Only stores trap into the model, they fill
+ * the page buffer. Commands written to FCMD complete at once, FRDY is
+ * never low. Programming or erasing a page invalidates just the TBs
+ * translated from that page, through memory_region_flush_rom_device().
+ * A TB that is already running finishes with the old code, like an
+ * instruction already fetched from flash.
+ *
+ * The lock bits are general purpose fuses 15:0, fuse state and flash
+ * contents survive a reset. For the contents that relies on the firmware
+ * loader writing the image into the array instead of registering a ROM
+ * blob, see avr32_load_firmware(). The security bit and the user page are
+ * not modelled.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/bitmap.h"
+#include "qemu/bswap.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+#include "hw/nvram/avr32_flashc.h"
+
+#define FLASHC_FCR      0x00
+#define FLASHC_FCMD     0x04
+#define FLASHC_FSR      0x08
+#define FLASHC_FGPFRHI  0x0c
+#define FLASHC_FGPFRLO  0x10
+#define FLASHC_MMIO_SIZE 0x400
+
+#define FCR_FRDY        (1u << 0)
+#define FCR_LOCKE       (1u << 2)
+#define FCR_PROGE       (1u << 3)
+#define FCR_FWS         (1u << 6)
+#define FCR_MASK        (FCR_FRDY | FCR_LOCKE | FCR_PROGE | FCR_FWS)
+
+#define FCMD_CMD_MASK   0x3f
+#define FCMD_PAGEN_SHIFT 8
+#define FCMD_PAGEN_MASK 0xffff
+#define FCMD_KEY_SHIFT  24
+#define FCMD_KEY        0xa5
+
+#define FSR_FRDY        (1u << 0)
+#define FSR_LOCKE       (1u << 2)
+#define FSR_PROGE       (1u << 3)
+#define FSR_QPRR        (1u << 5)
+#define FSR_FSZ_SHIFT   13
+#define FSR_LOCK_SHIFT  16
+
+enum {
+    CMD_NOP,
+    CMD_WP,         // write page
+    CMD_EP,         // erase page
+    CMD_CPB,        // clear page buffer
+    CMD_LP,         // lock region containing page
+    CMD_UP,         // unlock region containing page
+    CMD_EA,         // erase all
+    CMD_WGPB,       // write general purpose fuse bit
+    CMD_EGPB,       // erase general purpose fuse bit
+    CMD_SSB,        // set security bit
+    CMD_PGPFB,      // program general purpose fuse byte
+    CMD_EAGPF,      // erase all general purpose fuses
+    CMD_QPR,        // quick page read
+    CMD_WUP,        // write user page
+    CMD_EUP,        // erase user page
+    CMD_QPRUP,      // quick page read user page
+};
+
+// FSR.FSZ, flash sizes in KiB
+static const uint32_t flashc_fsz[] = { 32, 64, 128, 256, 384, 512, 768, 1024 };
+
+static uint32_t avr32_flashc_pages(AVR32FlashcState *s)
+{
+    return s->flash_size / AVR32_FLASHC_PAGE_SIZE;
+}
+
+static uint32_t avr32_flashc_region(AVR32FlashcState *s, uint32_t page)
+{
+    return page / (avr32_flashc_pages(s) / AVR32_FLASHC_LOCK_REGIONS);
+}
+
+static bool avr32_flashc_locked(AVR32FlashcState *s, uint32_t page)
+{
+    return !(s->gpf & (1ull << avr32_flashc_region(s, page)));
+}
+
+static void avr32_flashc_update_irq(AVR32FlashcState *s)
+{
+    // FRDY is always set
+    uint32_t pending = (s->fsr | FSR_FRDY) & s->fcr;
+
+    qemu_set_irq(s->irq, !!(pending & (FCR_FRDY | FCR_LOCKE | FCR_PROGE)));
+}
+
+static void avr32_flashc_write_page(AVR32FlashcState *s, uint32_t page)
+{
+    uint8_t *p = s->storage + page * AVR32_FLASHC_PAGE_SIZE;
+
+    // Programming only clears bits, erased flash reads as all ones
+    for (int i = 0; i < AVR32_FLASHC_PAGE_SIZE; i++) {
+        p[i] &= s->page_buffer[i];
+    }
+    memory_region_flush_rom_device(&s->flash, page * AVR32_FLASHC_PAGE_SIZE,
+                                   AVR32_FLASHC_PAGE_SIZE);
+    set_bit(page, s->written);
+}
+
+static void avr32_flashc_erase_page(AVR32FlashcState *s, uint32_t page)
+{
+    memset(s->storage + page * AVR32_FLASHC_PAGE_SIZE, 0xff,
+           AVR32_FLASHC_PAGE_SIZE);
+    memory_region_flush_rom_device(&s->flash, page * AVR32_FLASHC_PAGE_SIZE,
+                                   AVR32_FLASHC_PAGE_SIZE);
+    set_bit(page, s->written);
+}
+
+void avr32_flashc_reset_written(AVR32FlashcState *s, uint64_t tag)
+{
+    bitmap_zero(s->written, avr32_flashc_pages(s));
+    s->written_tag = tag;
+}
+
+void avr32_flashc_restore_page(AVR32FlashcState *s, uint32_t page,
+                               const uint8_t *data)
+{
+    memcpy(s->storage + page * AVR32_FLASHC_PAGE_SIZE, data,
+           AVR32_FLASHC_PAGE_SIZE);
+    memory_region_flush_rom_device(&s->flash, page * AVR32_FLASHC_PAGE_SIZE,
+                                   AVR32_FLASHC_PAGE_SIZE);
+    set_bit(page, s->written);
+}
+
+static bool avr32_flashc_page_erased(AVR32FlashcState *s, uint32_t page)
+{
+    uint8_t *p = s->storage + page * AVR32_FLASHC_PAGE_SIZE;
+
+    for (int i = 0; i < AVR32_FLASHC_PAGE_SIZE; i++) {
+        if (p[i] != 0xff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void avr32_flashc_command(AVR32FlashcState *s, uint32_t cmd,
+                                 uint32_t pagen)
+{
+    bool page_cmd = cmd == CMD_WP || cmd == CMD_EP || cmd == CMD_LP ||
+                    cmd == CMD_UP || cmd == CMD_QPR;
+
+    if (page_cmd && pagen >= avr32_flashc_pages(s)) {
+        s->fsr |= FSR_PROGE;
+        return;
+    }
+    if ((cmd == CMD_WP || cmd == CMD_EP) && avr32_flashc_locked(s, pagen)) {
+        s->fsr |= FSR_LOCKE;
+        return;
+    }
+
+    switch (cmd) {
+    case CMD_NOP:
+        break;
+    case CMD_WP:
+        avr32_flashc_write_page(s, pagen);
+        break;
+    case CMD_EP:
+        avr32_flashc_erase_page(s, pagen);
+        break;
+    case CMD_CPB:
+        memset(s->page_buffer, 0xff, sizeof(s->page_buffer));
+        break;
+    case CMD_LP:
+        s->gpf &= ~(1ull << avr32_flashc_region(s, pagen));
+        break;
+    case CMD_UP:
+        s->gpf |= 1ull << avr32_flashc_region(s, pagen);
+        break;
+    case CMD_EA:
+        if ((uint16_t)s->gpf != 0xffff) {
+            s->fsr |= FSR_LOCKE;
+            break;
+        }
+        memset(s->storage, 0xff, s->flash_size);
+        memory_region_flush_rom_device(&s->flash, 0, s->flash_size);
+        bitmap_set(s->written, 0, avr32_flashc_pages(s));
+        break;
+    case CMD_WGPB:
+        s->gpf &= ~(1ull << (pagen & 0x3f));
+        break;
+    case CMD_EGPB:
+        s->gpf |= 1ull << (pagen & 0x3f);
+        break;
+    case CMD_PGPFB: {
+        // PAGEN[2:0] selects the byte, PAGEN[10:3] is the data
+        int shift = (pagen & 0x7) * 8;
+
+        s->gpf &= ~(0xffull << shift) |
+                  ((uint64_t)((pagen >> 3) & 0xff) << shift);
+        break;
+    }
+    case CMD_EAGPF:
+        s->gpf = ~0ull;
+        break;
+    case CMD_QPR:
+        s->qprr = avr32_flashc_page_erased(s, pagen);
+        break;
+    case CMD_SSB:
+    case CMD_WUP:
+    case CMD_EUP:
+    case CMD_QPRUP:
+        qemu_log_mask(LOG_UNIMP, "%s: command %u not implemented\n",
+                      __func__, cmd);
+        break;
+    default:
+        s->fsr |= FSR_PROGE;
+        break;
+    }
+}
+
+static uint32_t avr32_flashc_fsz(AVR32FlashcState *s)
+{
+    for (int i = 0; i < ARRAY_SIZE(flashc_fsz); i++) {
+        if (s->flash_size <= flashc_fsz[i] * KiB) {
+            return i;
+        }
+    }
+    return ARRAY_SIZE(flashc_fsz) - 1;
+}
+
+static uint64_t avr32_flashc_read(void *opaque, hwaddr addr, unsigned size)
+{
+    AVR32FlashcState *s = opaque;
+    uint32_t val;
+
+    switch (addr) {
+    case FLASHC_FCR:
+        return s->fcr;
+    case FLASHC_FCMD:
+        return s->fcmd;
+    case FLASHC_FSR:
+        val = FSR_FRDY | s->fsr | (s->qprr ? FSR_QPRR : 0) |
+              avr32_flashc_fsz(s) << FSR_FSZ_SHIFT |
+              (uint32_t)(uint16_t)~s->gpf << FSR_LOCK_SHIFT;
+        s->fsr = 0;
+        avr32_flashc_update_irq(s);
+        return val;
+    case FLASHC_FGPFRHI:
+        return s->gpf >> 32;
+    case FLASHC_FGPFRLO:
+        return (uint32_t)s->gpf;
+    }
+
+    qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                  __func__, addr);
+    return 0;
+}
+
+static void avr32_flashc_write(void *opaque, hwaddr addr, uint64_t val,
+                               unsigned size)
+{
+    AVR32FlashcState *s = opaque;
+
+    switch (addr) {
+    case FLASHC_FCR:
+        s->fcr = val & FCR_MASK;
+        break;
+    case FLASHC_FCMD:
+        if ((val >> FCMD_KEY_SHIFT) != FCMD_KEY) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: FCMD written without key\n",
+                          __func__);
+            return;
+        }
+        // KEY reads as zero
+        s->fcmd = val & ((FCMD_PAGEN_MASK << FCMD_PAGEN_SHIFT) | FCMD_CMD_MASK);
+        avr32_flashc_command(s, val & FCMD_CMD_MASK,
+                             (val >> FCMD_PAGEN_SHIFT) & FCMD_PAGEN_MASK);
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, addr);
+        return;
+    }
+    avr32_flashc_update_irq(s);
+}
+
+static const MemoryRegionOps avr32_flashc_ops = {
+    .read = avr32_flashc_read,
+    .write = avr32_flashc_write,
+    .endianness = DEVICE_BIG_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+static uint64_t avr32_flashc_flash_read(void *opaque, hwaddr addr,
+                                        unsigned size)
+{
+    // Always in ROMD mode, reads never get here
+    g_assert_not_reached();
+}
+
+// Any address of the array writes the page buffer, the page is in FCMD
+static void avr32_flashc_flash_write(void *opaque, hwaddr addr, uint64_t val,
+                                     unsigned size)
+{
+    AVR32FlashcState *s = opaque;
+
+    stl_be_p(s->page_buffer + (addr & (AVR32_FLASHC_PAGE_SIZE - 4)), val);
+}
+
+static const MemoryRegionOps avr32_flashc_flash_ops = {
+    .read = avr32_flashc_flash_read,
+    .write = avr32_flashc_flash_write,
+    .endianness = DEVICE_BIG_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+static void avr32_flashc_init(Object *obj)
+{
+    AVR32FlashcState *s = AVR32_FLASHC(obj);
+
+    memory_region_init_io(&s->mmio, obj, &avr32_flashc_ops, s,
+                          TYPE_AVR32_FLASHC, FLASHC_MMIO_SIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->mmio);
+    sysbus_init_irq(SYS_BUS_DEVICE(obj), &s->irq);
+    s->gpf = ~0ull;
+}
+
+static void avr32_flashc_realize(DeviceState *dev, Error **errp)
+{
+    ERRP_GUARD();
+    AVR32FlashcState *s = AVR32_FLASHC(dev);
+
+    if (!s->flash_size ||
+        s->flash_size % (AVR32_FLASHC_PAGE_SIZE * AVR32_FLASHC_LOCK_REGIONS)) {
+        error_setg(errp, "%s: 'flash-size' must be a multiple of %d",
+                   TYPE_AVR32_FLASHC,
+                   AVR32_FLASHC_PAGE_SIZE * AVR32_FLASHC_LOCK_REGIONS);
+        return;
+    }
+    memory_region_init_rom_device(&s->flash, OBJECT(dev),
+                                  &avr32_flashc_flash_ops, s, "flash",
+                                  s->flash_size, errp);
+    if (*errp) {
+        return;
+    }
+    s->storage = memory_region_get_ram_ptr(&s->flash);
+    // Erased, the firmware loader writes the image over it once
+    memset(s->storage, 0xff, s->flash_size);
+    s->written = bitmap_new(avr32_flashc_pages(s));
+    sysbus_init_mmio(SYS_BUS_DEVICE(dev), &s->flash);
+}
+
+static void avr32_flashc_reset(DeviceState *dev)
+{
+    AVR32FlashcState *s = AVR32_FLASHC(dev);
+
+    s->fcr = 0;
+    s->fcmd = 0;
+    s->fsr = 0;
+    s->qprr = false;
+    memset(s->page_buffer, 0xff, sizeof(s->page_buffer));
+    avr32_flashc_update_irq(s);
+}
+
+static int avr32_flashc_post_load(void *opaque, int version_id)
+{
+    AVR32FlashcState *s = opaque;
+
+    // The array was loaded behind the back of the written bitmap
+    s->written_tag = 0;
+    return 0;
+}
+
+static const VMStateDescription vmstate_avr32_flashc = {
+    .name = TYPE_AVR32_FLASHC,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = avr32_flashc_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(fcr, AVR32FlashcState),
+        VMSTATE_UINT32(fcmd, AVR32FlashcState),
+        VMSTATE_UINT32(fsr, AVR32FlashcState),
+        VMSTATE_BOOL(qprr, AVR32FlashcState),
+        VMSTATE_UINT64(gpf, AVR32FlashcState),
+        VMSTATE_UINT8_ARRAY(page_buffer, AVR32FlashcState,
+                            AVR32_FLASHC_PAGE_SIZE),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property avr32_flashc_properties[] = {
+    DEFINE_PROP_UINT32("flash-size", AVR32FlashcState, flash_size, 512 * KiB),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void avr32_flashc_class_init(ObjectClass *oc, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(oc);
+
+    dc->realize = avr32_flashc_realize;
+    dc->reset = avr32_flashc_reset;
+    dc->vmsd = &vmstate_avr32_flashc;
+    device_class_set_props(dc, avr32_flashc_properties);
+}
+
+static const TypeInfo avr32_flashc_types[] = {
+        {
+                .name           = TYPE_AVR32_FLASHC,
+                .parent         = TYPE_SYS_BUS_DEVICE,
+                .instance_size  = sizeof(AVR32FlashcState),
+                .instance_init  = avr32_flashc_init,
+                .class_init     = avr32_flashc_class_init,
+        }
+};
+
+DEFINE_TYPES(avr32_flashc_types)
@@ -0,0 +1,77 @@
+/*
+ * QEMU AVR32 USART
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+#ifndef HW_CHAR_AVR32_USART_H
+#define HW_CHAR_AVR32_USART_H
+
+#include "hw/sysbus.h"
+#include "chardev/char-fe.h"
+#include "qemu/fifo8.h"
+#include "qemu/timer.h"
+#include "qom/object.h"
+
+#define TYPE_AVR32_USART "avr32-usart"
+OBJECT_DECLARE_SIMPLE_TYPE(AVR32UsartState, AVR32_USART)
+
+#define AVR32_USART_FIFO_SIZE   64
+
+struct AVR32UsartState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+
+    /*< public >*/
+    MemoryRegion mmio;
+    CharBackend chr;
+    qemu_irq irq;
+    // PDCA handshake, high while RHR holds data or THR has room
+    qemu_irq rx_dreq;
+    qemu_irq tx_dreq;
+
+    uint32_t mr;
+    uint32_t imr;
+    uint32_t csr;
+    uint32_t brgr;
+    uint32_t rtor;
+    uint32_t ttgr;
+    bool rx_enabled;
+    bool tx_enabled;
+
+    Fifo8 rx_fifo;
+    uint32_t rhr;
+    // Linear, so a partial backend write keeps the rest in place
+    uint8_t tx_fifo[AVR32_USART_FIFO_SIZE];
+    uint32_t tx_level;
+    // RX data idle for 4 character times, report it below the trigger level
+    bool rx_timeout;
+    QEMUTimer *rx_timeout_timer;
+    // Flushes the TX FIFO to the backend once the guest stops writing
+    QEMUBH *tx_bh;
+    guint tx_watch;
+
+    // Properties
+    uint32_t clock_frequency;
+    uint8_t rx_trigger;
+    uint8_t tx_trigger;
+};
+
+// PDCA data path, RX fills the PDCA buffer, TX drains it
+size_t avr32_usart_dma_read(void *opaque, uint8_t *buf, size_t len);
+size_t avr32_usart_dma_write(void *opaque, const uint8_t *buf, size_t len);
+
+#endif // HW_CHAR_AVR32_USART_H
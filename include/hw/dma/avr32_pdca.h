@@ -0,0 +1,96 @@
+/*
+ * QEMU AVR32 Peripheral DMA Controller (PDCA)
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+#ifndef HW_DMA_AVR32_PDCA_H
+#define HW_DMA_AVR32_PDCA_H
+
+#include "hw/sysbus.h"
+#include "qom/object.h"
+
+#define TYPE_AVR32_PDCA "avr32-pdca"
+OBJECT_DECLARE_SIMPLE_TYPE(AVR32PdcaState, AVR32_PDCA)
+
+#define AVR32_PDCA_CHANNELS     15
+#define AVR32_PDCA_PIDS         18
+
+// UC3A peripheral identifiers, the value of a channel's PSR
+#define AVR32_PDCA_PID_USART_RX(n)  (2 + (n))
+#define AVR32_PDCA_PID_USART_TX(n)  (10 + (n))
+
+/*
+ * Data path of a peripheral, it only implements the direction it serves.
+ * Both move up to @len bytes in one call and return how many were moved,
+ * 0 once the peripheral has nothing more to give or take.
+ */
+typedef struct AVR32PdcaPeripheralOps {
+    // Peripheral to memory, copy received bytes into @buf
+    size_t (*read)(void *opaque, uint8_t *buf, size_t len);
+    // Memory to peripheral, take bytes from @buf
+    size_t (*write)(void *opaque, const uint8_t *buf, size_t len);
+} AVR32PdcaPeripheralOps;
+
+typedef struct AVR32PdcaPeripheral {
+    const AVR32PdcaPeripheralOps *ops;
+    void *opaque;
+} AVR32PdcaPeripheral;
+
+typedef struct AVR32PdcaChannel {
+    uint32_t mar;
+    uint32_t psr;
+    uint32_t tcr;
+    uint32_t marr;
+    uint32_t tcrr;
+    uint32_t mr;
+    uint32_t imr;
+    bool enabled;
+    bool terr;
+} AVR32PdcaChannel;
+
+struct AVR32PdcaState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+
+    /*< public >*/
+    MemoryRegion mmio;
+    MemoryRegion *dma_mr;
+    AddressSpace dma_as;
+    qemu_irq irq[AVR32_PDCA_CHANNELS];
+
+    AVR32PdcaChannel chan[AVR32_PDCA_CHANNELS];
+    AVR32PdcaPeripheral periph[AVR32_PDCA_PIDS];
+    // Level of the "dreq" input lines, one bit per peripheral identifier
+    uint32_t dreq;
+    bool running;
+};
+
+/**
+ * avr32_pdca_connect:   attach the data path of a peripheral
+ *
+ * @s:      The PDCA
+ * @pid:    Peripheral identifier, as written to PSR
+ * @ops:    Data path, called with the BQL held
+ * @opaque: Passed to @ops
+ *
+ * The peripheral also drives "dreq" input @pid while it can move data,
+ * channels selecting @pid only transfer while it is high.
+ */
+void avr32_pdca_connect(AVR32PdcaState *s, unsigned int pid,
+                        const AVR32PdcaPeripheralOps *ops, void *opaque);
+
+#endif // HW_DMA_AVR32_PDCA_H
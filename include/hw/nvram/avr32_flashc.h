@@ -0,0 +1,85 @@
+/*
+ * QEMU AVR32 Flash Controller (FLASHC)
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+#ifndef HW_NVRAM_AVR32_FLASHC_H
+#define HW_NVRAM_AVR32_FLASHC_H
+
+#include "hw/sysbus.h"
+#include "qom/object.h"
+
+#define TYPE_AVR32_FLASHC "avr32-flashc"
+OBJECT_DECLARE_SIMPLE_TYPE(AVR32FlashcState, AVR32_FLASHC)
+
+#define AVR32_FLASHC_PAGE_SIZE      512
+#define AVR32_FLASHC_LOCK_REGIONS   16
+
+struct AVR32FlashcState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+
+    /*< public >*/
+    MemoryRegion mmio;
+    // The flash array, a ROM device: reads are plain RAM accesses
+    MemoryRegion flash;
+    uint8_t *storage;
+    qemu_irq irq;
+
+    uint32_t fcr;
+    uint32_t fcmd;
+    // LOCKE and PROGE, cleared when FSR is read
+    uint32_t fsr;
+    bool qprr;
+    // General purpose fuses, bit n cleared locks region n
+    uint64_t gpf;
+    // Flash writes land here, WP programs it into the page in FCMD
+    uint8_t page_buffer[AVR32_FLASHC_PAGE_SIZE];
+    // Pages programmed or erased since avr32_flashc_reset_written()
+    unsigned long *written;
+    // What the array held at that point, as tagged by the caller, 0: unknown
+    uint64_t written_tag;
+
+    // Properties
+    uint32_t flash_size;
+};
+
+/**
+ * avr32_flashc_reset_written:   start tracking writes to the flash array
+ *
+ * @s:      The flash controller
+ * @tag:    Non-zero tag for the current contents of the array
+ *
+ * Clears the written bitmap. Until the next call, s->written has a bit set
+ * for every page the guest programmed or erased, and s->written_tag is @tag
+ * unless the array changed in a way the bitmap cannot follow.
+ */
+void avr32_flashc_reset_written(AVR32FlashcState *s, uint64_t tag);
+
+/**
+ * avr32_flashc_restore_page:   overwrite a page of the flash array
+ *
+ * @s:      The flash controller
+ * @page:   The page number
+ * @data:   AVR32_FLASHC_PAGE_SIZE bytes of new contents
+ *
+ * Only the TBs translated from this page are invalidated.
+ */
+void avr32_flashc_restore_page(AVR32FlashcState *s, uint32_t page,
+                               const uint8_t *data);
+
+#endif // HW_NVRAM_AVR32_FLASHC_H
@@ -27,13 +27,10 @@
 #include "exec/address-spaces.h"
 #include "exec/helper-proto.h"
 
-static AVR32ACPU * cpu_self;
-static bool first_reset = true;
-
 static void avr32_cpu_disas_set_info(CPUState *cpu, disassemble_info *info)
 {
-    printf("[AVR32-DISAS] avr32_cpu_disas_set_info\n");
     info->mach = bfd_arch_avr32;
+    info->print_insn = avr32_print_insn;
 }
 
 static void avr32a_cpu_init(Object* obj)
@@ -44,22 +41,30 @@ static void avr32a_cpu_init(Object* obj)
 
     cpu_set_cpustate_pointers(cpu);
     cs->env_ptr = env;
+
+    qdev_init_gpio_out_named(DEVICE(cpu), &cpu->compare_irq, "compare", 1);
 }
 
 
+// Runs after avr32a_cpu_init(), AVR32B only changes the core behaviour
 static void avr32b_cpu_init(Object* obj)
 {
-    // TODO
+    AVR32ACPU *cpu = AVR32A_CPU(obj);
+
+    cpu->env.avr32b = true;
 }
 
 static void avr32_cpu_realizefn(DeviceState *dev, Error **errp)
 {
     CPUState* cs = CPU(dev);
-    cpu_self = AVR32A_CPU(cs);
+    AVR32ACPU *cpu = AVR32A_CPU(cs);
     AVR32ACPUClass* acc = AVR32A_CPU_GET_CLASS(dev);
     Error *local_err = NULL;
 
     // TODO: Custom CPU setup stuff per CPU core arch
+    cpu->clock_speed = acc->cpu_def ? acc->cpu_def->clock_speed
+                                    : AVR32_DEFAULT_CLOCK;
+    avr32_cpu_timer_init(cpu);
 
     cpu_exec_realizefn(cs, &local_err);
     if (local_err != NULL) {
@@ -75,46 +80,44 @@ static void avr32_cpu_realizefn(DeviceState *dev, Error **errp)
 
 static void avr32_cpu_reset(DeviceState *dev)
 {
-    if(!first_reset) {
-        printf("[AVR32-CPU] CPU RESET\n");
-    }
     CPUState *cs = CPU(dev);
     AVR32ACPU *cpu = AVR32A_CPU(cs);
     AVR32ACPUClass* acc = AVR32A_CPU_GET_CLASS(dev);
     CPUAVR32AState* env = &cpu->env;
 
     env->isInInterrupt = 0;
-    env->intlevel = 0;
+    env->intlevel = -1;
     env->intsrc = -1;
+    env->autovector = 0;
     acc->parent_reset(dev);
 
-    if(first_reset) {
-        memset(env->r, 0, sizeof(env->r));
-        memset(env->sflags, 1, sizeof(env->sflags));
-        first_reset = false;
-    }
-
-    env->sr = 0;
-
-    for(int i= 0; i< 32; i++){
-        env->sflags[i] = 0;
-    }
-    env->sflags[16] = 1;
-    env->sflags[21] = 1;
-    env->sflags[22] = 1;
+    avr32_cpu_write_sr(env, AVR32_SR_GM | AVR32_SR_EM |
+                            (AVR32_MODE_SUP << AVR32_SR_M_SHIFT));
 
 
     for(int i= 0; i< AVR32A_SYS_REG; i++){
         env->sysr[i] = 0;
     }
+    avr32_cpu_timer_reset(env);
 
     for(int i= 0; i< AVR32A_REG_PAGE_SIZE; i++){
         env->r[i] = 0;
     }
+    memset(env->bank, 0, sizeof(env->bank));
+    avr32_fpu_reset(env);
 
     printf("RESET 2\n");
 
-    env->r[AVR32A_PC_REG] = 0xd0000000;
+    if (env->avr32b) {
+        avr32b_mmu_reset(env);
+        env->sysr[AVR32_SYSR_CONFIG0] = AVR32_CONFIG0_AT_AVR32B |
+                                        AVR32_CONFIG0_MMUT_TLB;
+        // Boot flash at physical 0, through the uncached P2 segment
+        env->r[AVR32A_PC_REG] = 0xa0000000;
+    } else {
+        env->sysr[AVR32_SYSR_CONFIG0] = AVR32_CONFIG0_MMUT_MPU;
+        env->r[AVR32A_PC_REG] = 0xd0000000;
+    }
     env->r[AVR32A_LR_REG] = 0;
     env->r[AVR32A_SP_REG] = 0;
 }
@@ -122,9 +125,15 @@ static void avr32_cpu_reset(DeviceState *dev)
 static ObjectClass* avr32_cpu_class_by_name(const char *cpu_model)
 {
     ObjectClass *oc;
-    printf("[AVR32-TODO] avr32_cpu_class_by_name: %s\n", cpu_model);
-    oc = object_class_by_name(AVR32A_CPU_TYPE_NAME("AVR32EXPC"));
-    return oc;
+    char *typename = g_strdup_printf(AVR32A_CPU_TYPE_NAME("%s"), cpu_model);
+
+    oc = object_class_by_name(typename);
+    g_free(typename);
+    if (oc && !object_class_is_abstract(oc) &&
+        object_class_dynamic_cast(oc, TYPE_AVR32A_CPU)) {
+        return oc;
+    }
+    return NULL;
 }
 static bool avr32_cpu_has_work(CPUState *cs)
 {
@@ -144,18 +153,32 @@ static void avr32_cpu_dump_state(CPUState *cs, FILE *f, int flags)
     qemu_fprintf(f, "SP:    " TARGET_FMT_lx "\n", env->r[AVR32A_SP_REG]);
     qemu_fprintf(f, "LR:    " TARGET_FMT_lx "\n", env->r[AVR32A_LR_REG]);
 
+    uint32_t sr = avr32_cpu_read_sr(env);
+
     int i;
     for(i = 0;i < AVR32A_REG_PAGE_SIZE-3; ++i) {
         qemu_fprintf(f, "r%d:    " TARGET_FMT_lx "\n", i, env->r[i]);
     }
 
     for(i= 0; i< 32; i++){
-        qemu_fprintf(f, "%s:    " TARGET_FMT_lx "\n", avr32_cpu_sr_flag_names[i], env->sflags[i]);
+        qemu_fprintf(f, "%s:    " TARGET_FMT_lx "\n", avr32_cpu_sr_flag_names[i], (sr >> i) & 1);
     }
 
     qemu_fprintf(f, "\n");
 }
 
+static void avr32b_cpu_dump_state(CPUState *cs, FILE *f, int flags)
+{
+    CPUAVR32AState *env = &AVR32A_CPU(cs)->env;
+
+    avr32_cpu_dump_state(cs, f, flags);
+    qemu_fprintf(f, "TLBEHI: %08x TLBELO: %08x TLBEAR: %08x\n",
+                 env->sysr[AVR32_SYSR_TLBEHI], env->sysr[AVR32_SYSR_TLBELO],
+                 env->sysr[AVR32_SYSR_TLBEAR]);
+    qemu_fprintf(f, "MMUCR:  %08x PTBR:   %08x\n",
+                 env->sysr[AVR32_SYSR_MMUCR], env->sysr[AVR32_SYSR_PTBR]);
+}
+
 static void avr32_cpu_set_pc(CPUState *cs, vaddr value)
 {
     AVR32ACPU *cpu = AVR32A_CPU(cs);
@@ -166,8 +189,28 @@ static void avr32_cpu_set_pc(CPUState *cs, vaddr value)
 
 static bool avr32_cpu_exec_interrupt(CPUState *cs, int interrupt_request)
 {
-    //TODO: Later
-    return false;
+    AVR32ACPU *cpu = AVR32A_CPU(cs);
+    CPUAVR32AState *env = &cpu->env;
+    int level = env->intlevel;
+    int mode;
+
+    if (!(interrupt_request & CPU_INTERRUPT_HARD) || level < 0 ||
+        !cpu_interrupts_enabled(env)) {
+        return false;
+    }
+    if (env->sr & (1u << (AVR32_SR_I0M_SHIFT + level))) {
+        return false;
+    }
+
+    // Only a higher interrupt level may preempt, never exceptions or NMI
+    mode = (env->sr & AVR32_SR_M_MASK) >> AVR32_SR_M_SHIFT;
+    if (mode >= AVR32_MODE_INT0 + level) {
+        return false;
+    }
+
+    cs->exception_index = AVR32_EXCP_INT(level);
+    avr32_cpu_do_interrupt(cs);
+    return true;
 }
 
 #include "hw/core/sysemu-cpu-ops.h"
@@ -176,9 +219,20 @@ static const struct SysemuCPUOps avr32_sysemu_ops = {
         .get_phys_page_debug = avr32_cpu_get_phys_page_debug,
 };
 
+// PC is only stored to env at TB exits, insn_start data[0] has the rest
+static void avr32_restore_state_to_opc(CPUState *cs,
+                                       const TranslationBlock *tb,
+                                       const uint64_t *data)
+{
+    AVR32ACPU *cpu = AVR32A_CPU(cs);
+
+    cpu->env.r[AVR32A_PC_REG] = data[0];
+}
+
 static const struct TCGCPUOps avr32_tcg_ops = {
         .initialize = avr32_tcg_init,
         .synchronize_from_tb = avr32_cpu_synchronize_from_tb,
+        .restore_state_to_opc = avr32_restore_state_to_opc,
         .cpu_exec_interrupt = avr32_cpu_exec_interrupt,
         .tlb_fill = avr32_cpu_tlb_fill,
         .do_interrupt = avr32_cpu_do_interrupt,
@@ -206,6 +260,7 @@ static void avr32a_cpu_class_init(ObjectClass *oc, void *data)
     cc->set_pc = avr32_cpu_set_pc;
     cc->memory_rw_debug = avr32_cpu_memory_rw_debug;
     cc->sysemu_ops = &avr32_sysemu_ops;
+    dc->vmsd = &vms_avr32_cpu;
     cc->disas_set_info = avr32_cpu_disas_set_info;
     cc->tcg_ops = &avr32_tcg_ops;
     cc->gdb_read_register = avr32_cpu_gdb_read_register;
@@ -216,9 +271,12 @@ static void avr32a_cpu_class_init(ObjectClass *oc, void *data)
 }
 
 
+// Everything else is inherited from avr32a_cpu_class_init()
 static void avr32b_cpu_class_init(ObjectClass *oc, void *data)
 {
-    // TODO
+    CPUClass *cc = CPU_CLASS(oc);
+
+    cc->dump_state = avr32b_cpu_dump_state;
 }
 
 static const AVR32ACPUDef avr32_cpu_defs[] = {
@@ -230,6 +288,15 @@ static const AVR32ACPUDef avr32_cpu_defs[] = {
                 .clock_speed = 66 * 1000 * 1000, /* 66 MHz */
                 .audio = false,
                 .aes = false
+        },
+        {
+                .name = "AP7000",
+                .parent_microarch = TYPE_AVR32B_CPU,
+                .core_type = AVR32_AP7,
+                .series_type = AVR32_AP7000_S,
+                .clock_speed = 150 * 1000 * 1000, /* 150 MHz */
+                .audio = false,
+                .aes = false
         }
 };
 
@@ -270,11 +337,9 @@ static const TypeInfo avr32_cpu_arch_types[] = {
         },
         {
                 .name = TYPE_AVR32B_CPU,
-                .parent = TYPE_CPU,
-                .instance_size = sizeof(AVR32ACPU),
+                .parent = TYPE_AVR32A_CPU,
                 .instance_init = avr32b_cpu_init,
                 .abstract = true,
-                .class_size = sizeof(AVR32ACPUClass),
                 .class_init = avr32b_cpu_class_init,
         }
 };
@@ -22,9 +22,15 @@
 
 #include "cpu-qom.h"
 #include "exec/cpu-defs.h"
+#include "fpu/softfloat-types.h"
+
+// No atomic instructions are implemented, keep guest accesses fully ordered
+#define TCG_GUEST_DEFAULT_MO TCG_MO_ALL
 
 #define AVR32_EXP 0x100
 #define AVR32_EXP_S    AVR32_EXP | 0x30
+#define AVR32_AP7 0x200
+#define AVR32_AP7000_S AVR32_AP7 | 0x00
 
 #define AVR32A_REG_PAGE_SIZE 16 // r0 - r12 + LR + SP + PC
 #define AVR32A_PC_REG 15
@@ -52,6 +58,136 @@ struct AVR32ACPUDef {
 // Global Interrupt Mask
 #define AVR32_GM_FLAG(sr)       (sr & 0x10000) >> 16
 
+/*
+ * Status register layout. The arithmetic flags C, Z, N, V, Q and L are
+ * updated by almost every instruction and are kept one per word in
+ * sflags[]. All other SR bits live packed in sr, whose low bits are
+ * always zero. Use avr32_cpu_read_sr()/avr32_cpu_write_sr() for the
+ * architectural value.
+ */
+#define AVR32_SR_SPLIT_FLAGS    6
+#define AVR32_SR_SPLIT_MASK     ((1u << AVR32_SR_SPLIT_FLAGS) - 1)
+#define AVR32_SR_T              (1u << 14)
+#define AVR32_SR_R              (1u << 15)
+#define AVR32_SR_GM             (1u << 16)
+#define AVR32_SR_I0M_SHIFT      17
+#define AVR32_SR_EM             (1u << 21)
+#define AVR32_SR_M_SHIFT        22
+#define AVR32_SR_M_LEN          3
+#define AVR32_SR_M_MASK         (0x7u << AVR32_SR_M_SHIFT)
+#define AVR32_SR_D              (1u << 26)
+#define AVR32_SR_DM             (1u << 27)
+#define AVR32_SR_J              (1u << 28)
+#define AVR32_SR_H              (1u << 29)
+#define AVR32_SR_SS             (1u << 31)
+
+// Exception numbers, cs->exception_index
+#define AVR32_EXCP_INT0         1
+#define AVR32_EXCP_INT(n)       (AVR32_EXCP_INT0 + (n))
+#define AVR32_EXCP_ITLB_MISS    5
+#define AVR32_EXCP_ITLB_PROT    6
+#define AVR32_EXCP_DTLB_MISS_R  7
+#define AVR32_EXCP_DTLB_MISS_W  8
+#define AVR32_EXCP_DTLB_PROT_R  9
+#define AVR32_EXCP_DTLB_PROT_W  10
+#define AVR32_EXCP_DTLB_MODIFIED 11
+#define AVR32_EXCP_ILLEGAL_OPCODE 12
+#define AVR32_EXCP_PRIVILEGE    13
+
+// System register numbers, index into sysr[]
+#define AVR32_SYSR_EVBA         1
+#define AVR32_SYSR_ACBA         2
+#define AVR32_SYSR_ECR          4
+#define AVR32_SYSR_RSR_SUP      5   // AVR32B RSR_SUP-RSR_NMI, saved SR
+#define AVR32_SYSR_RAR_SUP      13  // AVR32B RAR_SUP-RAR_NMI, saved PC
+#define AVR32_SYSR_CONFIG0      64
+#define AVR32_SYSR_COUNT        66
+#define AVR32_SYSR_COMPARE      67
+#define AVR32_SYSR_TLBEHI       68
+#define AVR32_SYSR_TLBELO       69
+#define AVR32_SYSR_PTBR         70
+#define AVR32_SYSR_TLBEAR       71
+#define AVR32_SYSR_MMUCR        72
+#define AVR32_SYSR_TLBARLO      73
+#define AVR32_SYSR_TLBARHI      74
+#define AVR32_SYSR_MPUAR0       80  // MPUAR0-7: base, size and valid bit
+#define AVR32_SYSR_MPUPSR0      88  // MPUPSR0-7: subregions using set B
+#define AVR32_SYSR_MPUCRA       96
+#define AVR32_SYSR_MPUCRB       97
+#define AVR32_SYSR_MPUBRA       98
+#define AVR32_SYSR_MPUBRB       99
+#define AVR32_SYSR_MPUAPRA      100 // access permissions, 4 bits per region
+#define AVR32_SYSR_MPUAPRB      101
+#define AVR32_SYSR_MPUCR        102 // bit 0 enables the MPU
+
+#define AVR32_MPU_REGIONS       8
+
+// Return status and address registers of an AVR32B privileged mode
+#define AVR32_SYSR_RSR(mode)    (AVR32_SYSR_RSR_SUP + (mode) - AVR32_MODE_SUP)
+#define AVR32_SYSR_RAR(mode)    (AVR32_SYSR_RAR_SUP + (mode) - AVR32_MODE_SUP)
+
+// CONFIG0 fields
+#define AVR32_CONFIG0_AT_AVR32B (1u << 13)
+#define AVR32_CONFIG0_MMUT_TLB  (1u << 7)   // separate ITLB and DTLB
+#define AVR32_CONFIG0_MMUT_MPU  (3u << 7)
+
+// AVR32B TLBEHI, TLBELO and MMUCR fields
+#define AVR32_TLBEHI_VPN_MASK   0xfffffc00u
+#define AVR32_TLBEHI_V          (1u << 9)
+#define AVR32_TLBEHI_I          (1u << 8)   // TLBR/TLBW/TLBS use the ITLB
+#define AVR32_TLBEHI_ASID_MASK  0xffu
+#define AVR32_TLBELO_PFN_MASK   0xfffffc00u
+#define AVR32_TLBELO_G          (1u << 8)   // global, ignores the ASID
+#define AVR32_TLBELO_AP_SHIFT   4
+#define AVR32_TLBELO_SZ_SHIFT   2
+#define AVR32_TLBELO_D          (1u << 1)   // dirty, page may be written
+#define AVR32_MMUCR_E           (1u << 0)   // paging enabled
+#define AVR32_MMUCR_M           (1u << 1)   // one TLB shared by both sides
+#define AVR32_MMUCR_I           (1u << 2)   // invalidate all entries
+#define AVR32_MMUCR_N           (1u << 3)   // TLBS found no entry
+#define AVR32_MMUCR_S           (1u << 4)   // segmentation enabled
+#define AVR32_MMUCR_DRP_SHIFT   14
+#define AVR32_MMUCR_IRP_SHIFT   26
+#define AVR32_MMUCR_RP_LEN      6
+
+#define AVR32B_TLB_ENTRIES      32
+#define AVR32B_DTLB             0
+#define AVR32B_ITLB             1
+
+/*
+ * AVR32B shadows R8-R12 and LR for each interrupt level instead of
+ * stacking them. Bank 0 serves all other modes, bank 1 + n INTn.
+ */
+#define AVR32B_REG_BANKS        5
+#define AVR32B_BANKED_REGS      6
+
+// Coprocessor 0 is the FPU, CR0-CR15, doubles in even/odd pairs
+#define AVR32_FPU_CP            0
+#define AVR32_FPU_REGS          16
+
+// MMU indexes, the MPU grants different rights to the application mode
+#define AVR32_MMU_IDX_PRIV      0
+#define AVR32_MMU_IDX_USER      1
+#define AVR32_MMU_IDX_MASK      ((1 << AVR32_MMU_IDX_PRIV) | \
+                                 (1 << AVR32_MMU_IDX_USER))
+
+// TB flags, the TB cache is shared by all CPUs of a machine
+#define AVR32_TBFLAG_MMU_IDX    1
+#define AVR32_TBFLAG_AVR32B     2
+
+// Core clock if the CPU model does not define one
+#define AVR32_DEFAULT_CLOCK     (66 * 1000 * 1000)
+
+// SR[M2:M0] execution modes
+#define AVR32_MODE_APP          0
+#define AVR32_MODE_SUP          1
+#define AVR32_MODE_INT0         2
+#define AVR32_MODE_INT1         3
+#define AVR32_MODE_INT2         4
+#define AVR32_MODE_INT3         5
+#define AVR32_MODE_EX           6
+#define AVR32_MODE_NMI          7
+
 #define AVR32_EXTENDED_INSTR_FORMAT_MASK 0b1110000000000000
 #define AVR32_EXTENDED_INSTR_FORMAT_MASK_LE 0b11100000
 
@@ -69,12 +205,32 @@ static const char avr32_cpu_sr_flag_names[32][8] = {
         "sregM2", "sreg25","sregD","sregDM","sregJ","sregH", "sreg30", "sregSS"
 };
 
+/*
+ * Operation that last defined the C, Z, N and V flags. Unless cc_op is
+ * CC_OP_FLAGS those flags are not stored in sflags but derived on demand
+ * from cc_src1, cc_src2 and cc_res, see avr32_cpu_sync_flags().
+ */
+enum {
+    CC_OP_DYNAMIC = -1, // translator only: cc_op is not known statically
+    CC_OP_FLAGS = 0,    // C, Z, N and V are up to date in sflags
+    CC_OP_ADD,          // cc_res = cc_src1 + cc_src2
+    CC_OP_SUB,          // cc_res = cc_src1 - cc_src2
+    CC_OP_LOGIC,        // Z and N from cc_res, C and V are kept in sflags
+};
+
 typedef struct CPUArchState {
-    // Status Register
-    uint sr;
+    // Status Register without the bits kept in sflags
+    uint32_t sr;
     uint pc_w;
 
-    uint32_t sflags[32];
+    // SR bits 0 to AVR32_SR_SPLIT_FLAGS-1, one per word
+    uint32_t sflags[AVR32_SR_SPLIT_FLAGS];
+
+    // Lazily evaluated arithmetic flags
+    uint32_t cc_op;
+    uint32_t cc_src1;
+    uint32_t cc_src2;
+    uint32_t cc_res;
 
     // Register File Registers
     uint32_t r[AVR32A_REG_PAGE_SIZE]; // 32 bits each
@@ -82,12 +238,30 @@ typedef struct CPUArchState {
     //System registers
     uint32_t sysr[AVR32A_SYS_REG];
 
-    //interrupt source
-    int intsrc;
-    int intlevel;
-    uint64_t autovector;
+    //interrupt source, set by the interrupt controller
+    int intsrc;             // group of the pending request
+    int intlevel;           // INT0-INT3, -1 if nothing is pending
+    uint64_t autovector;    // handler offset from EVBA
     int isInInterrupt;
 
+    // COUNT is the scaled virtual clock plus count_offset, see timer.c
+    uint32_t count_offset;
+
+    // AVR32B core, fixed by the CPU type
+    bool avr32b;
+    // AVR32B TLBs, AVR32B_DTLB and AVR32B_ITLB
+    uint32_t tlbehi[2][AVR32B_TLB_ENTRIES];
+    uint32_t tlbelo[2][AVR32B_TLB_ENTRIES];
+    // AVR32B shadow registers, the live bank is in r[]
+    uint32_t bank[AVR32B_REG_BANKS][AVR32B_BANKED_REGS];
+
+    // FPU coprocessor registers, the odd register of a pair holds the MSW
+    uint32_t fpr[AVR32_FPU_REGS];
+    float_status fp_status;
+
+    // Must stay last, avr32_snapshot.c copies env up to here
+    QEMUTimer *compare_timer;
+
 } CPUAVR32AState;
 
 struct ArchCPU {
@@ -97,21 +271,29 @@ struct ArchCPU {
 
     CPUNegativeOffsetState neg;
     CPUAVR32AState env;
+
+    uint64_t clock_speed;
+    // COUNT == COMPARE, usually wired to the interrupt controller
+    qemu_irq compare_irq;
 };
 
 
 int avr32_print_insn(bfd_vma addr, disassemble_info *info);
+void avr32_disas_log(FILE *f, CPUState *cs, uint32_t pc, int size);
+
+extern const struct VMStateDescription vms_avr32_cpu;
 
 
 static inline int cpu_interrupts_enabled(CPUAVR32AState* env)
 {
-    return AVR32_GM_FLAG(env->sr);
+    return !AVR32_GM_FLAG(env->sr);
 }
 
 static inline int cpu_mmu_index(CPUAVR32AState *env, bool ifetch)
 {
-    // There is only one MMU, so that should be fine
-    return 0;
+    uint32_t mode = (env->sr & AVR32_SR_M_MASK) >> AVR32_SR_M_SHIFT;
+
+    return mode == AVR32_MODE_APP ? AVR32_MMU_IDX_USER : AVR32_MMU_IDX_PRIV;
 }
 
 static inline void cpu_get_tb_cpu_state(CPUAVR32AState *env, target_ulong *pc,
@@ -119,16 +301,40 @@ static inline void cpu_get_tb_cpu_state(CPUAVR32AState *env, target_ulong *pc,
 {
     *pc = env->r[AVR32A_PC_REG];
     *cs_base = 0;
-    *pflags = 0;
+    *pflags = cpu_mmu_index(env, false) |
+              (env->avr32b ? AVR32_TBFLAG_AVR32B : 0);
 }
 
 void avr32_tcg_init(void);
+void avr32_cpu_sync_flags(CPUAVR32AState *env);
+uint32_t avr32_cpu_read_sr(CPUAVR32AState *env);
+void avr32_cpu_write_sr(CPUAVR32AState *env, uint32_t val);
 bool avr32_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
                         MMUAccessType access_type, int mmu_idx,
                         bool probe, uintptr_t retaddr);
 void avr32_cpu_do_interrupt(CPUState *cpu);
 void avr32_cpu_set_int(void *opaque, int irq, int level);
+void avr32_cpu_set_irq_level(AVR32ACPU *cpu, int level, uint32_t autovector,
+                             int group);
 hwaddr avr32_cpu_get_phys_page_debug(CPUState *cs, vaddr addr);
+uint32_t avr32_cpu_get_count(CPUAVR32AState *env);
+void avr32_cpu_set_count(CPUAVR32AState *env, uint32_t val);
+void avr32_cpu_set_compare(CPUAVR32AState *env, uint32_t val);
+void avr32_cpu_timer_init(AVR32ACPU *cpu);
+void avr32_cpu_timer_reset(CPUAVR32AState *env);
+bool avr32_mpu_lookup(CPUAVR32AState *env, uint32_t addr,
+                      MMUAccessType access_type, int mmu_idx,
+                      int *prot, int *excp, uint64_t *size);
+int avr32_ap_prot(int ap, int mmu_idx);
+bool avr32b_mmu_lookup(CPUAVR32AState *env, uint32_t addr,
+                       MMUAccessType access_type, int mmu_idx,
+                       uint32_t *phys, int *prot, int *excp, uint64_t *size);
+void avr32b_mmu_fault(CPUAVR32AState *env, uint32_t addr,
+                      MMUAccessType access_type, int excp);
+void avr32b_mmu_reset(CPUAVR32AState *env);
+void avr32b_switch_bank(CPUAVR32AState *env, int old_mode, int new_mode);
+void avr32_fpu_init_status(CPUAVR32AState *env);
+void avr32_fpu_reset(CPUAVR32AState *env);
 int avr32_cpu_memory_rw_debug(CPUState *cs, vaddr addr, uint8_t *buf, int len, bool is_write);
 
 void avr32_cpu_synchronize_from_tb(CPUState *cs, const TranslationBlock *tb);
@@ -19,40 +19,29 @@
  */
 #include "qemu/osdep.h"
 #include "cpu.h"
+#include "exec/cpu-common.h"
 
 typedef struct DisasContext {
     // Provided by QEMU
     disassemble_info *dis;
 
     uint32_t addr;
-    uint32_t pc;
 
+    // Fetched once per instruction, avail is 2 at the end of readable memory
     uint8_t bytes[4];
+    int avail;
+    // Length the decoder asked for
+    int len;
 } DisasContext;
 
 // Decode helper required only if insn wide is variable
 static uint32_t decode_insn_load_bytes(DisasContext *ctx, uint32_t insn,
                                        int i, int n){
-    printf("[AVR32-DISAS] decode_insn_load_bytes at: 0x%04x\n", ctx->pc);
-
-    // TODO: We can probably just load 4 bytes and decide to only use 2 of them
-    ctx->dis->read_memory_func(ctx->addr, ctx->bytes, 2, ctx->dis);
-
-    if((ctx->bytes[0] & AVR32_EXTENDED_INSTR_FORMAT_MASK_LE) == AVR32_EXTENDED_INSTR_FORMAT_MASK_LE)
-    {
-        ctx->dis->read_memory_func(ctx->addr, ctx->bytes, 4, ctx->dis);
-
-        insn = bfd_getb32(ctx->bytes);
-        ctx->addr += 4;
-        printf("[AVR32-DISAS] decode_insn_load_bytes, loaded (long): 0x%04x\n", insn);
-
-    } else {
-        insn = bfd_getb16(ctx->bytes) << 16;
-        ctx->addr += 2;
-        printf("[AVR32-DISAS] decode_insn_load_bytes, loaded (short): 0x%04x\n", insn);
+    ctx->len = n;
+    if (n > ctx->avail) {
+        return insn;
     }
-
-    return insn;
+    return insn | bfd_getb16(ctx->bytes + i) << (16 - 8 * i);
 }
 
 /* Include the auto-generated decoder.  */
@@ -67,28 +56,92 @@ static bool decode_insn(DisasContext *ctx, uint32_t insn);
 
 int avr32_print_insn(bfd_vma addr, disassemble_info *dis)
 {
-    printf("[AVR32-DISAS] avr32_print_insn\n");
     DisasContext ctx;
     uint32_t insn;
+    int status;
     int i;
 
     ctx.dis = dis;
-    ctx.pc = ctx.addr = addr;
-//    ctx.len = 0;
+    ctx.addr = addr;
+    ctx.len = 0;
+
+    // One read covers both widths, retry short at the end of a region
+    ctx.avail = 4;
+    status = dis->read_memory_func(addr, ctx.bytes, 4, dis);
+    if (status != 0) {
+        ctx.avail = 2;
+        status = dis->read_memory_func(addr, ctx.bytes, 2, dis);
+    }
+    if (status != 0) {
+        dis->memory_error_func(status, addr, dis);
+        return -1;
+    }
 
     insn = decode_insn_load(&ctx);
-    if (!decode_insn(&ctx, insn)) {
-        ctx.dis->fprintf_func(ctx.dis->stream, ".byte\t");
-        for (i = 0; i < ctx.addr - addr; i++) {
-            if (i > 0) {
-                ctx.dis->fprintf_func(ctx.dis->stream, ",");
-            }
-            ctx.dis->fprintf_func(ctx.dis->stream, "0x%02x", insn >> 24);
-            insn <<= 8;
+    if (ctx.len > ctx.avail || !decode_insn(&ctx, insn)) {
+        ctx.len = MIN(ctx.len, ctx.avail);
+        dis->fprintf_func(dis->stream, ".byte\t");
+        for (i = 0; i < ctx.len; i++) {
+            dis->fprintf_func(dis->stream, i ? ",0x%02x" : "0x%02x",
+                              ctx.bytes[i]);
         }
     }
 
-    return ctx.addr - addr;
+    return ctx.len;
+}
+
+static int avr32_buffer_read_memory(bfd_vma memaddr, bfd_byte *myaddr,
+                                    int length, struct disassemble_info *info)
+{
+    if (memaddr < info->buffer_vma
+        || memaddr + length > info->buffer_vma + info->buffer_length) {
+        return EIO;
+    }
+    memcpy(myaddr, info->buffer + (memaddr - info->buffer_vma), length);
+    return 0;
+}
+
+static void avr32_memory_error(int status, bfd_vma memaddr,
+                               struct disassemble_info *info)
+{
+    info->fprintf_func(info->stream,
+                       "Address 0x%" PRIx64 " is out of bounds.", memaddr);
+}
+
+/*
+ * in_asm logging: fetch the whole TB with a single debug access and decode
+ * from that copy instead of going through the MMU for every instruction.
+ */
+void avr32_disas_log(FILE *f, CPUState *cs, uint32_t pc, int size)
+{
+    disassemble_info info = { };
+    g_autofree uint8_t *code = g_malloc(size);
+    uint32_t end = pc + size;
+    int count;
+
+    if (cpu_memory_rw_debug(cs, pc, code, size, false) != 0) {
+        fprintf(f, "0x%08x:  Cannot access memory\n", pc);
+        return;
+    }
+
+    info.fprintf_func = fprintf;
+    info.stream = f;
+    info.buffer = code;
+    info.buffer_vma = pc;
+    info.buffer_length = size;
+    info.read_memory_func = avr32_buffer_read_memory;
+    info.memory_error_func = avr32_memory_error;
+    info.mach = bfd_arch_avr32;
+
+    while (pc < end) {
+        fprintf(f, "0x%08x:  ", pc);
+        count = avr32_print_insn(pc, &info);
+        fprintf(f, "\n");
+        if (count <= 0) {
+            break;
+        }
+        pc += count;
+    }
 }
 
 
@@ -221,6 +274,9 @@ INSN(LDW_f5,            LDW,        "%s, %s, %s",                REG(a->rd), REG
 INSN(LDW_f6,            LDW,        "%s, %s, %s",                REG(a->rd), REG(a->rx), REG(a->ry))
 INSN(LDW_cond,          LDWc,       "%s, %s, 0x%04x, 0x%04x",    REG(a->rp), REG(a->rd), a->cond4, a->disp9)
 
+INSN(LDC_D,     LDC_D,     "cp%d, cr%d, %s[0x%x]",            a->cp, a->cr3 * 2, REG(a->rp), a->disp << 2)
+INSN(LDC_W,     LDC_W,     "cp%d, cr%d, %s[0x%x]",            a->cp, a->cr, REG(a->rp), a->disp << 2)
+
 INSN(LDDPC,      LDDPC,    "%s, PC[0x%04x]",                    REG(a->rd), a->disp << 2)
 INSN(LDDSP,      LDDSP,    "%s, %d",                       REG(a->rd), a->disp << 2)
 
@@ -281,6 +337,11 @@ INSN(MULUD, MUL,       "%s, %s, %s",                     REG(a->rd), REG(a->rx),
 INSN(MUSFR,      MUSFR,        "%s",                            REG(a->rs))
 INSN(MUSTR,      MUSTR,        "%s",                            REG(a->rd))
 
+INSN(MVCR_D,    MVCR_D,    "cp%d, %s, cr%d",                  a->cp, REG(a->r3 * 2), a->cr3 * 2)
+INSN(MVCR_W,    MVCR_W,    "cp%d, %s, cr%d",                  a->cp, REG(a->r), a->cr)
+INSN(MVRC_D,    MVRC_D,    "cp%d, cr%d, %s",                  a->cp, a->cr3 * 2, REG(a->r3 * 2))
+INSN(MVRC_W,    MVRC_W,    "cp%d, cr%d, %s",                  a->cp, a->cr, REG(a->r))
+
 INSN(NEG,   NEG,        "%s",                                REG(a->rd))
 INSN(NOP,   NOP,        "NOP: %d",                                12)
 
@@ -291,6 +352,39 @@ INSN(OR_cond, OR,           "%s, %s, %s, 0x%x",                 REG(a->rd), REG(
 INSN(ORH,   ORH,        "%s, 0x%04x",                           REG(a->rd), a->imm16)
 INSN(ORL,   ORL,        "%s, 0x%04x",                           REG(a->rd), a->imm16)
 
+INSN(PABS_SB,    PABS_SB,    "%s, %s",                               REG(a->rd), REG(a->rs))
+INSN(PABS_SH,    PABS_SH,    "%s, %s",                               REG(a->rd), REG(a->rs))
+INSN(PADD_B,     PADD_B,     "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PADD_H,     PADD_H,     "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PADDH_SH,   PADDH_SH,   "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PADDH_UB,   PADDH_UB,   "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PADDS_SB,   PADDS_SB,   "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PADDS_SH,   PADDS_SH,   "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PADDS_UB,   PADDS_UB,   "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PADDS_UH,   PADDS_UH,   "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PADDX_H,    PADDX_H,    "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PADDXH_SH,  PADDXH_SH,  "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PADDXS_SH,  PADDXS_SH,  "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PADDXS_UH,  PADDXS_UH,  "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PAVG_SH,    PAVG_SH,    "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PAVG_UB,    PAVG_UB,    "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PMAX_SH,    PMAX_SH,    "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PMAX_UB,    PMAX_UB,    "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PMIN_SH,    PMIN_SH,    "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PMIN_UB,    PMIN_UB,    "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PSUB_B,     PSUB_B,     "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PSUB_H,     PSUB_H,     "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PSUBH_SH,   PSUBH_SH,   "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PSUBH_UB,   PSUBH_UB,   "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PSUBS_SB,   PSUBS_SB,   "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PSUBS_SH,   PSUBS_SH,   "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PSUBS_UB,   PSUBS_UB,   "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PSUBS_UH,   PSUBS_UH,   "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PSUBX_H,    PSUBX_H,    "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PSUBXH_SH,  PSUBXH_SH,  "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PSUBXS_SH,  PSUBXS_SH,  "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+INSN(PSUBXS_UH,  PSUBXS_UH,  "%s, %s, %s",                           REG(a->rd), REG(a->rx), REG(a->ry))
+
 
 INSN(POPM,   POPM,        "0x%04x",                           a->list)
 INSN(PUSHM,   PUSHM,        "0x%04x",                           a->list)
@@ -325,6 +419,9 @@ INSN(SR,   SR,        "%s, cond4: 0x%04x",                      REG(a->rd), a->c
 
 INSN(SSRF,   SR,        "bp5: 0x%04x",                          a->bp5)
 
+INSN(STC_D,     STC_D,     "cp%d, %s[0x%x], cr%d",            a->cp, REG(a->rp), a->disp << 2, a->cr3 * 2)
+INSN(STC_W,     STC_W,     "cp%d, %s[0x%x], cr%d",            a->cp, REG(a->rp), a->disp << 2, a->cr)
+
 INSN(STB_f1,         STB,         "%s, %s",                  REG(a->rp), REG(a->rs))
 INSN(STB_f2,            STB,         "%s, %s",                  REG(a->rp), REG(a->rs))
 INSN(STB_f3,            STB,         "%s, %s, 0x%02x",          REG(a->rp), REG(a->rd), a->disp3)
@@ -360,5 +457,8 @@ INSN(SUB_f5,        SUB,        "%s, %s, 0x%0x4",                   REG(a->rs),
 INSN(SUBc_f1,       SUBc,       "%s, %d, %d, %0x2",                 REG(a->rd), a->f, a->cond4, a->imm8)
 INSN(SUBc_f2,       SUBc,       "%s, %s, %s",                       REG(a->rd), REG(a->rx), REG(a->ry))
 
+INSN(TLBR,   TLBR,        "TLBR")
+INSN(TLBS,   TLBS,        "TLBS")
+INSN(TLBW,   TLBW,        "TLBW")
 INSN(TNBZ,   TNBZ,        "%s",                             REG(a->rd))
 INSN(TST,   TST,        "%s, %s",                           REG(a->rs), REG(a->rd))
\ No newline at end of file
@@ -0,0 +1,174 @@
+/*
+ * QEMU AVR32 floating point coprocessor
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+
+/*
+ * The FPU rounds to nearest even and reports no IEEE exception flags.
+ * avr32_fpu_init_status() therefore presets the inexact flag, which lets
+ * softfloat compute add, sub, mul, div, fma and sqrt with the host FPU
+ * and only fall back to the soft implementation for corner cases. As
+ * there is no FPU control or status register, fp_status is not migrated
+ * but rebuilt.
+ */
+
+#include "qemu/osdep.h"
+#include "cpu.h"
+#include "exec/helper-proto.h"
+#include "fpu/softfloat.h"
+
+void avr32_fpu_init_status(CPUAVR32AState *env)
+{
+    env->fp_status = (float_status) { };
+    set_float_rounding_mode(float_round_nearest_even, &env->fp_status);
+    set_default_nan_mode(true, &env->fp_status);
+    set_float_exception_flags(float_flag_inexact, &env->fp_status);
+}
+
+void avr32_fpu_reset(CPUAVR32AState *env)
+{
+    memset(env->fpr, 0, sizeof(env->fpr));
+    avr32_fpu_init_status(env);
+}
+
+uint32_t helper_fadd_s(CPUAVR32AState *env, uint32_t a, uint32_t b)
+{
+    return float32_add(a, b, &env->fp_status);
+}
+
+uint64_t helper_fadd_d(CPUAVR32AState *env, uint64_t a, uint64_t b)
+{
+    return float64_add(a, b, &env->fp_status);
+}
+
+uint32_t helper_fsub_s(CPUAVR32AState *env, uint32_t a, uint32_t b)
+{
+    return float32_sub(a, b, &env->fp_status);
+}
+
+uint64_t helper_fsub_d(CPUAVR32AState *env, uint64_t a, uint64_t b)
+{
+    return float64_sub(a, b, &env->fp_status);
+}
+
+uint32_t helper_fmul_s(CPUAVR32AState *env, uint32_t a, uint32_t b)
+{
+    return float32_mul(a, b, &env->fp_status);
+}
+
+uint64_t helper_fmul_d(CPUAVR32AState *env, uint64_t a, uint64_t b)
+{
+    return float64_mul(a, b, &env->fp_status);
+}
+
+// acc + x * y, fused, flags are float_muladd_* negations
+uint32_t helper_fmac_s(CPUAVR32AState *env, uint32_t acc, uint32_t x,
+                       uint32_t y, uint32_t flags)
+{
+    return float32_muladd(x, y, acc, flags, &env->fp_status);
+}
+
+uint64_t helper_fmac_d(CPUAVR32AState *env, uint64_t acc, uint64_t x,
+                       uint64_t y, uint32_t flags)
+{
+    return float64_muladd(x, y, acc, flags, &env->fp_status);
+}
+
+uint32_t helper_frcpa_s(CPUAVR32AState *env, uint32_t a)
+{
+    return float32_div(float32_one, a, &env->fp_status);
+}
+
+uint64_t helper_frcpa_d(CPUAVR32AState *env, uint64_t a)
+{
+    return float64_div(float64_one, a, &env->fp_status);
+}
+
+uint32_t helper_frsqrta_s(CPUAVR32AState *env, uint32_t a)
+{
+    return float32_div(float32_one, float32_sqrt(a, &env->fp_status),
+                       &env->fp_status);
+}
+
+uint64_t helper_frsqrta_d(CPUAVR32AState *env, uint64_t a)
+{
+    return float64_div(float64_one, float64_sqrt(a, &env->fp_status),
+                       &env->fp_status);
+}
+
+// FloatRelation, the translator turns it into C, Z, N and V
+uint32_t helper_fcmp_s(CPUAVR32AState *env, uint32_t a, uint32_t b)
+{
+    return float32_compare_quiet(a, b, &env->fp_status);
+}
+
+uint32_t helper_fcmp_d(CPUAVR32AState *env, uint64_t a, uint64_t b)
+{
+    return float64_compare_quiet(a, b, &env->fp_status);
+}
+
+// Float to integer casts truncate, as C does
+uint32_t helper_fcastrs_sw(CPUAVR32AState *env, uint32_t a)
+{
+    return float32_to_int32_round_to_zero(a, &env->fp_status);
+}
+
+uint32_t helper_fcastrd_sw(CPUAVR32AState *env, uint64_t a)
+{
+    return float64_to_int32_round_to_zero(a, &env->fp_status);
+}
+
+uint32_t helper_fcastrs_uw(CPUAVR32AState *env, uint32_t a)
+{
+    return float32_to_uint32_round_to_zero(a, &env->fp_status);
+}
+
+uint32_t helper_fcastrd_uw(CPUAVR32AState *env, uint64_t a)
+{
+    return float64_to_uint32_round_to_zero(a, &env->fp_status);
+}
+
+uint32_t helper_fcastsw_s(CPUAVR32AState *env, uint32_t a)
+{
+    return int32_to_float32(a, &env->fp_status);
+}
+
+uint64_t helper_fcastsw_d(CPUAVR32AState *env, uint32_t a)
+{
+    return int32_to_float64(a, &env->fp_status);
+}
+
+uint32_t helper_fcastuw_s(CPUAVR32AState *env, uint32_t a)
+{
+    return uint32_to_float32(a, &env->fp_status);
+}
+
+uint64_t helper_fcastuw_d(CPUAVR32AState *env, uint32_t a)
+{
+    return uint32_to_float64(a, &env->fp_status);
+}
+
+uint32_t helper_fcasts_d(CPUAVR32AState *env, uint64_t a)
+{
+    return float64_to_float32(a, &env->fp_status);
+}
+
+uint64_t helper_fcastd_s(CPUAVR32AState *env, uint32_t a)
+{
+    return float32_to_float64(a, &env->fp_status);
+}
@@ -18,16 +18,18 @@
  * <http://www.gnu.org/licenses/lgpl-2.1.html>
  */
 #include "qemu/osdep.h"
+#include "qemu/main-loop.h"
 #include "cpu.h"
 #include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
 #include "tcg/tcg.h"
 #include "exec/helper-proto.h"
 #include "hw/avr32/boot.h"
 
-static inline void raise_exception(CPUAVR32AState *env, int index,
+static inline G_NORETURN void raise_exception(CPUAVR32AState *env, int index,
         uintptr_t retaddr);
 
-static inline void raise_exception(CPUAVR32AState *env, int index,
+static inline G_NORETURN void raise_exception(CPUAVR32AState *env, int index,
         uintptr_t retaddr)
 {
     CPUState *cs = env_cpu(env);
@@ -38,31 +40,229 @@ static inline void raise_exception(CPUAVR32AState *env, int index,
 
 void helper_raise_illegal_instruction(CPUAVR32AState *env)
 {
-    CPUState *cs = env_cpu(env);
-    raise_exception(env, 23, GETPC());
-    cpu_loop_exit(cs);
+    raise_exception(env, AVR32_EXCP_ILLEGAL_OPCODE, GETPC());
+}
+
+void helper_raise_privilege_violation(CPUAVR32AState *env)
+{
+    raise_exception(env, AVR32_EXCP_PRIVILEGE, GETPC());
 }
 
 bool avr32_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
                         MMUAccessType access_type, int mmu_idx,
                         bool probe, uintptr_t retaddr)
 {
-    int port = 0;
+    CPUAVR32AState *env = cs->env_ptr;
+    uint64_t tlb_size;
+    uint32_t phys;
+    int prot, excp;
+
+    if (env->avr32b) {
+        if (avr32b_mmu_lookup(env, address, access_type, mmu_idx,
+                              &phys, &prot, &excp, &tlb_size)) {
+            tlb_set_page(cs, address & TARGET_PAGE_MASK,
+                         phys & TARGET_PAGE_MASK, prot, mmu_idx, tlb_size);
+            return true;
+        }
+    } else if (avr32_mpu_lookup(env, address, access_type, mmu_idx,
+                                &prot, &excp, &tlb_size)) {
+        // The MPU only checks, addresses are not translated
+        tlb_set_page(cs, address & TARGET_PAGE_MASK,
+                     address & TARGET_PAGE_MASK, prot, mmu_idx, tlb_size);
+        return true;
+    }
+    if (probe) {
+        return false;
+    }
+
+    env->sysr[AVR32_SYSR_TLBEAR] = address;
+    if (env->avr32b) {
+        avr32b_mmu_fault(env, address, access_type, excp);
+    }
+    raise_exception(env, excp, retaddr);
+}
+
+/*
+ * AVR32B swaps in the shadow registers of an interrupt level instead of
+ * stacking them. Called on every mode change, after SR has been written.
+ */
+void avr32b_switch_bank(CPUAVR32AState *env, int old_mode, int new_mode)
+{
+    static const int banked[] = { 8, 9, 10, 11, 12, AVR32A_LR_REG };
+    int from = old_mode >= AVR32_MODE_INT0 && old_mode <= AVR32_MODE_INT3 ?
+               old_mode - AVR32_MODE_INT0 + 1 : 0;
+    int to = new_mode >= AVR32_MODE_INT0 && new_mode <= AVR32_MODE_INT3 ?
+             new_mode - AVR32_MODE_INT0 + 1 : 0;
+
+    if (!env->avr32b || from == to) {
+        return;
+    }
+    for (int i = 0; i < ARRAY_SIZE(banked); i++) {
+        env->bank[from][i] = env->r[banked[i]];
+        env->r[banked[i]] = env->bank[to][i];
+    }
+}
+
+static int avr32_sr_mode(uint32_t sr)
+{
+    return extract32(sr, AVR32_SR_M_SHIFT, AVR32_SR_M_LEN);
+}
+
+// AVR32B keeps the return state in RSR/RAR of the new mode, not the stack
+static void avr32b_save_return(CPUAVR32AState *env, int mode, uint32_t sr)
+{
+    env->sysr[AVR32_SYSR_RSR(mode)] = sr;
+    env->sysr[AVR32_SYSR_RAR(mode)] = env->r[AVR32A_PC_REG];
+}
+
+/*
+ * Synchronous exceptions. AVR32A stacks PC and SR, RETE pops them again,
+ * AVR32B keeps them in RSR_EX and RAR_EX. The saved PC is the faulting
+ * insn, so returning retries it.
+ */
+static void avr32_cpu_do_exception(CPUState *cs, uint32_t sr)
+{
+    static const uint32_t vector[] = {
+        [AVR32_EXCP_ITLB_MISS] = 0x050,
+        [AVR32_EXCP_ITLB_PROT] = 0x018,
+        [AVR32_EXCP_DTLB_MISS_R] = 0x060,
+        [AVR32_EXCP_DTLB_MISS_W] = 0x070,
+        [AVR32_EXCP_DTLB_PROT_R] = 0x03c,
+        [AVR32_EXCP_DTLB_PROT_W] = 0x040,
+        [AVR32_EXCP_DTLB_MODIFIED] = 0x044,
+        [AVR32_EXCP_ILLEGAL_OPCODE] = 0x020,
+        [AVR32_EXCP_PRIVILEGE] = 0x028,
+    };
+    CPUAVR32AState *env = cs->env_ptr;
+    uint32_t *r = env->r;
+    uint32_t offset = vector[cs->exception_index];
 
-    port = PAGE_READ | PAGE_EXEC | PAGE_WRITE;
-    tlb_set_page(cs, address, address, port,
-                 mmu_idx, TARGET_PAGE_SIZE);
-    return true;
+    if (env->avr32b) {
+        avr32b_save_return(env, AVR32_MODE_EX, sr);
+    } else {
+        r[AVR32A_SP_REG] -= 4;
+        cpu_stl_be_mmuidx_ra(env, r[AVR32A_SP_REG], r[AVR32A_PC_REG],
+                             AVR32_MMU_IDX_PRIV, 0);
+        r[AVR32A_SP_REG] -= 4;
+        cpu_stl_be_mmuidx_ra(env, r[AVR32A_SP_REG], sr, AVR32_MMU_IDX_PRIV, 0);
+    }
+
+    env->sysr[AVR32_SYSR_ECR] = offset >> 2;
+    avr32_cpu_write_sr(env, (sr & ~AVR32_SR_M_MASK) | AVR32_SR_GM |
+                            AVR32_SR_EM | (AVR32_MODE_EX << AVR32_SR_M_SHIFT));
+    avr32b_switch_bank(env, avr32_sr_mode(sr), AVR32_MODE_EX);
+
+    r[AVR32A_PC_REG] = env->sysr[AVR32_SYSR_EVBA] + offset;
+    cs->exception_index = -1;
 }
 
 void avr32_cpu_do_interrupt(CPUState *cs)
 {
-    //TODO: Processor specific
+    CPUAVR32AState *env = cs->env_ptr;
+    static const int stacked[] = { 8, 9, 10, 11, 12, AVR32A_LR_REG };
+    uint32_t *r = env->r;
+    uint32_t sr;
+    int level;
+
+    // Exception entry stacks SR, so the lazy flags must be materialised first
+    sr = avr32_cpu_read_sr(env);
+
+    if (cs->exception_index >= AVR32_EXCP_ITLB_MISS &&
+        cs->exception_index <= AVR32_EXCP_PRIVILEGE) {
+        avr32_cpu_do_exception(cs, sr);
+        return;
+    }
+    if (cs->exception_index < AVR32_EXCP_INT(0) ||
+        cs->exception_index > AVR32_EXCP_INT(3)) {
+        // Indexes are internal, only the helpers above raise exceptions
+        g_assert_not_reached();
+    }
+    level = cs->exception_index - AVR32_EXCP_INT(0);
+
+    if (env->avr32b) {
+        avr32b_save_return(env, AVR32_MODE_INT0 + level, sr);
+    } else {
+        // AVR32A stacks R8-R12 and LR in hardware, RETE pops them again
+        for (int i = 0; i < ARRAY_SIZE(stacked); i++) {
+            r[AVR32A_SP_REG] -= 4;
+            cpu_stl_be_mmuidx_ra(env, r[AVR32A_SP_REG], r[stacked[i]],
+                                 AVR32_MMU_IDX_PRIV, 0);
+        }
+        r[AVR32A_SP_REG] -= 4;
+        cpu_stl_be_mmuidx_ra(env, r[AVR32A_SP_REG], r[AVR32A_PC_REG],
+                             AVR32_MMU_IDX_PRIV, 0);
+        r[AVR32A_SP_REG] -= 4;
+        cpu_stl_be_mmuidx_ra(env, r[AVR32A_SP_REG], sr, AVR32_MMU_IDX_PRIV, 0);
+    }
+
+    // Enter INTn and mask this level and all below it
+    avr32_cpu_write_sr(env, (sr & ~AVR32_SR_M_MASK) |
+                            ((AVR32_MODE_INT0 + level) << AVR32_SR_M_SHIFT) |
+                            (((2u << level) - 1) << AVR32_SR_I0M_SHIFT));
+    avr32b_switch_bank(env, avr32_sr_mode(sr), AVR32_MODE_INT0 + level);
+
+    r[AVR32A_PC_REG] = env->sysr[AVR32_SYSR_EVBA] + env->autovector;
+    cs->exception_index = -1;
+}
+
+/*
+ * Called by the interrupt controller whenever its highest pending request
+ * changes. level is INT0-INT3 or -1 if no request is pending.
+ */
+void avr32_cpu_set_irq_level(AVR32ACPU *cpu, int level, uint32_t autovector,
+                             int group)
+{
+    CPUState *cs = CPU(cpu);
+    CPUAVR32AState *env = &cpu->env;
+
+    env->intlevel = level;
+    env->intsrc = group;
+    env->autovector = autovector;
+    if (level >= 0) {
+        cpu_interrupt(cs, CPU_INTERRUPT_HARD);
+    } else {
+        cpu_reset_interrupt(cs, CPU_INTERRUPT_HARD);
+    }
 }
 
 hwaddr avr32_cpu_get_phys_page_debug(CPUState *cs, vaddr addr)
 {
-    return addr;
+    CPUAVR32AState *env = cs->env_ptr;
+    uint64_t size;
+    uint32_t phys;
+    int prot, excp;
+
+    if (!env->avr32b) {
+        return addr;
+    }
+    if (!avr32b_mmu_lookup(env, addr, MMU_DATA_LOAD, AVR32_MMU_IDX_PRIV,
+                           &phys, &prot, &excp, &size)) {
+        return -1;
+    }
+    return phys & TARGET_PAGE_MASK;
+}
+
+// AVR32B MTSR SR, a mode change swaps the shadow registers
+void helper_write_sr(CPUAVR32AState *env, uint32_t val)
+{
+    int mode = avr32_sr_mode(env->sr);
+
+    avr32_cpu_write_sr(env, val);
+    avr32b_switch_bank(env, mode, avr32_sr_mode(val));
+}
+
+/*
+ * AVR32B RETE returns through RSR/RAR of the current mode. Application
+ * mode has no such pair, RETE is undefined there and behaves as in SUP.
+ */
+void helper_rete(CPUAVR32AState *env)
+{
+    int mode = MAX(avr32_sr_mode(env->sr), AVR32_MODE_SUP);
+    uint32_t sr = env->sysr[AVR32_SYSR_RSR(mode)];
+
+    avr32_cpu_write_sr(env, sr);
+    avr32b_switch_bank(env, mode, avr32_sr_mode(sr));
+    env->r[AVR32A_PC_REG] = env->sysr[AVR32_SYSR_RAR(mode)];
 }
 
 
@@ -74,6 +274,50 @@ void helper_debug(CPUAVR32AState *env)
     cpu_loop_exit(cs);
 }
 
+/*
+ * Park the vCPU until avr32_cpu_has_work() reports a pending interrupt.
+ * The translator has already advanced PC past the SLEEP instruction.
+ */
+void helper_sleep(CPUAVR32AState *env)
+{
+    CPUState *cs = env_cpu(env);
+
+    cs->exception_index = EXCP_HLT;
+    cs->halted = 1;
+    cpu_loop_exit(cs);
+}
+
+uint32_t helper_mfsr_count(CPUAVR32AState *env)
+{
+    return avr32_cpu_get_count(env);
+}
+
+/*
+ * COUNT and COMPARE drive the compare timer and the INTC line, which are
+ * shared with the main loop. Under MTTCG the vCPU thread runs without the
+ * BQL, take it here.
+ */
+void helper_mtsr_count(CPUAVR32AState *env, uint32_t val)
+{
+    qemu_mutex_lock_iothread();
+    avr32_cpu_set_count(env, val);
+    qemu_mutex_unlock_iothread();
+}
+
+void helper_mtsr_compare(CPUAVR32AState *env, uint32_t val)
+{
+    qemu_mutex_lock_iothread();
+    avr32_cpu_set_compare(env, val);
+    qemu_mutex_unlock_iothread();
+}
+
+// Any MPU register write may change the rights of cached mappings
+void helper_mtsr_mpu(CPUAVR32AState *env, uint32_t sr, uint32_t val)
+{
+    env->sysr[sr] = val;
+    tlb_flush(env_cpu(env));
+}
+
 void helper_break(CPUAVR32AState *env)
 {
     CPUState *cs = env_cpu(env);
@@ -82,40 +326,61 @@ void helper_break(CPUAVR32AState *env)
     cpu_loop_exit(cs);
 }
 
-int avr32_cpu_memory_rw_debug(CPUState *cs, vaddr addr, uint8_t *buf,
-                            int len, bool is_write)
+/*
+ * Materialise C, Z, N and V from the pending lazy flag operation into sflags.
+ */
+void avr32_cpu_sync_flags(CPUAVR32AState *env)
 {
-    return cpu_memory_rw_debug(cs, addr, buf, len, is_write);
+    uint32_t src1 = env->cc_src1;
+    uint32_t src2 = env->cc_src2;
+    uint32_t res = env->cc_res;
+
+    switch (env->cc_op) {
+    case CC_OP_ADD:
+        env->sflags[sflagC] = res < src1;
+        env->sflags[sflagV] = ((res ^ src1) & ~(src1 ^ src2)) >> 31;
+        break;
+    case CC_OP_SUB:
+        env->sflags[sflagC] = src1 < src2;
+        env->sflags[sflagV] = ((src1 ^ src2) & (src1 ^ res)) >> 31;
+        break;
+    case CC_OP_LOGIC:
+        break;
+    default:
+        return;
+    }
+    env->sflags[sflagZ] = res == 0;
+    env->sflags[sflagN] = res >> 31;
+    env->cc_op = CC_OP_FLAGS;
 }
 
-//TODO: The saturation might be not working as intended. Add more tests.
-void helper_macsathhw(CPUAVR32AState *env, uint32_t rd, uint32_t op1,  uint32_t op2)
+void helper_sync_flags(CPUAVR32AState *env)
 {
-    uint32_t prod = 0;
-    if(op1 == -1 && op2 == -1){
-        prod = 0x7fffffff;
-        env->sflags[sflagQ] = 1;
-    }
-    else{
-        prod = (op1 * op2) << 1;
-        if((op1 >> 31) && (op2 >> 31) && !(prod >>31)){
-            prod = 0x80000000;
-            env->sflags[sflagQ] = 1;
-        }
-        else if(!(op1 >>31) && !(op2 >> 31) && (prod >>31)){
-            prod = 0x7fffffff;
-            env->sflags[sflagQ] = 1;
-        }
-    }
+    avr32_cpu_sync_flags(env);
+}
+
+uint32_t avr32_cpu_read_sr(CPUAVR32AState *env)
+{
+    uint32_t sr = env->sr;
 
-    uint32_t res = prod + env->r[rd];
-    if((prod >>31) && (env->r[rd] >>31) && !(res >>31)){
-        res = 0x80000000;
-        env->sflags[sflagQ] = 1;
+    avr32_cpu_sync_flags(env);
+    for (int i = 0; i < AVR32_SR_SPLIT_FLAGS; i++) {
+        sr |= (env->sflags[i] & 1) << i;
     }
-    else if(!(prod >>31) && !(env->r[rd] >>31) && (res >>31)){
-        res = 0x7fffffff;
-        env->sflags[sflagQ] = 1;
+    return sr;
+}
+
+void avr32_cpu_write_sr(CPUAVR32AState *env, uint32_t val)
+{
+    for (int i = 0; i < AVR32_SR_SPLIT_FLAGS; i++) {
+        env->sflags[i] = (val >> i) & 1;
     }
-    env->r[rd] = res;
+    env->sr = val & ~AVR32_SR_SPLIT_MASK;
+    env->cc_op = CC_OP_FLAGS;
+}
+
+int avr32_cpu_memory_rw_debug(CPUState *cs, vaddr addr, uint8_t *buf,
+                            int len, bool is_write)
+{
+    return cpu_memory_rw_debug(cs, addr, buf, len, is_write);
 }
@@ -18,9 +18,46 @@
  * <http://www.gnu.org/licenses/lgpl-2.1.html>
  */
 DEF_HELPER_1(raise_illegal_instruction, noreturn, env)
+DEF_HELPER_1(raise_privilege_violation, noreturn, env)
 DEF_HELPER_1(debug, noreturn, env)
 DEF_HELPER_1(break, noreturn, env)
-DEF_HELPER_4(macsathhw, void, env, i32, i32, i32)
+DEF_HELPER_1(sync_flags, void, env)
+DEF_HELPER_1(sleep, noreturn, env)
+DEF_HELPER_1(mfsr_count, i32, env)
+DEF_HELPER_2(mtsr_count, void, env, i32)
+DEF_HELPER_2(mtsr_compare, void, env, i32)
+DEF_HELPER_3(mtsr_mpu, void, env, i32, i32)
+DEF_HELPER_3(mtsr_mmu, void, env, i32, i32)
+DEF_HELPER_1(tlbr, void, env)
+DEF_HELPER_1(tlbw, void, env)
+DEF_HELPER_1(tlbs, void, env)
+DEF_HELPER_2(write_sr, void, env, i32)
+DEF_HELPER_1(rete, void, env)
+
+DEF_HELPER_FLAGS_3(fadd_s, TCG_CALL_NO_RWG, i32, env, i32, i32)
+DEF_HELPER_FLAGS_3(fadd_d, TCG_CALL_NO_RWG, i64, env, i64, i64)
+DEF_HELPER_FLAGS_3(fsub_s, TCG_CALL_NO_RWG, i32, env, i32, i32)
+DEF_HELPER_FLAGS_3(fsub_d, TCG_CALL_NO_RWG, i64, env, i64, i64)
+DEF_HELPER_FLAGS_3(fmul_s, TCG_CALL_NO_RWG, i32, env, i32, i32)
+DEF_HELPER_FLAGS_3(fmul_d, TCG_CALL_NO_RWG, i64, env, i64, i64)
+DEF_HELPER_FLAGS_5(fmac_s, TCG_CALL_NO_RWG, i32, env, i32, i32, i32, i32)
+DEF_HELPER_FLAGS_5(fmac_d, TCG_CALL_NO_RWG, i64, env, i64, i64, i64, i32)
+DEF_HELPER_FLAGS_2(frcpa_s, TCG_CALL_NO_RWG, i32, env, i32)
+DEF_HELPER_FLAGS_2(frcpa_d, TCG_CALL_NO_RWG, i64, env, i64)
+DEF_HELPER_FLAGS_2(frsqrta_s, TCG_CALL_NO_RWG, i32, env, i32)
+DEF_HELPER_FLAGS_2(frsqrta_d, TCG_CALL_NO_RWG, i64, env, i64)
+DEF_HELPER_FLAGS_3(fcmp_s, TCG_CALL_NO_RWG, i32, env, i32, i32)
+DEF_HELPER_FLAGS_3(fcmp_d, TCG_CALL_NO_RWG, i32, env, i64, i64)
+DEF_HELPER_FLAGS_2(fcastrs_sw, TCG_CALL_NO_RWG, i32, env, i32)
+DEF_HELPER_FLAGS_2(fcastrd_sw, TCG_CALL_NO_RWG, i32, env, i64)
+DEF_HELPER_FLAGS_2(fcastrs_uw, TCG_CALL_NO_RWG, i32, env, i32)
+DEF_HELPER_FLAGS_2(fcastrd_uw, TCG_CALL_NO_RWG, i32, env, i64)
+DEF_HELPER_FLAGS_2(fcastsw_s, TCG_CALL_NO_RWG, i32, env, i32)
+DEF_HELPER_FLAGS_2(fcastsw_d, TCG_CALL_NO_RWG, i64, env, i32)
+DEF_HELPER_FLAGS_2(fcastuw_s, TCG_CALL_NO_RWG, i32, env, i32)
+DEF_HELPER_FLAGS_2(fcastuw_d, TCG_CALL_NO_RWG, i64, env, i32)
+DEF_HELPER_FLAGS_2(fcasts_d, TCG_CALL_NO_RWG, i32, env, i64)
+DEF_HELPER_FLAGS_2(fcastd_s, TCG_CALL_NO_RWG, i64, env, i32)
 
 #ifndef QEMU_AVR32_HELPER
 #define QEMU_AVR32_HELPER
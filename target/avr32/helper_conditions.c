@@ -21,96 +21,98 @@
 #include "tcg/tcg.h"
 
 /*
- * Returns the value that needs to be matched by the return register
+ * Describe condition as a TCG comparison on the flags in cpu_sflags:
+ * it holds iff c->v1 c->cond c->v2. The caller can feed that straight into
+ * brcond, setcond or movcond.
  */
-int checkCondition(int condition, TCGv returnReg, TCGv cpu_r[], TCGv cpu_sflags[]){
-    int val;
+void prepareCondition(int condition, DisasCompare *c, TCGv cpu_sflags[]){
+    TCGv t;
+
+    c->v2 = tcg_constant_i32(0);
     switch (condition) {
         case 0x0:
-            // equal
-            tcg_gen_mov_i32(returnReg, cpu_sflags[sflagZ]);
-            val = 1;
+            // eq
+            c->cond = TCG_COND_NE;
+            c->v1 = cpu_sflags[sflagZ];
             break;
         case 0x1:
-            //not equal
-            tcg_gen_mov_i32(returnReg, cpu_sflags[sflagZ]);
-            val = 0;
+            // ne
+            c->cond = TCG_COND_EQ;
+            c->v1 = cpu_sflags[sflagZ];
             break;
-        case 0x02:
-            // clear carry, higher (cc/hs).
-            tcg_gen_mov_i32(returnReg, cpu_sflags[sflagC]);
-            val = 0;
+        case 0x2:
+            // clear carry, higher (cc/hs)
+            c->cond = TCG_COND_EQ;
+            c->v1 = cpu_sflags[sflagC];
             break;
-        case 0x03:
+        case 0x3:
             // set carry, lower (cs/lo)
-            tcg_gen_mov_i32(returnReg, cpu_sflags[sflagC]);
-            val = 1;
+            c->cond = TCG_COND_NE;
+            c->v1 = cpu_sflags[sflagC];
             break;
-        case 0x04:
-            // set carry, lower (cs/lo)
-            tcg_gen_setcond_i32(TCG_COND_EQ, returnReg, cpu_sflags[sflagN], cpu_sflags[sflagV]);
-            val = 1;
+        case 0x4:
+            // ge, N == V
+            c->cond = TCG_COND_EQ;
+            c->v1 = cpu_sflags[sflagN];
+            c->v2 = cpu_sflags[sflagV];
             break;
         case 0x5:
-            //lt
-            tcg_gen_xor_i32(returnReg, cpu_sflags[sflagN], cpu_sflags[sflagV]);
-            val = 1;
+            // lt, N != V
+            c->cond = TCG_COND_NE;
+            c->v1 = cpu_sflags[sflagN];
+            c->v2 = cpu_sflags[sflagV];
             break;
         case 0x6:
-            //mi
-            tcg_gen_mov_i32(returnReg, cpu_sflags[sflagN]);
-            val = 1;
+            // mi
+            c->cond = TCG_COND_NE;
+            c->v1 = cpu_sflags[sflagN];
             break;
-        case 0x07:
-            // positiv, not slfagN
-            tcg_gen_mov_i32(returnReg, cpu_sflags[sflagN]);
-            val = 0;
+        case 0x7:
+            // pl
+            c->cond = TCG_COND_EQ;
+            c->v1 = cpu_sflags[sflagN];
             break;
         case 0x8:
-            //ls
-            tcg_gen_or_i32(returnReg, cpu_sflags[sflagC], cpu_sflags[sflagZ]);
-            val = 1;
+        case 0xb:
+            // ls: C or Z, hi: not C and not Z
+            t = tcg_temp_new_i32();
+            tcg_gen_or_i32(t, cpu_sflags[sflagC], cpu_sflags[sflagZ]);
+            c->cond = condition == 0x8 ? TCG_COND_NE : TCG_COND_EQ;
+            c->v1 = t;
             break;
         case 0x9:
-            //gt
-            tcg_gen_setcond_i32(TCG_COND_EQ, returnReg, cpu_sflags[sflagN], cpu_sflags[sflagV]);
-            tcg_gen_andc_i32(returnReg, returnReg, cpu_sflags[sflagZ]);
-            val = 1;
-            break;
         case 0xa:
-            //le
-            tcg_gen_xor_i32(returnReg, cpu_sflags[sflagN], cpu_sflags[sflagV]);
-            tcg_gen_or_i32(returnReg, cpu_sflags[sflagZ], returnReg);
-            val = 1;
-            break;
-        case 0x0b:
-            // unsigned higher, HI, not C and not Z
-            tcg_gen_not_i32(returnReg, cpu_sflags[sflagC]);
-            tcg_gen_andc_i32(returnReg, returnReg, cpu_sflags[sflagZ]);
-            tcg_gen_andi_i32(returnReg, returnReg, 0x00000001);
-            val = 1;
+            // gt: not Z and N == V, le: Z or N != V
+            t = tcg_temp_new_i32();
+            tcg_gen_xor_i32(t, cpu_sflags[sflagN], cpu_sflags[sflagV]);
+            tcg_gen_or_i32(t, t, cpu_sflags[sflagZ]);
+            c->cond = condition == 0x9 ? TCG_COND_EQ : TCG_COND_NE;
+            c->v1 = t;
             break;
         case 0xc:
-            tcg_gen_mov_i32(returnReg, cpu_sflags[sflagV]);
-            val = 1;
+            // vs
+            c->cond = TCG_COND_NE;
+            c->v1 = cpu_sflags[sflagV];
             break;
         case 0xd:
-            tcg_gen_mov_i32(returnReg, cpu_sflags[sflagV]);
-            val = 0;
+            // vc
+            c->cond = TCG_COND_EQ;
+            c->v1 = cpu_sflags[sflagV];
             break;
         case 0xe:
-            tcg_gen_mov_i32(returnReg, cpu_sflags[sflagQ]);
-            val = 1;
+            // qs
+            c->cond = TCG_COND_NE;
+            c->v1 = cpu_sflags[sflagQ];
             break;
-        case 0x0f:
-            tcg_gen_movi_i32(returnReg, 0x1);
-            val = 1;
+        case 0xf:
+            // al
+            c->cond = TCG_COND_ALWAYS;
+            c->v1 = c->v2;
             break;
         default:
             printf("[COND] ERROR: undefined condition %d\n", condition);
             g_assert_not_reached();
     }
-    return val;
 }
 
 void set_v_flag_add(TCGv op1, TCGv op2, TCGv result, TCGv cpu_sflags[]){
@@ -181,30 +183,3 @@ void set_flags_cpc(TCGv rd, TCGv rs, TCGv res, TCGv cpu_sflags[]){
     set_c_flag_cp(rd, rs, res, cpu_sflags);
     set_v_flag_cp(rd, rs, res, cpu_sflags);
 }
-
-void cpw_instruction(TCGv Rd, TCGv Rs, TCGv cpu_sflags[]){
-    TCGv res = tcg_temp_new_i32();
-
-    tcg_gen_sub_i32(res, Rd, Rs);
-
-    // set N flag: N ← RES[31]
-    tcg_gen_shri_i32(cpu_sflags[sflagN], res, 31);
-
-    // set Z flag: Z ← (RES[31:0] == 0)
-    tcg_gen_setcondi_tl(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0); /* Zf = R == 0 */
-
-
-    //move bit 31 to position 0
-    tcg_gen_shri_i32(res, res, 31);
-    tcg_gen_shri_i32(Rd, Rd, 31);
-    tcg_gen_shri_i32(Rs, Rs, 31);
-
-    //Set V flag
-    set_v_flag_cp(Rd, Rs, res, cpu_sflags);
-
-    //Set C flag
-    set_c_flag_cp(Rd, Rs, res, cpu_sflags);
-
-    //tcg_temp_new_i32(res);
-    return;
-}
\ No newline at end of file
@@ -32,7 +32,14 @@
 #include "exec/translator.h"
 #include "exec/gen-icount.h"
 
-int checkCondition(int condition, TCGv returnReg, TCGv cpu_r[], TCGv cpu_sflags[]);
+// A condition as a TCG comparison, it holds iff v1 cond v2
+typedef struct DisasCompare {
+    TCGCond cond;
+    TCGv v1;
+    TCGv v2;
+} DisasCompare;
+
+void prepareCondition(int condition, DisasCompare *c, TCGv cpu_sflags[]);
 
 void set_v_flag_add(TCGv op1, TCGv op2, TCGv result, TCGv cpu_sflags[]);
 void set_c_flag_add(TCGv op1, TCGv op2, TCGv result, TCGv cpu_sflags[]);
@@ -42,6 +49,4 @@ void set_c_flag_cp(TCGv op1, TCGv op2, TCGv result, TCGv cpu_sflags[]);
 
 void set_flags_cpc(TCGv op1, TCGv op2, TCGv result, TCGv cpu_sflags[]);
 
-void cpw_instruction(TCGv Rd, TCGv Rs, TCGv cpu_sflags[]);
-
 #endif //QEMU_AVR32_HELPER_CP_INST_H
@@ -21,7 +21,7 @@
 #include "qemu/osdep.h"
 #include "qemu/error-report.h"
 #include "elf.h"
-#include <string.h>
+#include "disas/disas.h"
 #include "target/avr32/helper_elf.h"
 
 const char *AVR32_FIRMWARE_FILE;
@@ -45,12 +45,27 @@ uint16_t avr32_elf_convert_short(short num){
 void avr32_convert_elf_header(Elf32_Ehdr *header){
     // We only need some headers
     header->e_machine = avr32_elf_convert_short(header->e_machine);
+    header->e_entry = avr32_elf_convert_int(header->e_entry);
+    header->e_phoff = avr32_elf_convert_int(header->e_phoff);
+    header->e_phentsize = avr32_elf_convert_short(header->e_phentsize);
+    header->e_phnum = avr32_elf_convert_short(header->e_phnum);
     header->e_shoff = avr32_elf_convert_int(header->e_shoff);
     header->e_shentsize = avr32_elf_convert_short(header->e_shentsize);
     header->e_shnum = avr32_elf_convert_short(header->e_shnum);
     header->e_shstrndx = avr32_elf_convert_short(header->e_shstrndx);
 }
 
+void avr32_convert_elf_program_header(Elf32_Phdr *phdr){
+    phdr->p_type = avr32_elf_convert_int(phdr->p_type);
+    phdr->p_offset = avr32_elf_convert_int(phdr->p_offset);
+    phdr->p_vaddr = avr32_elf_convert_int(phdr->p_vaddr);
+    phdr->p_paddr = avr32_elf_convert_int(phdr->p_paddr);
+    phdr->p_filesz = avr32_elf_convert_int(phdr->p_filesz);
+    phdr->p_memsz = avr32_elf_convert_int(phdr->p_memsz);
+    phdr->p_flags = avr32_elf_convert_int(phdr->p_flags);
+    phdr->p_align = avr32_elf_convert_int(phdr->p_align);
+}
+
 void avr32_elf_read_section_headers(Elf32_Ehdr *header, FILE* file, Elf32_Shdr** sh_table){
     fseek(file, header->e_shoff, SEEK_SET);
     int res;
@@ -82,27 +97,6 @@ void avr32_elf_read_sh_string_table(Elf32_Ehdr *header, FILE* file, Elf32_Shdr**
     }
 }
 
-void avr32_elf_read_string_table(Elf32_Ehdr *header, FILE* file, Elf32_Shdr** sh_table, char *sh_strtable, char* strtable) {
-    int strtab_idx = -1;
-    for(int i= 0; i< header->e_shnum; i++){
-        if(strcmp(&sh_strtable[sh_table[i]->sh_name], ".strtab") == 0){
-            strtab_idx = i;
-            break;
-        }
-    }
-    int offset = sh_table[strtab_idx]->sh_offset;
-    int size = sh_table[strtab_idx]->sh_size;
-
-    int res;
-    fseek(file, offset, SEEK_SET);
-    res = fread(strtable, size, 1, file);
-
-    if(res <= 0){
-        printf("[AVR32-ELF] Read error!");
-        exit(1);
-    }
-}
-
 bool avr32_is_elf_file(const char *filename){
     FILE *firm_file = fopen(filename, "rb");
     char magic[4];
@@ -116,31 +110,115 @@ bool avr32_is_elf_file(const char *filename){
     return (magic[0] == 0x7f && magic[1] == 0x45 && magic[2] == 0x4c && magic[3] == 0x46);
 }
 
-void avr32_read_symtab(Elf32_Ehdr *header, FILE* file, Elf32_Shdr** sh_table, char *sh_strtable, char *strtab, Elf32_Sym** sym_tab){
-    int symtab_idx = -1;
-    for(int i= 0; i< header->e_shnum; i++){
-        if(strcmp(&sh_strtable[sh_table[i]->sh_name], ".symtab") == 0){
-            symtab_idx = i;
+static int avr32_elf_symcmp(const void *s0, const void *s1){
+    const Elf32_Sym *sym0 = s0;
+    const Elf32_Sym *sym1 = s1;
+
+    if(sym0->st_value != sym1->st_value){
+        return sym0->st_value < sym1->st_value ? -1 : 1;
+    }
+    return 0;
+}
+
+static int avr32_elf_symfind(const void *key, const void *s1){
+    hwaddr addr = *(const hwaddr *)key;
+    const Elf32_Sym *sym = s1;
+
+    if(addr < sym->st_value){
+        return -1;
+    }
+    if(addr >= (hwaddr)sym->st_value + sym->st_size){
+        return 1;
+    }
+    return 0;
+}
+
+static const char *avr32_elf_lookup_symbol(struct syminfo *s, hwaddr orig_addr){
+    Elf32_Sym *sym = bsearch(&orig_addr, s->disas_symtab.elf32,
+                             s->disas_num_syms, sizeof(Elf32_Sym),
+                             avr32_elf_symfind);
+
+    return sym ? s->disas_strtab + sym->st_name : "";
+}
+
+/*
+ * Build one sorted table of the function symbols of the mapped image and
+ * register it with lookup_symbol(), so in_asm logs name the firmware
+ * function of each TB. Symbols within [base, base + size) are moved by the
+ * same offset the loader applied to the image.
+ */
+void avr32_elf_load_symbols(const Elf32_Ehdr *header, const uint8_t *data,
+                            size_t len, uint32_t base, uint32_t size,
+                            uint32_t load_base){
+    const Elf32_Shdr *shdrs = (const Elf32_Shdr *)(data + header->e_shoff);
+    uint32_t sym_off = 0, sym_size = 0, str_off = 0, str_size = 0;
+    Elf32_Sym *syms;
+    struct syminfo *s;
+    int nsyms, n = 0;
+
+    if(header->e_shentsize != sizeof(Elf32_Shdr) || header->e_shoff > len ||
+       (uint64_t)header->e_shnum * sizeof(Elf32_Shdr) > len - header->e_shoff){
+        return;
+    }
+
+    for(int i = 0; i < header->e_shnum; i++){
+        if(avr32_elf_convert_int(shdrs[i].sh_type) == SHT_SYMTAB){
+            uint32_t link = avr32_elf_convert_int(shdrs[i].sh_link);
+
+            if(link >= header->e_shnum){
+                return;
+            }
+            sym_off = avr32_elf_convert_int(shdrs[i].sh_offset);
+            sym_size = avr32_elf_convert_int(shdrs[i].sh_size);
+            str_off = avr32_elf_convert_int(shdrs[link].sh_offset);
+            str_size = avr32_elf_convert_int(shdrs[link].sh_size);
             break;
         }
     }
-    int number_of_symbols = (sh_table[symtab_idx]->sh_size / sizeof (Elf32_Sym));
-    sym_tab = malloc(sh_table[symtab_idx]->sh_size);
+    if(!sym_size || sym_off > len || sym_size > len - sym_off ||
+       !str_size || str_off > len || str_size > len - str_off){
+        return;
+    }
 
-    fseek(file, sh_table[symtab_idx]->sh_offset, SEEK_SET);
-    int res;
-    for(int i= 0; i < number_of_symbols; i++){
-        sym_tab[i] = malloc(sizeof (Elf32_Sym));
-        res = fread(sym_tab[i],  sizeof (Elf32_Sym), 1, file);
-        if(res <= 0){
-            error_report("[AVR32-ELF] Cannot read symbol at index 0x%x\n", i);
-            exit(1);
+    nsyms = sym_size / sizeof(Elf32_Sym);
+    syms = g_new(Elf32_Sym, nsyms);
+    for(int i = 0; i < nsyms; i++){
+        Elf32_Sym sym;
+
+        memcpy(&sym, data + sym_off + i * sizeof(Elf32_Sym), sizeof(sym));
+        sym.st_name = avr32_elf_convert_int(sym.st_name);
+        sym.st_value = avr32_elf_convert_int(sym.st_value);
+        sym.st_size = avr32_elf_convert_int(sym.st_size);
+        sym.st_shndx = avr32_elf_convert_short(sym.st_shndx);
+
+        // Only functions are of interest
+        if(sym.st_shndx == SHN_UNDEF || sym.st_shndx >= SHN_LORESERVE ||
+           ELF32_ST_TYPE(sym.st_info) != STT_FUNC || sym.st_name >= str_size){
+            continue;
         }
+        if(sym.st_value >= base && sym.st_value - base < size){
+            sym.st_value = sym.st_value - base + load_base;
+        }
+        syms[n++] = sym;
+    }
+    if(n == 0){
+        g_free(syms);
+        return;
+    }
 
-        sym_tab[i]->st_name = avr32_elf_convert_int(sym_tab[i]->st_name);
-        sym_tab[i]->st_value = avr32_elf_convert_int(sym_tab[i]->st_value);
-        sym_tab[i]->st_size = avr32_elf_convert_int(sym_tab[i]->st_size);
-        sym_tab[i]->st_shndx = avr32_elf_convert_int(sym_tab[i]->st_shndx);
+    qsort(syms, n, sizeof(Elf32_Sym), avr32_elf_symcmp);
+    for(int i = 0; i < n - 1; i++){
+        if(syms[i].st_size == 0){
+            syms[i].st_size = syms[i + 1].st_value - syms[i].st_value;
+        }
     }
 
-}
\ No newline at end of file
+    s = g_new0(struct syminfo, 1);
+    s->lookup_symbol = avr32_elf_lookup_symbol;
+    s->disas_symtab.elf32 = g_renew(Elf32_Sym, syms, n);
+    s->disas_num_syms = n;
+    // Keep a NUL-terminated copy, the file mapping may go away
+    s->disas_strtab = g_strndup((const char *)data + str_off, str_size);
+    s->next = syminfos;
+    syminfos = s;
+}
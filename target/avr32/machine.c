@@ -24,17 +24,19 @@
 static int get_sreg(QEMUFile *f, void *opaque, size_t size,
                     const VMStateField *field)
 {
+    CPUAVR32AState *env = container_of(opaque, CPUAVR32AState, sr);
     uint32_t sreg;
 
     sreg = qemu_get_be32(f);
-    return sreg;
+    avr32_cpu_write_sr(env, sreg);
+    return 0;
 }
 
 static int put_sreg(QEMUFile *f, void *opaque, size_t size,
                     const VMStateField *field, JSONWriter *vmdesc)
 {
-    CPUAVR32AState *env = opaque;
-    uint32_t sreg = env->sr;
+    CPUAVR32AState *env = container_of(opaque, CPUAVR32AState, sr);
+    uint32_t sreg = avr32_cpu_read_sr(env);
 
     qemu_put_be32(f, sreg);
     return 0;
@@ -46,16 +48,50 @@ static const VMStateInfo vms_sreg = {
         .put = put_sreg,
 };
 
+static int avr32_cpu_post_load(void *opaque, int version_id)
+{
+    AVR32ACPU *cpu = opaque;
+
+    avr32_fpu_init_status(&cpu->env);
+    return 0;
+}
+
+/*
+ * The lazy flag state is folded into SR by put_sreg() and comes back as
+ * CC_OP_FLAGS, so cc_op and its operands need not be migrated. COUNT is
+ * derived from the migrated virtual clock plus count_offset. The FPU has
+ * no control or status register, its softfloat state is rebuilt on load.
+ */
 const VMStateDescription vms_avr32_cpu = {
         .name = "cpu",
-        .version_id = 1,
-        .minimum_version_id = 1,
+        .version_id = 4,
+        .minimum_version_id = 2,
+        .post_load = avr32_cpu_post_load,
         .fields = (VMStateField[]) {
 
                 VMSTATE_UINT32_ARRAY(env.r, AVR32ACPU, AVR32A_REG_PAGE_SIZE),
 
                 VMSTATE_SINGLE(env.sr, AVR32ACPU , 0, vms_sreg, uint32_t),
 
+                VMSTATE_UINT32_ARRAY(env.sysr, AVR32ACPU, AVR32A_SYS_REG),
+
+                VMSTATE_INT32(env.intsrc, AVR32ACPU),
+                VMSTATE_INT32(env.intlevel, AVR32ACPU),
+                VMSTATE_UINT64(env.autovector, AVR32ACPU),
+                VMSTATE_INT32(env.isInInterrupt, AVR32ACPU),
+
+                VMSTATE_UINT32(env.count_offset, AVR32ACPU),
+                VMSTATE_TIMER_PTR(env.compare_timer, AVR32ACPU),
+
+                VMSTATE_UINT32_2DARRAY_V(env.tlbehi, AVR32ACPU, 2,
+                                         AVR32B_TLB_ENTRIES, 3),
+                VMSTATE_UINT32_2DARRAY_V(env.tlbelo, AVR32ACPU, 2,
+                                         AVR32B_TLB_ENTRIES, 3),
+                VMSTATE_UINT32_2DARRAY_V(env.bank, AVR32ACPU, AVR32B_REG_BANKS,
+                                         AVR32B_BANKED_REGS, 3),
+
+                VMSTATE_UINT32_ARRAY_V(env.fpr, AVR32ACPU, AVR32_FPU_REGS, 4),
+
                 VMSTATE_END_OF_LIST()
         }
 };
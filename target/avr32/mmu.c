@@ -0,0 +1,288 @@
+/*
+ * QEMU AVR32B memory management unit
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+
+/*
+ * With segmentation enabled, the upper half of the address space is
+ * privileged only. P1 (0x80000000) and P2 (0xa0000000) map the first
+ * 512 MiB of physical memory, P4 (0xe0000000) is mapped one to one. P0
+ * and P3 are translated by the ITLB and DTLB once paging is enabled.
+ *
+ * The TLBs are the page table as far as the softmmu is concerned. There
+ * is no hardware walker, a miss raises an exception with TLBEAR and
+ * TLBEHI set up and the handler refills an entry from the tables at PTBR
+ * with TLBW. The softmmu TLB is not ASID tagged, so changing the ASID
+ * flushes it. Privileged and application accesses use separate MMU
+ * indexes, mode switches need no flush.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/helper-proto.h"
+
+#define AVR32B_P1_BASE      0x80000000u
+#define AVR32B_P3_BASE      0xc0000000u
+#define AVR32B_P4_BASE      0xe0000000u
+#define AVR32B_SEG_MASK     0x1fffffffu
+
+static const int miss[] = {
+    [MMU_DATA_LOAD] = AVR32_EXCP_DTLB_MISS_R,
+    [MMU_DATA_STORE] = AVR32_EXCP_DTLB_MISS_W,
+    [MMU_INST_FETCH] = AVR32_EXCP_ITLB_MISS,
+};
+
+static const int fault[] = {
+    [MMU_DATA_LOAD] = AVR32_EXCP_DTLB_PROT_R,
+    [MMU_DATA_STORE] = AVR32_EXCP_DTLB_PROT_W,
+    [MMU_INST_FETCH] = AVR32_EXCP_ITLB_PROT,
+};
+
+// TLBELO[SZ]: 1K, 4K, 64K or 1M
+static uint64_t avr32b_page_size(uint32_t elo)
+{
+    static const int shift[] = { 10, 12, 16, 20 };
+
+    return 1ull << shift[extract32(elo, AVR32_TLBELO_SZ_SHIFT, 2)];
+}
+
+// Unless MMUCR[M] shares the DTLB, fetches use the ITLB
+static int avr32b_tlb_of(CPUAVR32AState *env, MMUAccessType access_type)
+{
+    if (access_type == MMU_INST_FETCH &&
+        !(env->sysr[AVR32_SYSR_MMUCR] & AVR32_MMUCR_M)) {
+        return AVR32B_ITLB;
+    }
+    return AVR32B_DTLB;
+}
+
+static int avr32b_rp_shift(int tlb)
+{
+    return tlb == AVR32B_ITLB ? AVR32_MMUCR_IRP_SHIFT : AVR32_MMUCR_DRP_SHIFT;
+}
+
+static int avr32b_tlb_find(CPUAVR32AState *env, int tlb, uint32_t addr,
+                           uint32_t asid)
+{
+    for (int i = 0; i < AVR32B_TLB_ENTRIES; i++) {
+        uint32_t ehi = env->tlbehi[tlb][i];
+        uint32_t elo = env->tlbelo[tlb][i];
+
+        if (!(ehi & AVR32_TLBEHI_V) ||
+            ((ehi ^ addr) & ~(uint32_t)(avr32b_page_size(elo) - 1) &
+             AVR32_TLBEHI_VPN_MASK)) {
+            continue;
+        }
+        if ((elo & AVR32_TLBELO_G) || (ehi & AVR32_TLBEHI_ASID_MASK) == asid) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool avr32b_mmu_lookup(CPUAVR32AState *env, uint32_t addr,
+                       MMUAccessType access_type, int mmu_idx,
+                       uint32_t *phys, int *prot, int *excp, uint64_t *size)
+{
+    uint32_t mmucr = env->sysr[AVR32_SYSR_MMUCR];
+    uint32_t elo;
+    uint64_t page;
+    int tlb, n;
+
+    *prot = PAGE_READ | PAGE_WRITE | PAGE_EXEC;
+    *size = TARGET_PAGE_SIZE;
+    *phys = addr;
+
+    if (mmucr & AVR32_MMUCR_S) {
+        if (addr >= AVR32B_P1_BASE && mmu_idx == AVR32_MMU_IDX_USER) {
+            *excp = fault[access_type];
+            return false;
+        }
+        if (addr >= AVR32B_P4_BASE) {
+            return true;
+        }
+        if (addr >= AVR32B_P1_BASE && addr < AVR32B_P3_BASE) {
+            *phys = addr & AVR32B_SEG_MASK;
+            return true;
+        }
+    }
+    if (!(mmucr & AVR32_MMUCR_E)) {
+        return true;
+    }
+
+    tlb = avr32b_tlb_of(env, access_type);
+    n = avr32b_tlb_find(env, tlb, addr,
+                        env->sysr[AVR32_SYSR_TLBEHI] & AVR32_TLBEHI_ASID_MASK);
+    if (n < 0) {
+        *excp = miss[access_type];
+        return false;
+    }
+
+    elo = env->tlbelo[tlb][n];
+    page = avr32b_page_size(elo);
+    *phys = (elo & AVR32_TLBELO_PFN_MASK & ~(uint32_t)(page - 1)) |
+            (addr & (page - 1));
+    *size = page;
+    *prot = avr32_ap_prot(extract32(elo, AVR32_TLBELO_AP_SHIFT, 3), mmu_idx);
+    if (!(*prot & (1 << access_type))) {
+        *excp = fault[access_type];
+        return false;
+    }
+    // Clean pages trap the first write, so the OS can track dirty pages
+    if (!(elo & AVR32_TLBELO_D)) {
+        if (access_type == MMU_DATA_STORE) {
+            *excp = AVR32_EXCP_DTLB_MODIFIED;
+            return false;
+        }
+        *prot &= ~PAGE_WRITE;
+    }
+    if (page < TARGET_PAGE_SIZE && ((*phys ^ addr) & ~TARGET_PAGE_MASK)) {
+        qemu_log_mask(LOG_UNIMP, "avr32b: 1K page at 0x%08x must keep address "
+                      "bits 11:10\n", addr);
+    }
+    return true;
+}
+
+/*
+ * Prepare the state the TLB exception handlers expect. TLBEHI holds the
+ * VPN of the faulting address, so the refill only has to set TLBELO, and
+ * on a miss the replacement pointer selects a free entry, or the next one
+ * round robin.
+ */
+void avr32b_mmu_fault(CPUAVR32AState *env, uint32_t addr,
+                      MMUAccessType access_type, int excp)
+{
+    int tlb = avr32b_tlb_of(env, access_type);
+    int shift = avr32b_rp_shift(tlb);
+    uint32_t ehi = env->sysr[AVR32_SYSR_TLBEHI];
+    int rp, i;
+
+    env->sysr[AVR32_SYSR_TLBEHI] = (addr & AVR32_TLBEHI_VPN_MASK) |
+                                   AVR32_TLBEHI_V |
+                                   (tlb == AVR32B_ITLB ? AVR32_TLBEHI_I : 0) |
+                                   (ehi & AVR32_TLBEHI_ASID_MASK);
+    if (excp != miss[access_type]) {
+        return;
+    }
+
+    for (i = 0; i < AVR32B_TLB_ENTRIES; i++) {
+        if (!(env->tlbehi[tlb][i] & AVR32_TLBEHI_V)) {
+            break;
+        }
+    }
+    rp = extract32(env->sysr[AVR32_SYSR_MMUCR], shift, AVR32_MMUCR_RP_LEN);
+    rp = i < AVR32B_TLB_ENTRIES ? i : (rp + 1) % AVR32B_TLB_ENTRIES;
+    env->sysr[AVR32_SYSR_MMUCR] = deposit32(env->sysr[AVR32_SYSR_MMUCR], shift,
+                                            AVR32_MMUCR_RP_LEN, rp);
+}
+
+void avr32b_mmu_reset(CPUAVR32AState *env)
+{
+    memset(env->tlbehi, 0, sizeof(env->tlbehi));
+    memset(env->tlbelo, 0, sizeof(env->tlbelo));
+    // Paging is off, but the reset vector is in P2
+    env->sysr[AVR32_SYSR_MMUCR] = AVR32_MMUCR_S;
+}
+
+// Drop the softmmu mappings an entry may have produced
+static void avr32b_tlb_flush_entry(CPUAVR32AState *env, int tlb, int n)
+{
+    uint32_t ehi = env->tlbehi[tlb][n];
+    uint64_t page = avr32b_page_size(env->tlbelo[tlb][n]);
+
+    if (ehi & AVR32_TLBEHI_V) {
+        tlb_flush_range_by_mmuidx(env_cpu(env), ehi & ~(uint32_t)(page - 1),
+                                  page, AVR32_MMU_IDX_MASK, TARGET_LONG_BITS);
+    }
+}
+
+// The TLB and entry TLBR, TLBW and TLBS operate on
+static int avr32b_tlb_selected(CPUAVR32AState *env, int *n)
+{
+    int tlb = env->sysr[AVR32_SYSR_TLBEHI] & AVR32_TLBEHI_I ? AVR32B_ITLB
+                                                             : AVR32B_DTLB;
+
+    *n = extract32(env->sysr[AVR32_SYSR_MMUCR], avr32b_rp_shift(tlb),
+                   AVR32_MMUCR_RP_LEN) % AVR32B_TLB_ENTRIES;
+    return tlb;
+}
+
+void helper_mtsr_mmu(CPUAVR32AState *env, uint32_t sr, uint32_t val)
+{
+    uint32_t old = env->sysr[sr];
+
+    if (sr == AVR32_SYSR_TLBEHI) {
+        env->sysr[sr] = val;
+        if ((old ^ val) & AVR32_TLBEHI_ASID_MASK) {
+            tlb_flush(env_cpu(env));
+        }
+        return;
+    }
+
+    // MMUCR
+    if (val & AVR32_MMUCR_I) {
+        for (int i = 0; i < AVR32B_TLB_ENTRIES; i++) {
+            env->tlbehi[AVR32B_DTLB][i] &= ~AVR32_TLBEHI_V;
+            env->tlbehi[AVR32B_ITLB][i] &= ~AVR32_TLBEHI_V;
+        }
+    }
+    env->sysr[sr] = val & ~AVR32_MMUCR_I;
+    if ((val & AVR32_MMUCR_I) ||
+        ((old ^ val) & (AVR32_MMUCR_E | AVR32_MMUCR_M | AVR32_MMUCR_S))) {
+        tlb_flush(env_cpu(env));
+    }
+}
+
+void helper_tlbr(CPUAVR32AState *env)
+{
+    int n, tlb = avr32b_tlb_selected(env, &n);
+
+    env->sysr[AVR32_SYSR_TLBEHI] = env->tlbehi[tlb][n] |
+        (env->sysr[AVR32_SYSR_TLBEHI] & AVR32_TLBEHI_I);
+    env->sysr[AVR32_SYSR_TLBELO] = env->tlbelo[tlb][n];
+}
+
+void helper_tlbw(CPUAVR32AState *env)
+{
+    int n, tlb = avr32b_tlb_selected(env, &n);
+
+    avr32b_tlb_flush_entry(env, tlb, n);
+    env->tlbehi[tlb][n] = env->sysr[AVR32_SYSR_TLBEHI] & ~AVR32_TLBEHI_I;
+    env->tlbelo[tlb][n] = env->sysr[AVR32_SYSR_TLBELO];
+    // The new entry may shadow one with the same VPN
+    avr32b_tlb_flush_entry(env, tlb, n);
+}
+
+void helper_tlbs(CPUAVR32AState *env)
+{
+    uint32_t ehi = env->sysr[AVR32_SYSR_TLBEHI];
+    int tlb = ehi & AVR32_TLBEHI_I ? AVR32B_ITLB : AVR32B_DTLB;
+    int n = avr32b_tlb_find(env, tlb, ehi & AVR32_TLBEHI_VPN_MASK,
+                            ehi & AVR32_TLBEHI_ASID_MASK);
+    uint32_t mmucr = env->sysr[AVR32_SYSR_MMUCR];
+
+    if (n < 0) {
+        mmucr |= AVR32_MMUCR_N;
+    } else {
+        mmucr &= ~AVR32_MMUCR_N;
+        mmucr = deposit32(mmucr, avr32b_rp_shift(tlb), AVR32_MMUCR_RP_LEN, n);
+    }
+    env->sysr[AVR32_SYSR_MMUCR] = mmucr;
+}
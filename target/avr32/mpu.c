@@ -0,0 +1,159 @@
+/*
+ * QEMU AVR32 memory protection unit
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+
+/*
+ * The MPU does not translate, it only checks. There are eight regions of
+ * 2^(SIZE+1) bytes, SIZE >= 11, each split into 16 subregions. MPUPSRn
+ * selects per subregion whether the access permissions of set A or set B
+ * apply. If regions overlap, the lowest numbered one wins. An access that
+ * hits no region raises a TLB miss exception, one without sufficient
+ * rights a TLB protection exception.
+ *
+ * The returned size is the largest naturally aligned block around the
+ * address with uniform rights, so the softmmu can track region sized
+ * mappings. Below a page it falls back to per access checks.
+ */
+
+#include "qemu/osdep.h"
+#include "cpu.h"
+
+#define MPUAR_VALID         1u
+#define MPUAR_SIZE_SHIFT    1
+#define MPUAR_SIZE_LEN      5
+#define MPUAR_BASE_MASK     0xfffff000u
+#define MPUAR_MIN_SIZE      11
+
+#define MPU_SUBREGIONS      16
+
+// Access permission encodings, privileged and application rights
+static const struct {
+    uint8_t priv;
+    uint8_t user;
+} avr32_mpu_ap[16] = {
+    [0x0] = { PAGE_READ,                          0 },
+    [0x1] = { PAGE_READ | PAGE_EXEC,              0 },
+    [0x2] = { PAGE_READ | PAGE_WRITE,             0 },
+    [0x3] = { PAGE_READ | PAGE_WRITE | PAGE_EXEC, 0 },
+    [0x4] = { PAGE_READ,                          PAGE_READ },
+    [0x5] = { PAGE_READ | PAGE_EXEC,              PAGE_READ | PAGE_EXEC },
+    [0x6] = { PAGE_READ | PAGE_WRITE,             PAGE_READ | PAGE_WRITE },
+    [0x7] = { PAGE_READ | PAGE_WRITE | PAGE_EXEC,
+              PAGE_READ | PAGE_WRITE | PAGE_EXEC },
+    [0x8] = { PAGE_READ | PAGE_WRITE,             PAGE_READ },
+    [0x9] = { PAGE_READ | PAGE_WRITE,             PAGE_READ | PAGE_EXEC },
+    // 0xa is no access, the rest is reserved and treated the same
+};
+
+// The AVR32B TLB entries use encodings 0x0-0x7 of the same table
+int avr32_ap_prot(int ap, int mmu_idx)
+{
+    return mmu_idx == AVR32_MMU_IDX_USER ? avr32_mpu_ap[ap].user
+                                         : avr32_mpu_ap[ap].priv;
+}
+
+// Region n as [base, base + size), false if it is disabled or malformed
+static bool avr32_mpu_region(CPUAVR32AState *env, int n, uint32_t *base,
+                             uint64_t *size)
+{
+    uint32_t ar = env->sysr[AVR32_SYSR_MPUAR0 + n];
+    int sz = extract32(ar, MPUAR_SIZE_SHIFT, MPUAR_SIZE_LEN);
+
+    if (!(ar & MPUAR_VALID) || sz < MPUAR_MIN_SIZE) {
+        return false;
+    }
+    *size = 1ull << (sz + 1);
+    *base = ar & MPUAR_BASE_MASK & ~(uint32_t)(*size - 1);
+    return true;
+}
+
+static bool avr32_mpu_overlaps(uint32_t base, uint64_t size,
+                               uint32_t start, uint64_t len)
+{
+    return base < start + len && start < base + size;
+}
+
+bool avr32_mpu_lookup(CPUAVR32AState *env, uint32_t addr,
+                      MMUAccessType access_type, int mmu_idx,
+                      int *prot, int *excp, uint64_t *size)
+{
+    static const int miss[] = {
+        [MMU_DATA_LOAD] = AVR32_EXCP_DTLB_MISS_R,
+        [MMU_DATA_STORE] = AVR32_EXCP_DTLB_MISS_W,
+        [MMU_INST_FETCH] = AVR32_EXCP_ITLB_MISS,
+    };
+    static const int fault[] = {
+        [MMU_DATA_LOAD] = AVR32_EXCP_DTLB_PROT_R,
+        [MMU_DATA_STORE] = AVR32_EXCP_DTLB_PROT_W,
+        [MMU_INST_FETCH] = AVR32_EXCP_ITLB_PROT,
+    };
+    uint32_t base, block;
+    uint64_t region_size, block_size;
+    int n, sub, ap;
+    bool set_b;
+
+    if (!(env->sysr[AVR32_SYSR_MPUCR] & 1)) {
+        *prot = PAGE_READ | PAGE_WRITE | PAGE_EXEC;
+        *size = TARGET_PAGE_SIZE;
+        return true;
+    }
+
+    for (n = 0; n < AVR32_MPU_REGIONS; n++) {
+        if (avr32_mpu_region(env, n, &base, &region_size) &&
+            addr - base < region_size) {
+            break;
+        }
+    }
+    if (n == AVR32_MPU_REGIONS) {
+        *excp = miss[access_type];
+        return false;
+    }
+
+    block_size = region_size / MPU_SUBREGIONS;
+    sub = (addr - base) / block_size;
+    block = base + sub * block_size;
+    set_b = extract32(env->sysr[AVR32_SYSR_MPUPSR0 + n], sub, 1);
+    ap = extract32(env->sysr[set_b ? AVR32_SYSR_MPUAPRB : AVR32_SYSR_MPUAPRA],
+                   4 * n, 4);
+    *prot = avr32_ap_prot(ap, mmu_idx);
+
+    // Shrink the block if a higher priority region covers part of it
+    for (int i = 0; i < n; i++) {
+        uint32_t other;
+        uint64_t other_size;
+
+        if (!avr32_mpu_region(env, i, &other, &other_size) ||
+            !avr32_mpu_overlaps(other, other_size, block, block_size)) {
+            continue;
+        }
+        block_size = TARGET_PAGE_SIZE;
+        block = addr & TARGET_PAGE_MASK;
+        if (avr32_mpu_overlaps(other, other_size, block, block_size)) {
+            block_size = 1;
+            break;
+        }
+    }
+    *size = block_size;
+
+    if (!(*prot & (1 << access_type))) {
+        *excp = fault[access_type];
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+/*
+ * QEMU AVR32 COUNT/COMPARE timer
+ *
+ * Copyright (c) 2022-2023 Florian Göhler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see
+ * <http://www.gnu.org/licenses/lgpl-2.1.html>
+ */
+
+/*
+ * COUNT is never incremented per instruction. It is derived from
+ * QEMU_CLOCK_VIRTUAL scaled to the core clock, plus an offset that
+ * absorbs guest writes. A COMPARE match is scheduled as a QEMUTimer,
+ * which raises the "compare" output line until COMPARE is written again.
+ * Writing 0 to COMPARE disables the match.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+#include "qemu/host-utils.h"
+#include "hw/irq.h"
+#include "cpu.h"
+
+static uint32_t avr32_cpu_cycles(AVR32ACPU *cpu, int64_t now_ns)
+{
+    return muldiv64(now_ns, cpu->clock_speed, NANOSECONDS_PER_SECOND);
+}
+
+static void avr32_cpu_compare_update(AVR32ACPU *cpu)
+{
+    CPUAVR32AState *env = &cpu->env;
+    int64_t now_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    uint64_t wait;
+
+    if (env->sysr[AVR32_SYSR_COMPARE] == 0) {
+        timer_del(env->compare_timer);
+        return;
+    }
+
+    wait = (uint32_t)(env->sysr[AVR32_SYSR_COMPARE] -
+                      avr32_cpu_get_count(env));
+    if (wait == 0) {
+        // COUNT already passed COMPARE, next match after a full wrap
+        wait = 1ULL << 32;
+    }
+    timer_mod(env->compare_timer,
+              now_ns + muldiv64(wait, NANOSECONDS_PER_SECOND,
+                                cpu->clock_speed));
+}
+
+static void avr32_cpu_compare_cb(void *opaque)
+{
+    AVR32ACPU *cpu = opaque;
+
+    qemu_irq_raise(cpu->compare_irq);
+    avr32_cpu_compare_update(cpu);
+}
+
+uint32_t avr32_cpu_get_count(CPUAVR32AState *env)
+{
+    AVR32ACPU *cpu = env_archcpu(env);
+
+    return avr32_cpu_cycles(cpu, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL)) +
+           env->count_offset;
+}
+
+void avr32_cpu_set_count(CPUAVR32AState *env, uint32_t val)
+{
+    AVR32ACPU *cpu = env_archcpu(env);
+
+    env->count_offset = val -
+        avr32_cpu_cycles(cpu, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+    avr32_cpu_compare_update(cpu);
+}
+
+void avr32_cpu_set_compare(CPUAVR32AState *env, uint32_t val)
+{
+    AVR32ACPU *cpu = env_archcpu(env);
+
+    env->sysr[AVR32_SYSR_COMPARE] = val;
+    qemu_irq_lower(cpu->compare_irq);
+    avr32_cpu_compare_update(cpu);
+}
+
+void avr32_cpu_timer_init(AVR32ACPU *cpu)
+{
+    cpu->env.compare_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                          avr32_cpu_compare_cb, cpu);
+}
+
+void avr32_cpu_timer_reset(CPUAVR32AState *env)
+{
+    avr32_cpu_set_count(env, 0);
+    avr32_cpu_set_compare(env, 0);
+}
@@ -21,10 +21,13 @@
 #include "tcg/tcg.h"
 #include "cpu.h"
 #include "tcg/tcg-op.h"
+#include "tcg/tcg-op-gvec.h"
 #include "exec/cpu_ldst.h"
 #include "exec/helper-gen.h"
 #include "exec/log.h"
 #include "exec/translator.h"
+#include "exec/gen-icount.h"
+#include "fpu/softfloat.h"
 #include "helper_conditions.h"
 #include "hw/core/tcg-cpu-ops.h"
 #include "exec/address-spaces.h"
@@ -45,22 +48,23 @@
 #define sflagV 3
 #define sflagQ 4
 #define sflagL 5
-#define sflagT 14
-#define sflagR 15
-#define sflagGM 16
-#define sflagEM 21
 
-static TCGv cpu_sflags[32];
+static TCGv cpu_sflags[AVR32_SR_SPLIT_FLAGS];
+static TCGv cpu_sr;
 
-static TCGv cpu_r[NUM_REG_PAGE_SIZE];
+static TCGv cpu_cc_op;
+static TCGv cpu_cc_src1;
+static TCGv cpu_cc_src2;
+static TCGv cpu_cc_res;
 
-//SystemRegisters
-static TCGv cpu_sysr[AVR32A_SYS_REG];
+static TCGv cpu_r[NUM_REG_PAGE_SIZE];
 
 enum {
-    // Only the PC was modified, keep running without interrupt
+    // PC was written with a computed value, look up the next TB
     DISAS_JUMP = DISAS_TARGET_0,
+    // PC is up to date, return to the main loop
     DISAS_EXIT = DISAS_TARGET_1,
+    // Continue at pc_next through goto_tb slot 1, the fall-through edge
     DISAS_CHAIN = DISAS_TARGET_2
 
 };
@@ -75,6 +79,15 @@ struct DisasContext {
     CPUState *cs;
 
     uint32_t pc;
+    // First byte of the guest page the TB starts in
+    target_ulong page_start;
+
+    // Statically known value of env->cc_op, or CC_OP_DYNAMIC
+    int cc_op;
+    // MMU index of all guest memory accesses, from the TB flags
+    int mem_idx;
+    // AVR32B core, exceptions save state in RSR/RAR instead of the stack
+    bool avr32b;
 };
 
 void avr32_tcg_init(void){
@@ -86,33 +99,57 @@ void avr32_tcg_init(void){
                                           avr32_cpu_r_names[i]);
     }
 
-    for(i = 0;i < AVR32A_SYS_REG; ++i) {
-        char* name;
-        int res_messg = asprintf(&name, "Sysreg-%03d\n", i);
-        if (res_messg < 0){
-        }
-
-        cpu_sysr[i] = tcg_global_mem_new_i32(cpu_env,
-                                             offsetof(CPUAVR32AState, sysr[i]),
-                                             name);
-        free(name);
-    }
-
-    for(i = 0;i < 32; ++i) {
+    for(i = 0;i < AVR32_SR_SPLIT_FLAGS; ++i) {
         cpu_sflags[i] = tcg_global_mem_new_i32(cpu_env,
                                                offsetof(CPUAVR32AState, sflags[i]),
                                                avr32_cpu_sr_flag_names[i]);
     }
+    cpu_sr = tcg_global_mem_new_i32(cpu_env,
+                                    offsetof(CPUAVR32AState, sr), "sr");
+
+    cpu_cc_op = tcg_global_mem_new_i32(cpu_env,
+                                       offsetof(CPUAVR32AState, cc_op), "cc_op");
+    cpu_cc_src1 = tcg_global_mem_new_i32(cpu_env,
+                                         offsetof(CPUAVR32AState, cc_src1), "cc_src1");
+    cpu_cc_src2 = tcg_global_mem_new_i32(cpu_env,
+                                         offsetof(CPUAVR32AState, cc_src2), "cc_src2");
+    cpu_cc_res = tcg_global_mem_new_i32(cpu_env,
+                                        offsetof(CPUAVR32AState, cc_res), "cc_res");
 }
 
-// Decode helper required only if insn wide is variable
+/*
+ * System registers are rarely touched, so they are not TCG globals. Every
+ * global costs liveness and register allocation work in each TB.
+ */
+static void gen_ld_sysr(TCGv dest, int sr){
+    tcg_gen_ld_i32(dest, cpu_env, offsetof(CPUAVR32AState, sysr[sr]));
+}
+
+static void gen_st_sysr(int sr, TCGv src){
+    tcg_gen_st_i32(src, cpu_env, offsetof(CPUAVR32AState, sysr[sr]));
+}
+
+// Insns are always big-endian, independent of the target build endianness
+#if TARGET_BIG_ENDIAN
+#define AVR32_INSN_BSWAP false
+#else
+#define AVR32_INSN_BSWAP true
+#endif
+
+/*
+ * Decode helper required only if insn wide is variable. Fetches go through
+ * the translator loader, which reads from the host pointer of the TB's
+ * pages and keeps page tracking and plugins informed.
+ */
 static uint32_t decode_insn_load_bytes(DisasContext *ctx, uint32_t insn,
                                        int i, int n){
     if(i == 0){
-        insn = cpu_lduw_be_data(ctx->env, ctx->base.pc_next + i) << 16;
+        insn = translator_lduw_swap(ctx->env, &ctx->base,
+                                    ctx->base.pc_next + i, AVR32_INSN_BSWAP) << 16;
     }
     else if (i== 2){
-        insn |= cpu_lduw_be_data(ctx->env, ctx->base.pc_next + i);
+        insn |= translator_lduw_swap(ctx->env, &ctx->base,
+                                     ctx->base.pc_next + i, AVR32_INSN_BSWAP);
     }
 
     //No instruction was loaded.
@@ -122,20 +159,621 @@ static uint32_t decode_insn_load_bytes(DisasContext *ctx, uint32_t insn,
     return insn;
 }
 
+/*
+ * Leave the TB towards a static target. Slot 0 is used for taken branches
+ * and direct calls, slot 1 for the fall-through edge.
+ */
 static void gen_goto_tb(DisasContext* ctx, int n, target_ulong dest){
     if (translator_use_goto_tb(&ctx->base, dest)) {
         tcg_gen_goto_tb(n);
         tcg_gen_movi_i32(cpu_r[PC_REG], dest);
         tcg_gen_exit_tb(ctx->base.tb, n);
     } else {
-
         tcg_gen_movi_i32(cpu_r[PC_REG], dest);
         tcg_gen_lookup_and_goto_ptr();
     }
-    ctx->base.is_jmp = DISAS_CHAIN;
 }
 
 
+/*
+ * Lazy condition flags
+ *
+ * Most instructions only record their operands and result in the cc_*
+ * globals together with the kind of operation. C, Z, N and V are only
+ * computed into sflags when something actually reads them.
+ */
+static void set_cc_op(DisasContext *ctx, int op)
+{
+    if (ctx->cc_op != op) {
+        ctx->cc_op = op;
+        tcg_gen_movi_i32(cpu_cc_op, op);
+    }
+}
+
+// Compute C and V of a pending CC_OP_ADD/CC_OP_SUB into sflags
+static void gen_flags_cv(DisasContext *ctx){
+    TCGv t1 = tcg_temp_new_i32();
+    TCGv t2 = tcg_temp_new_i32();
+
+    if(ctx->cc_op == CC_OP_ADD){
+        tcg_gen_setcond_i32(TCG_COND_LTU, cpu_sflags[sflagC], cpu_cc_res, cpu_cc_src1);
+        tcg_gen_xor_i32(t1, cpu_cc_res, cpu_cc_src1);
+        tcg_gen_xor_i32(t2, cpu_cc_src1, cpu_cc_src2);
+        tcg_gen_andc_i32(t1, t1, t2);
+    }
+    else{
+        tcg_gen_setcond_i32(TCG_COND_LTU, cpu_sflags[sflagC], cpu_cc_src1, cpu_cc_src2);
+        tcg_gen_xor_i32(t1, cpu_cc_src1, cpu_cc_src2);
+        tcg_gen_xor_i32(t2, cpu_cc_src1, cpu_cc_res);
+        tcg_gen_and_i32(t1, t1, t2);
+    }
+    tcg_gen_shri_i32(cpu_sflags[sflagV], t1, 31);
+}
+
+// Make C, Z, N and V valid in sflags
+static void gen_flush_flags(DisasContext *ctx){
+    switch (ctx->cc_op) {
+        case CC_OP_FLAGS:
+            return;
+        case CC_OP_DYNAMIC:
+            gen_helper_sync_flags(cpu_env);
+            ctx->cc_op = CC_OP_FLAGS;
+            return;
+        case CC_OP_ADD:
+        case CC_OP_SUB:
+            gen_flags_cv(ctx);
+            /* fall through */
+        case CC_OP_LOGIC:
+            tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], cpu_cc_res, 0);
+            tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_cc_res, 31);
+            break;
+        default:
+            g_assert_not_reached();
+    }
+    set_cc_op(ctx, CC_OP_FLAGS);
+}
+
+static void gen_add_cc(DisasContext *ctx, TCGv res, TCGv src1, TCGv src2){
+    tcg_gen_mov_i32(cpu_cc_src1, src1);
+    tcg_gen_mov_i32(cpu_cc_src2, src2);
+    tcg_gen_mov_i32(cpu_cc_res, res);
+    set_cc_op(ctx, CC_OP_ADD);
+}
+
+static void gen_sub_cc(DisasContext *ctx, TCGv res, TCGv src1, TCGv src2){
+    tcg_gen_mov_i32(cpu_cc_src1, src1);
+    tcg_gen_mov_i32(cpu_cc_src2, src2);
+    tcg_gen_mov_i32(cpu_cc_res, res);
+    set_cc_op(ctx, CC_OP_SUB);
+}
+
+// Z and N from res, C and V must already be valid in sflags
+static void gen_set_logic_cc(DisasContext *ctx, TCGv res){
+    tcg_gen_mov_i32(cpu_cc_res, res);
+    set_cc_op(ctx, CC_OP_LOGIC);
+}
+
+// Z and N from res, C and V keep their current value
+static void gen_logic_cc(DisasContext *ctx, TCGv res){
+    switch (ctx->cc_op) {
+        case CC_OP_DYNAMIC:
+            gen_helper_sync_flags(cpu_env);
+            break;
+        case CC_OP_ADD:
+        case CC_OP_SUB:
+            gen_flags_cv(ctx);
+            break;
+        default:
+            break;
+    }
+    gen_set_logic_cc(ctx, res);
+}
+
+// Assemble the architectural SR from cpu_sr and the split flags
+static void gen_read_sr(DisasContext *ctx, TCGv dest){
+    gen_flush_flags(ctx);
+    tcg_gen_mov_i32(dest, cpu_sr);
+    for(int i = 0; i < AVR32_SR_SPLIT_FLAGS; i++){
+        tcg_gen_deposit_i32(dest, dest, cpu_sflags[i], i, 1);
+    }
+}
+
+static void gen_write_sr(DisasContext *ctx, TCGv src){
+    set_cc_op(ctx, CC_OP_FLAGS);
+    for(int i = 0; i < AVR32_SR_SPLIT_FLAGS; i++){
+        tcg_gen_extract_i32(cpu_sflags[i], src, i, 1);
+    }
+    tcg_gen_andi_i32(cpu_sr, src, ~AVR32_SR_SPLIT_MASK);
+}
+
+// SR[M2:M0]
+static void gen_read_sr_mode(TCGv dest){
+    tcg_gen_extract_i32(dest, cpu_sr, AVR32_SR_M_SHIFT, AVR32_SR_M_LEN);
+}
+
+// End the TB after this insn, e.g. when an SR write may unmask an interrupt
+static void gen_exit_after_insn(DisasContext *ctx){
+    tcg_gen_movi_tl(cpu_r[PC_REG], ctx->base.pc_next);
+    ctx->base.is_jmp = DISAS_EXIT;
+}
+
+/*
+ * Supervisor only insns raise a privilege violation in application mode.
+ * Call after advancing pc_next, the exception is taken at the insn itself.
+ */
+static bool gen_check_priv(DisasContext *ctx){
+    if (ctx->mem_idx != AVR32_MMU_IDX_USER) {
+        return true;
+    }
+    gen_helper_raise_privilege_violation(cpu_env);
+    ctx->base.is_jmp = DISAS_NORETURN;
+    return false;
+}
+
+// COUNT and COMPARE are backed by the virtual clock, see timer.c
+static void gen_timer_io_start(DisasContext *ctx){
+    if (tb_cflags(ctx->base.tb) & CF_USE_ICOUNT) {
+        gen_io_start();
+        gen_exit_after_insn(ctx);
+    }
+}
+
+/*
+ * Conditions compare the lazy flag operands directly where possible, so
+ * e.g. cp.w + br{cond} needs neither materialised flags nor a setcond.
+ */
+static void gen_prepare_cond(DisasContext *ctx, int condition, DisasCompare *c){
+    static const TCGCond sub_cond[] = {
+        [0x0] = TCG_COND_EQ, [0x1] = TCG_COND_NE,
+        [0x2] = TCG_COND_GEU, [0x3] = TCG_COND_LTU,
+        [0x4] = TCG_COND_GE, [0x5] = TCG_COND_LT,
+        [0x8] = TCG_COND_LEU, [0x9] = TCG_COND_GT,
+        [0xa] = TCG_COND_LE, [0xb] = TCG_COND_GTU,
+    };
+
+    switch (ctx->cc_op) {
+        case CC_OP_SUB:
+            if(condition <= 0xb && condition != 0x6 && condition != 0x7){
+                c->cond = sub_cond[condition];
+                c->v1 = cpu_cc_src1;
+                c->v2 = cpu_cc_src2;
+                return;
+            }
+            /* fall through */
+        case CC_OP_ADD:
+        case CC_OP_LOGIC:
+            // eq, ne, mi and pl only depend on the result
+            if(condition <= 0x1 || condition == 0x6 || condition == 0x7){
+                c->cond = condition == 0x0 ? TCG_COND_EQ :
+                          condition == 0x1 ? TCG_COND_NE :
+                          condition == 0x6 ? TCG_COND_LT : TCG_COND_GE;
+                c->v1 = cpu_cc_res;
+                c->v2 = tcg_constant_i32(0);
+                return;
+            }
+            // CC_OP_LOGIC keeps C and V in sflags
+            if(ctx->cc_op == CC_OP_LOGIC &&
+               (condition == 0x2 || condition == 0x3 ||
+                condition == 0xc || condition == 0xd)){
+                break;
+            }
+            /* fall through */
+        default:
+            if(condition < 0xe){
+                gen_flush_flags(ctx);
+            }
+            break;
+    }
+    prepareCondition(condition, c, cpu_sflags);
+}
+
+// Branch to l unless condition holds
+static void gen_brcond_false(DisasContext *ctx, int condition, TCGLabel *l){
+    DisasCompare c;
+
+    gen_prepare_cond(ctx, condition, &c);
+    tcg_gen_brcond_i32(tcg_invert_cond(c.cond), c.v1, c.v2, l);
+}
+
+// rd = cond ? val : rd, a conditional write to PC falls through otherwise
+static void gen_movcond_rd(DisasContext *ctx, DisasCompare *c, int rd,
+                           TCGv val, int insn_len){
+    TCGv old = cpu_r[rd];
+
+    if(rd == PC_REG){
+        old = tcg_constant_i32(ctx->base.pc_next + insn_len);
+        ctx->base.is_jmp = DISAS_JUMP;
+    }
+    tcg_gen_movcond_i32(c->cond, cpu_r[rd], c->v1, c->v2, val, old);
+}
+
+/*
+ * Multi-register transfers address every slot from a single base and write
+ * the base register back once, so a fault part way through leaves it
+ * unchanged and the insn can simply be restarted.
+ */
+
+// Load regs[i] from base + 4 * i
+static void gen_ld_multi(DisasContext *ctx, TCGv base, const int *regs, int n){
+    TCGv addr = tcg_temp_new_i32();
+
+    for(int i = 0; i < n; i++){
+        tcg_gen_addi_i32(addr, base, 4 * i);
+        tcg_gen_qemu_ld_tl(cpu_r[regs[i]], addr, ctx->mem_idx, MO_BEUL);
+    }
+}
+
+// Store vals[i] to base + offset + step * i
+static void gen_st_multi(DisasContext *ctx, TCGv base, TCGv *vals, int n,
+                         int offset, int step){
+    TCGv addr = tcg_temp_new_i32();
+
+    for(int i = 0; i < n; i++){
+        tcg_gen_addi_i32(addr, base, offset + step * i);
+        tcg_gen_qemu_st_tl(vals[i], addr, ctx->mem_idx, MO_BEUL);
+    }
+}
+
+/*
+ * Expand the PUSHM/POPM register list (R0-R3, R4-R7, R8-R9, R10, R11, R12,
+ * LR, PC from bit 0 up) into regs[] in push order, return the count.
+ */
+static int pushm_list_regs(int list, int *regs){
+    static const int first[8] = {0, 4, 8, 10, 11, 12, LR_REG, PC_REG};
+    static const int count[8] = {4, 4, 2, 1, 1, 1, 1, 1};
+    int n = 0;
+
+    for(int b = 0; b < 8; b++){
+        if(((list >> b) & 1) == 1){
+            for(int r = first[b]; r < first[b] + count[b]; r++){
+                regs[n++] = r;
+            }
+        }
+    }
+    return n;
+}
+
+// Return value placed in R12 by POPM/LDM with PC and the return flag set
+static int multi_ret_value(bool lr, bool r12){
+    if(!lr && !r12){
+        return 0;
+    }
+    if(!lr && r12){
+        return 1;
+    }
+    return -1;
+}
+
+// Signed halfword of src, top selects bits 31:16
+static void gen_sext_half(TCGv dest, TCGv src, int top){
+    tcg_gen_sextract_i32(dest, src, top ? 16 : 0, 16);
+}
+
+// dest = SSAT32(a + b), Q is set if the sum saturates
+static void gen_ssadd_q(TCGv dest, TCGv a, TCGv b){
+    TCGv res = tcg_temp_new_i32();
+    TCGv ovf = tcg_temp_new_i32();
+    TCGv tmp = tcg_temp_new_i32();
+    TCGv sat = tcg_temp_new_i32();
+
+    tcg_gen_add_i32(res, a, b);
+    tcg_gen_xor_i32(ovf, res, a);
+    tcg_gen_xor_i32(tmp, a, b);
+    tcg_gen_andc_i32(ovf, ovf, tmp);
+
+    // On overflow both operands have the sign of a
+    tcg_gen_sari_i32(sat, a, 31);
+    tcg_gen_xori_i32(sat, sat, INT32_MAX);
+    tcg_gen_movcond_i32(TCG_COND_LT, dest, ovf, tcg_constant_i32(0), sat, res);
+
+    tcg_gen_shri_i32(tmp, ovf, 31);
+    tcg_gen_or_i32(cpu_sflags[sflagQ], cpu_sflags[sflagQ], tmp);
+}
+
+typedef void GenLaneFn(TCGv, TCGv, TCGv);
+
+/*
+ * Packed SIMD operation on the lane-bit wide lanes of rx and ry. Each lane
+ * is extracted, fn'ed and, if sat is set, clamped to the lane range before
+ * being deposited into rd. Crossed operations pair the lanes of rx with
+ * the lanes of ry in reverse order.
+ */
+static void gen_packed(TCGv rd, TCGv rx, TCGv ry, int lane, bool sign,
+                       bool cross, bool sat, GenLaneFn *fn){
+    TCGv res = tcg_temp_new_i32();
+    TCGv ta = tcg_temp_new_i32();
+    TCGv tb = tcg_temp_new_i32();
+    int lanes = 32 / lane;
+    int32_t min = sign ? -(1 << (lane - 1)) : 0;
+    int32_t max = sign ? (1 << (lane - 1)) - 1 : (1 << lane) - 1;
+
+    tcg_gen_movi_i32(res, 0);
+    for(int i = 0; i < lanes; i++){
+        int ofs_a = i * lane;
+        int ofs_b = cross ? (lanes - 1 - i) * lane : ofs_a;
+
+        if(sign){
+            tcg_gen_sextract_i32(ta, rx, ofs_a, lane);
+            tcg_gen_sextract_i32(tb, ry, ofs_b, lane);
+        }
+        else{
+            tcg_gen_extract_i32(ta, rx, ofs_a, lane);
+            tcg_gen_extract_i32(tb, ry, ofs_b, lane);
+        }
+        fn(ta, ta, tb);
+        if(sat){
+            tcg_gen_smax_i32(ta, ta, tcg_constant_i32(min));
+            tcg_gen_smin_i32(ta, ta, tcg_constant_i32(max));
+        }
+        tcg_gen_deposit_i32(res, res, ta, ofs_a, lane);
+    }
+    tcg_gen_mov_i32(rd, res);
+}
+
+static void gen_lane_addh(TCGv d, TCGv a, TCGv b){
+    tcg_gen_add_i32(d, a, b);
+    tcg_gen_sari_i32(d, d, 1);
+}
+
+static void gen_lane_subh(TCGv d, TCGv a, TCGv b){
+    tcg_gen_sub_i32(d, a, b);
+    tcg_gen_sari_i32(d, d, 1);
+}
+
+static void gen_lane_avg(TCGv d, TCGv a, TCGv b){
+    tcg_gen_add_i32(d, a, b);
+    tcg_gen_addi_i32(d, d, 1);
+    tcg_gen_sari_i32(d, d, 1);
+}
+
+static void gen_lane_abs(TCGv d, TCGv a, TCGv b){
+    tcg_gen_abs_i32(d, b);
+}
+
+/*
+ * FPU coprocessor, COP CP0 with OP[6:1] selecting the operation and OP[0]
+ * double precision. Doubles live in even/odd register pairs, like the
+ * register pairs of the CPU the odd one holds the most significant word.
+ */
+enum {
+    FPU_FMAC,       // CRd += CRx * CRy, fused
+    FPU_FNMAC,      // CRd = -CRd + CRx * CRy
+    FPU_FMSC,       // CRd -= CRx * CRy
+    FPU_FNMSC,      // CRd = -CRd - CRx * CRy
+    FPU_FMUL,
+    FPU_FNMUL,
+    FPU_FADD,
+    FPU_FSUB,
+    FPU_FCASTR_SW,  // to int32, rounding towards zero
+    FPU_FCASTR_UW,
+    FPU_FCASTSW,    // from int32
+    FPU_FCASTUW,
+    FPU_FCMP,
+    FPU_FCHK,
+    FPU_FRCPA,
+    FPU_FRSQRTA,
+    FPU_FABS,
+    FPU_FNEG,
+    FPU_FMOV,
+    FPU_FCAST,      // fcasts.d to single, fcastd.s to double
+};
+
+static void gen_ld_fpr(TCGv dest, int n){
+    tcg_gen_ld_i32(dest, cpu_env, offsetof(CPUAVR32AState, fpr[n]));
+}
+
+static void gen_st_fpr(int n, TCGv src){
+    tcg_gen_st_i32(src, cpu_env, offsetof(CPUAVR32AState, fpr[n]));
+}
+
+static void gen_ld_fpr_d(TCGv_i64 dest, int n){
+    TCGv lo = tcg_temp_new_i32();
+    TCGv hi = tcg_temp_new_i32();
+
+    gen_ld_fpr(lo, n);
+    gen_ld_fpr(hi, n + 1);
+    tcg_gen_concat_i32_i64(dest, lo, hi);
+}
+
+static void gen_st_fpr_d(int n, TCGv_i64 src){
+    TCGv lo = tcg_temp_new_i32();
+    TCGv hi = tcg_temp_new_i32();
+
+    tcg_gen_extr_i64_i32(lo, hi, src);
+    gen_st_fpr(n, lo);
+    gen_st_fpr(n + 1, hi);
+}
+
+/*
+ * fcmp sets Z on equal, C and N on less and V on unordered, so the
+ * unsigned conditions test ordered relations: eq, lo, hs, ...
+ */
+static void gen_fcmp_flags(DisasContext *ctx, TCGv rel){
+    set_cc_op(ctx, CC_OP_FLAGS);
+    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], rel,
+                         float_relation_equal);
+    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagC], rel,
+                         float_relation_less);
+    tcg_gen_mov_i32(cpu_sflags[sflagN], cpu_sflags[sflagC]);
+    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagV], rel,
+                         float_relation_unordered);
+}
+
+static const int fpu_muladd_flags[] = {
+    [FPU_FMAC] = 0,
+    [FPU_FNMAC] = float_muladd_negate_c,
+    [FPU_FMSC] = float_muladd_negate_product,
+    [FPU_FNMSC] = float_muladd_negate_c | float_muladd_negate_product,
+};
+
+static bool gen_fpu_op_s(DisasContext *ctx, int op, int d, int x, int y){
+    TCGv fd = tcg_temp_new_i32();
+    TCGv fx = tcg_temp_new_i32();
+    TCGv fy = tcg_temp_new_i32();
+    TCGv_i64 t;
+
+    gen_ld_fpr(fx, x);
+    gen_ld_fpr(fy, y);
+    switch (op) {
+    case FPU_FMAC:
+    case FPU_FNMAC:
+    case FPU_FMSC:
+    case FPU_FNMSC:
+        gen_ld_fpr(fd, d);
+        gen_helper_fmac_s(fd, cpu_env, fd, fx, fy,
+                          tcg_constant_i32(fpu_muladd_flags[op]));
+        break;
+    case FPU_FMUL:
+        gen_helper_fmul_s(fd, cpu_env, fx, fy);
+        break;
+    case FPU_FNMUL:
+        gen_helper_fmul_s(fd, cpu_env, fx, fy);
+        tcg_gen_xori_i32(fd, fd, INT32_MIN);
+        break;
+    case FPU_FADD:
+        gen_helper_fadd_s(fd, cpu_env, fx, fy);
+        break;
+    case FPU_FSUB:
+        gen_helper_fsub_s(fd, cpu_env, fx, fy);
+        break;
+    case FPU_FCASTR_SW:
+        gen_helper_fcastrs_sw(fd, cpu_env, fx);
+        break;
+    case FPU_FCASTR_UW:
+        gen_helper_fcastrs_uw(fd, cpu_env, fx);
+        break;
+    case FPU_FCASTSW:
+        gen_helper_fcastsw_s(fd, cpu_env, fx);
+        break;
+    case FPU_FCASTUW:
+        gen_helper_fcastuw_s(fd, cpu_env, fx);
+        break;
+    case FPU_FCMP:
+        gen_helper_fcmp_s(fd, cpu_env, fx, fy);
+        gen_fcmp_flags(ctx, fd);
+        return true;
+    case FPU_FRCPA:
+        gen_helper_frcpa_s(fd, cpu_env, fx);
+        break;
+    case FPU_FRSQRTA:
+        gen_helper_frsqrta_s(fd, cpu_env, fx);
+        break;
+    case FPU_FABS:
+        tcg_gen_andi_i32(fd, fx, INT32_MAX);
+        break;
+    case FPU_FNEG:
+        tcg_gen_xori_i32(fd, fx, INT32_MIN);
+        break;
+    case FPU_FMOV:
+        tcg_gen_mov_i32(fd, fx);
+        break;
+    case FPU_FCAST:
+        if (x & 1) {
+            return false;
+        }
+        t = tcg_temp_new_i64();
+        gen_ld_fpr_d(t, x);
+        gen_helper_fcasts_d(fd, cpu_env, t);
+        break;
+    default:
+        return false;
+    }
+    gen_st_fpr(d, fd);
+    return true;
+}
+
+static bool gen_fpu_op_d(DisasContext *ctx, int op, int d, int x, int y){
+    TCGv_i64 fd = tcg_temp_new_i64();
+    TCGv_i64 fx = tcg_temp_new_i64();
+    TCGv_i64 fy = tcg_temp_new_i64();
+    TCGv t = tcg_temp_new_i32();
+
+    // Conversions from or to a single register
+    switch (op) {
+    case FPU_FCASTR_SW:
+    case FPU_FCASTR_UW:
+        if (x & 1) {
+            return false;
+        }
+        gen_ld_fpr_d(fx, x);
+        if (op == FPU_FCASTR_SW) {
+            gen_helper_fcastrd_sw(t, cpu_env, fx);
+        } else {
+            gen_helper_fcastrd_uw(t, cpu_env, fx);
+        }
+        gen_st_fpr(d, t);
+        return true;
+    case FPU_FCASTSW:
+    case FPU_FCASTUW:
+    case FPU_FCAST:
+        if (d & 1) {
+            return false;
+        }
+        gen_ld_fpr(t, x);
+        if (op == FPU_FCASTSW) {
+            gen_helper_fcastsw_d(fd, cpu_env, t);
+        } else if (op == FPU_FCASTUW) {
+            gen_helper_fcastuw_d(fd, cpu_env, t);
+        } else {
+            gen_helper_fcastd_s(fd, cpu_env, t);
+        }
+        gen_st_fpr_d(d, fd);
+        return true;
+    }
+
+    if ((d | x | y) & 1) {
+        return false;
+    }
+    gen_ld_fpr_d(fx, x);
+    gen_ld_fpr_d(fy, y);
+    switch (op) {
+    case FPU_FMAC:
+    case FPU_FNMAC:
+    case FPU_FMSC:
+    case FPU_FNMSC:
+        gen_ld_fpr_d(fd, d);
+        gen_helper_fmac_d(fd, cpu_env, fd, fx, fy,
+                          tcg_constant_i32(fpu_muladd_flags[op]));
+        break;
+    case FPU_FMUL:
+        gen_helper_fmul_d(fd, cpu_env, fx, fy);
+        break;
+    case FPU_FNMUL:
+        gen_helper_fmul_d(fd, cpu_env, fx, fy);
+        tcg_gen_xori_i64(fd, fd, INT64_MIN);
+        break;
+    case FPU_FADD:
+        gen_helper_fadd_d(fd, cpu_env, fx, fy);
+        break;
+    case FPU_FSUB:
+        gen_helper_fsub_d(fd, cpu_env, fx, fy);
+        break;
+    case FPU_FCMP:
+        gen_helper_fcmp_d(t, cpu_env, fx, fy);
+        gen_fcmp_flags(ctx, t);
+        return true;
+    case FPU_FRCPA:
+        gen_helper_frcpa_d(fd, cpu_env, fx);
+        break;
+    case FPU_FRSQRTA:
+        gen_helper_frsqrta_d(fd, cpu_env, fx);
+        break;
+    case FPU_FABS:
+        tcg_gen_andi_i64(fd, fx, INT64_MAX);
+        break;
+    case FPU_FNEG:
+        tcg_gen_xori_i64(fd, fx, INT64_MIN);
+        break;
+    case FPU_FMOV:
+        tcg_gen_mov_i64(fd, fx);
+        break;
+    default:
+        return false;
+    }
+    gen_st_fpr_d(d, fd);
+    return true;
+}
+
 static uint32_t decode_insn_load(DisasContext *ctx);
 static bool decode_insn(DisasContext *ctx, uint32_t insn);
 #include "decode-insn.c.inc"
@@ -148,6 +786,7 @@ static int sign_extend_8(int number){
 }
 
 static bool trans_ABS(DisasContext *ctx, arg_ABS *a){
+    gen_flush_flags(ctx);
     TCGv reg = cpu_r[a->rd];
     tcg_gen_abs_i32(reg, reg);
     tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], reg, 0); /* Zf = R == 0 */
@@ -155,20 +794,24 @@ static bool trans_ABS(DisasContext *ctx, arg_ABS *a){
     return true;
 }
 
-//TODO: add tests
+// PC = *(ACBA + disp * 4), the target is loaded before LR is written
 static bool trans_ACALL(DisasContext *ctx, arg_ACALL *a){
-    TCGv temp = tcg_temp_new_i32();
-    tcg_gen_movi_i32(temp, a->disp << 2);
-
-    tcg_gen_addi_i32(cpu_r[AVR32A_LR_REG], cpu_r[AVR32A_LR_REG], 0x2);
-    tcg_gen_add_i32(cpu_r[AVR32A_PC_REG], temp, cpu_sysr[2]);
+    TCGv ptr = tcg_temp_new_i32();
+    TCGv dest = tcg_temp_new_i32();
 
+    gen_ld_sysr(ptr, AVR32_SYSR_ACBA);
+    tcg_gen_addi_i32(ptr, ptr, a->disp << 2);
+    tcg_gen_qemu_ld_i32(dest, ptr, ctx->mem_idx, MO_BEUL);
+    tcg_gen_movi_i32(cpu_r[AVR32A_LR_REG], ctx->base.pc_next + 2);
+    tcg_gen_mov_i32(cpu_r[AVR32A_PC_REG], dest);
 
+    ctx->base.is_jmp = DISAS_JUMP;
     ctx->base.pc_next += 2;
     return true;
 }
 
 static bool trans_ACR(DisasContext *ctx, arg_ACR *a){
+    gen_flush_flags(ctx);
     TCGv rd = tcg_temp_new_i32();
     TCGv res = tcg_temp_new_i32();
     TCGv cond = tcg_temp_new_i32();
@@ -202,6 +845,7 @@ static bool trans_ACR(DisasContext *ctx, arg_ACR *a){
 }
 
 static bool trans_ADC(DisasContext *ctx, arg_ADC *a){
+    gen_flush_flags(ctx);
     TCGv res = tcg_temp_new_i32();
     TCGv rx = tcg_temp_new_i32();
     TCGv ry = tcg_temp_new_i32();
@@ -238,31 +882,10 @@ static bool trans_ADC(DisasContext *ctx, arg_ADC *a){
 
 static bool trans_ADD_f1(DisasContext *ctx, arg_ADD_f1 *a){
     TCGv res = tcg_temp_new_i32();
-    TCGv Rd = tcg_temp_new_i32();
-    TCGv Rs = tcg_temp_new_i32();
-    tcg_gen_mov_i32(Rd,  cpu_r[a->rd]);
-    tcg_gen_mov_i32(Rs, cpu_r[a->rs]);
-
-
-    tcg_gen_add_i32(res,  cpu_r[a->rd], cpu_r[a->rs]);
-    tcg_gen_add_i32(cpu_r[a->rd],  cpu_r[a->rd], cpu_r[a->rs]);
-
-    // set N flag: N ← RES[31]
-    tcg_gen_shri_i32(cpu_sflags[sflagN], res, 31);
-
-    // set Z flag: Z ← (RES[31:0] == 0)
-    tcg_gen_setcondi_tl(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0); /* Zf = R == 0 */
-
-    tcg_gen_shri_i32(Rd, Rd, 31);
-    tcg_gen_shri_i32(Rs, Rs, 31);
-    tcg_gen_shri_i32(res, res, 31);
-
-    // V-flag
-    set_v_flag_add(Rd, Rs, res, cpu_sflags);
-
-    // C-flag
-    set_c_flag_add(Rd, Rs, res, cpu_sflags);
 
+    tcg_gen_add_i32(res, cpu_r[a->rd], cpu_r[a->rs]);
+    gen_add_cc(ctx, res, cpu_r[a->rd], cpu_r[a->rs]);
+    tcg_gen_mov_i32(cpu_r[a->rd], res);
 
     if(a->rd == PC_REG){
         ctx->base.is_jmp = DISAS_JUMP;
@@ -274,33 +897,12 @@ static bool trans_ADD_f1(DisasContext *ctx, arg_ADD_f1 *a){
 
 static bool trans_ADD_f2(DisasContext *ctx, arg_ADD_f2 *a){
     TCGv res = tcg_temp_new_i32();
-
-    TCGv Rx = tcg_temp_new_i32();
     TCGv Ry = tcg_temp_new_i32();
 
-    tcg_gen_mov_i32(Rx, cpu_r[a->rx]);
     tcg_gen_shli_i32(Ry, cpu_r[a->ry], a->sa);
-
-    tcg_gen_add_i32(res, Rx, Ry);
-    tcg_gen_add_i32(cpu_r[a->rd], Rx, Ry);
-
-    // set N flag: N ← RES[31]
-    tcg_gen_shri_i32(cpu_sflags[sflagN], res, 31);
-
-    // set Z flag: Z ← (RES[31:0] == 0)
-    tcg_gen_setcondi_tl(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0); /* Zf = R == 0 */
-
-
-    tcg_gen_shri_i32(Rx, Rx, 31);
-    tcg_gen_shri_i32(Ry, Ry, 31);
-    tcg_gen_shri_i32(res, res, 31);
-
-    // V-flag
-    set_v_flag_add(Rx, Ry, res, cpu_sflags);
-
-    // C-flag
-    set_c_flag_add(Rx, Ry, res, cpu_sflags);
-
+    tcg_gen_add_i32(res, cpu_r[a->rx], Ry);
+    gen_add_cc(ctx, res, cpu_r[a->rx], Ry);
+    tcg_gen_mov_i32(cpu_r[a->rd], res);
 
     if(a->rd == PC_REG){
         ctx->base.is_jmp = DISAS_JUMP;
@@ -311,27 +913,20 @@ static bool trans_ADD_f2(DisasContext *ctx, arg_ADD_f2 *a){
 }
 
 static bool trans_ADD_cond(DisasContext *ctx, arg_ADD_cond *a){
+    DisasCompare c;
+    TCGv res = tcg_temp_new_i32();
 
-    TCGLabel *no_add = gen_new_label();
-
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond, reg, cpu_r, cpu_sflags);
-
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, no_add);
-    tcg_gen_add_i32(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry]);
-
-    gen_set_label(no_add);
-
+    gen_prepare_cond(ctx, a->cond, &c);
+    tcg_gen_add_i32(res, cpu_r[a->rx], cpu_r[a->ry]);
+    gen_movcond_rd(ctx, &c, a->rd, res, 4);
 
-    if(a->rd == PC_REG){
-        ctx->base.is_jmp = DISAS_JUMP;
-    }
     ctx->base.pc_next += 4;
     return true;
 }
 
 //TODO: Add tests
 static bool trans_ADDABS(DisasContext *ctx, arg_ADDABS *a){
+    gen_flush_flags(ctx);
     TCGv temp = tcg_temp_new_i32();
     tcg_gen_abs_i32(temp, cpu_r[a->ry]);
     tcg_gen_add_i32(cpu_r[a->rd], cpu_r[a->rx], temp);
@@ -343,46 +938,16 @@ static bool trans_ADDABS(DisasContext *ctx, arg_ADDABS *a){
     return true;
 }
 
-//TODO: add tests
 static bool trans_ADDHHW(DisasContext *ctx, arg_ADDHHW *a){
     TCGv op1 = tcg_temp_new_i32();
     TCGv op2 = tcg_temp_new_i32();
     TCGv res = tcg_temp_new_i32();
 
-    if(a->x == 1){
-        tcg_gen_shri_i32(op1, cpu_r[a->rx], 0x10);
-    }
-    else{
-        tcg_gen_andi_i32(op1, cpu_r[a->rx], 0xFFFF);
-    }
-    tcg_gen_ext16s_i32(op1, op1);
-
-    if(a->y == 1){
-        tcg_gen_shri_i32(op2, cpu_r[a->ry], 0x10);
-    }
-    else{
-        tcg_gen_andi_i32(op2, cpu_r[a->ry], 0xFFFF);
-    }
-    tcg_gen_ext16s_i32(op2, op2);
-    tcg_gen_add_i32(cpu_r[a->rd], op1, op2);
-
-    tcg_gen_mov_i32(res, cpu_r[a->rd]);
-
-    // set N flag: N ← RES[31]
-    tcg_gen_shri_i32(cpu_sflags[sflagN], res, 31);
-
-    // set Z flag: Z ← (RES[31:0] == 0)
-    tcg_gen_setcondi_tl(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0); /* Zf = R == 0 */
-
-    tcg_gen_shri_i32(op1, op1, 31);
-    tcg_gen_shri_i32(op2, op2, 31);
-    tcg_gen_shri_i32(res, res, 31);
-
-    // V-flag
-    set_v_flag_add(op1, op2, res, cpu_sflags);
-
-    // C-flag
-    set_c_flag_add(op1, op2, res, cpu_sflags);
+    gen_sext_half(op1, cpu_r[a->rx], a->x);
+    gen_sext_half(op2, cpu_r[a->ry], a->y);
+    tcg_gen_add_i32(res, op1, op2);
+    gen_add_cc(ctx, res, op1, op2);
+    tcg_gen_mov_i32(cpu_r[a->rd], res);
 
     ctx->base.pc_next += 4;
     return true;
@@ -391,8 +956,7 @@ static bool trans_ADDHHW(DisasContext *ctx, arg_ADDHHW *a){
 static bool trans_AND_f1(DisasContext *ctx, arg_AND_f1 *a){
 
     tcg_gen_and_i32(cpu_r[a->rd], cpu_r[a->rd], cpu_r[a->rs]);
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], cpu_r[a->rd], 0);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
+    gen_logic_cc(ctx, cpu_r[a->rd]);
     ctx->base.pc_next += 2;
     return true;
 }
@@ -401,8 +965,7 @@ static bool trans_AND_f2(DisasContext *ctx, arg_AND_f2 *a){
     TCGv temp = tcg_temp_new_i32();
     tcg_gen_shli_i32(temp, cpu_r[a->ry], a->sa5);
     tcg_gen_and_i32(cpu_r[a->rd], cpu_r[a->rx], temp);
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], cpu_r[a->rd], 0);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
+    gen_logic_cc(ctx, cpu_r[a->rd]);
 
     ctx->base.pc_next += 4;
     return true;
@@ -412,8 +975,7 @@ static bool trans_AND_f3(DisasContext *ctx, arg_AND_f3 *a){
     TCGv temp = tcg_temp_new_i32();
     tcg_gen_shri_i32(temp, cpu_r[a->ry], a->sa5);
     tcg_gen_and_i32(cpu_r[a->rd], cpu_r[a->rx], temp);
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], cpu_r[a->rd], 0);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
+    gen_logic_cc(ctx, cpu_r[a->rd]);
 
     ctx->base.pc_next += 4;
     return true;
@@ -421,13 +983,12 @@ static bool trans_AND_f3(DisasContext *ctx, arg_AND_f3 *a){
 
 //TODO: add tests
 static bool trans_AND_cond(DisasContext *ctx, arg_AND_cond *a){
-    TCGv conVal = tcg_temp_new_i32();
-    int val = checkCondition(a->cond, conVal, cpu_r, cpu_sflags);
-    TCGLabel *noAction = gen_new_label();
-    tcg_gen_brcondi_i32(TCG_COND_NE, conVal, val, noAction);
-    tcg_gen_and_i32(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry]);
+    DisasCompare c;
+    TCGv res = tcg_temp_new_i32();
 
-    gen_set_label(noAction);
+    gen_prepare_cond(ctx, a->cond, &c);
+    tcg_gen_and_i32(res, cpu_r[a->rx], cpu_r[a->ry]);
+    gen_movcond_rd(ctx, &c, a->rd, res, 4);
 
     ctx->base.pc_next += 4;
     return true;
@@ -445,8 +1006,7 @@ static bool trans_ANDH(DisasContext *ctx, arg_ANDH *a){
     if(a->coh){
         tcg_gen_andi_i32(rd, rd, 0xFFFF0000);
     }
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], rd, 0);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], rd, 31);
+    gen_logic_cc(ctx, rd);
 
     ctx->base.pc_next += 4;
     return true;
@@ -464,8 +1024,7 @@ static bool trans_ANDL(DisasContext *ctx, arg_ANDL *a){
         tcg_gen_andi_i32(rd, rd, 0x0000FFFF);
     }
 
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], rd, 0);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], rd, 31);
+    gen_logic_cc(ctx, rd);
 
 
     ctx->base.pc_next += 4;
@@ -480,6 +1039,7 @@ static bool trans_ANDN(DisasContext *ctx, arg_ANDN *a){
 }
 
 static bool trans_ASR_f1(DisasContext *ctx, arg_ASR_f1 *a){
+    gen_flush_flags(ctx);
     TCGv shift = tcg_temp_new_i32();
     TCGv res = tcg_temp_new_i32();
     TCGv op = tcg_temp_new_i32();
@@ -510,6 +1070,7 @@ static bool trans_ASR_f1(DisasContext *ctx, arg_ASR_f1 *a){
 }
 
 static bool trans_ASR_f2(DisasContext *ctx, arg_ASR_f2 *a){
+    gen_flush_flags(ctx);
     int sa = a->bp4 << 1;
     sa += a->bp1;
     TCGv shift = tcg_temp_new_i32();
@@ -537,6 +1098,7 @@ static bool trans_ASR_f2(DisasContext *ctx, arg_ASR_f2 *a){
 }
 
 static bool trans_ASR_f3(DisasContext *ctx, arg_ASR_f3 *a){
+    gen_flush_flags(ctx);
     TCGv res = tcg_temp_new_i32();
     TCGv op = tcg_temp_new_i32();
     tcg_gen_mov_i32(op, cpu_r[a->rs]);
@@ -559,6 +1121,7 @@ static bool trans_ASR_f3(DisasContext *ctx, arg_ASR_f3 *a){
 }
 
 static bool trans_BFEXTS(DisasContext *ctx, arg_BFEXTS *a){
+    gen_flush_flags(ctx);
     TCGv rd = tcg_temp_new_i32();
     TCGv rs = tcg_temp_new_i32();
     TCGv temp = tcg_temp_new_i32();
@@ -592,6 +1155,7 @@ static bool trans_BFEXTS(DisasContext *ctx, arg_BFEXTS *a){
 }
 
 static bool trans_BFEXTU(DisasContext *ctx, arg_BFEXTU *a){
+    gen_flush_flags(ctx);
 
     TCGv rd =tcg_temp_new_i32();
     TCGv rs = tcg_temp_new_i32();
@@ -617,6 +1181,7 @@ static bool trans_BFEXTU(DisasContext *ctx, arg_BFEXTU *a){
 }
 
 static bool trans_BFINS(DisasContext *ctx, arg_BFINS *a){
+    gen_flush_flags(ctx);
     TCGv temp = tcg_temp_new_i32();
     TCGv mask = tcg_temp_new_i32();
     TCGv revMask = tcg_temp_new_i32();
@@ -649,6 +1214,7 @@ static bool trans_BFINS(DisasContext *ctx, arg_BFINS *a){
 }
 
 static bool trans_BLD(DisasContext *ctx, arg_BLD *a){
+    gen_flush_flags(ctx);
     TCGv bit = tcg_temp_new_i32();
     tcg_gen_shri_i32(bit, cpu_r[a->rd], a->bp5);
     tcg_gen_andi_i32(bit, bit, 0x00000001);
@@ -667,10 +1233,7 @@ static bool trans_BR_f1(DisasContext *ctx, arg_BR_f1 *a){
     disp = disp << 1;
 
     TCGLabel *no_branch = gen_new_label();
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->rd, reg, cpu_r, cpu_sflags);
-
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, no_branch);
+    gen_brcond_false(ctx, a->rd, no_branch);
     gen_goto_tb(ctx, 0, ctx->base.pc_next+disp);
 
     gen_set_label(no_branch);
@@ -692,10 +1255,7 @@ static bool trans_BR_f2(DisasContext *ctx, arg_BR_f2 *a){
 
     TCGLabel *no_branch = gen_new_label();
 
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond, reg, cpu_r, cpu_sflags);
-
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, no_branch);
+    gen_brcond_false(ctx, a->cond, no_branch);
     gen_goto_tb(ctx, 0, ctx->base.pc_next+disp);
 
     gen_set_label(no_branch);
@@ -715,6 +1275,7 @@ static bool trans_BREAKPOINT(DisasContext *ctx, arg_BREAKPOINT *a){
 }
 
 static bool trans_BREV_r(DisasContext *ctx, arg_BREV_r *a){
+    gen_flush_flags(ctx);
     TCGv temp = tcg_temp_new_i32();
     TCGv new_val = tcg_temp_new_i32();
     tcg_gen_movi_i32(temp, 0);
@@ -733,6 +1294,7 @@ static bool trans_BREV_r(DisasContext *ctx, arg_BREV_r *a){
 }
 
 static bool trans_BST(DisasContext *ctx, arg_BST *a){
+    gen_flush_flags(ctx);
     TCGv temp = tcg_temp_new_i32();
     tcg_gen_shli_i32(temp, cpu_sflags[sflagC], a->bp5);
     tcg_gen_or_i32(cpu_r[a->rd], cpu_r[a->rd], temp);
@@ -747,6 +1309,7 @@ static bool trans_CACHE(DisasContext *ctx, arg_CACHE *a){
 }
 
 static bool trans_CASTSB(DisasContext *ctx, arg_CASTSB *a){
+    gen_flush_flags(ctx);
     tcg_gen_ext8s_i32(cpu_r[a->rd], cpu_r[a->rd]);
 
     tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
@@ -757,6 +1320,7 @@ static bool trans_CASTSB(DisasContext *ctx, arg_CASTSB *a){
 }
 
 static bool trans_CASTSH(DisasContext *ctx, arg_CASTSH *a){
+    gen_flush_flags(ctx);
     tcg_gen_ext16s_i32(cpu_r[a->rd], cpu_r[a->rd]);
 
     tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
@@ -768,6 +1332,7 @@ static bool trans_CASTSH(DisasContext *ctx, arg_CASTSH *a){
 }
 
 static bool trans_CASTUB(DisasContext *ctx, arg_CASTUB *a){
+    gen_flush_flags(ctx);
     tcg_gen_andi_i32(cpu_r[a->rd], cpu_r[a->rd], 0x000000FF);
     tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
     tcg_gen_shri_i32(cpu_sflags[sflagC], cpu_r[a->rd], 31);
@@ -777,6 +1342,7 @@ static bool trans_CASTUB(DisasContext *ctx, arg_CASTUB *a){
 }
 
 static bool trans_CASTUH(DisasContext *ctx, arg_CASTUH *a){
+    gen_flush_flags(ctx);
     tcg_gen_andi_i32(cpu_r[a->rd], cpu_r[a->rd], 0x0000FFFF);
     tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
     tcg_gen_shri_i32(cpu_sflags[sflagC], cpu_r[a->rd], 31);
@@ -786,6 +1352,7 @@ static bool trans_CASTUH(DisasContext *ctx, arg_CASTUH *a){
 }
 
 static bool trans_CBR(DisasContext *ctx, arg_CBR *a){
+    gen_flush_flags(ctx);
     int bp = 0;
     bp = a->bp4 << 1;
     bp += a->bp1;
@@ -802,6 +1369,7 @@ static bool trans_CBR(DisasContext *ctx, arg_CBR *a){
 }
 
 static bool trans_CLZ(DisasContext *ctx, arg_CLZ *a){
+    gen_flush_flags(ctx);
     TCGLabel *head = gen_new_label();
     TCGLabel *end = gen_new_label();
     TCGLabel *ifT = gen_new_label();
@@ -836,6 +1404,7 @@ static bool trans_CLZ(DisasContext *ctx, arg_CLZ *a){
 }
 
 static bool trans_COM(DisasContext *ctx, arg_COM *a){
+    gen_flush_flags(ctx);
     tcg_gen_not_i32(cpu_r[a->rd], cpu_r[a->rd]);
     tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], cpu_r[a->rd], 0);
     ctx->base.pc_next += 2;
@@ -843,12 +1412,28 @@ static bool trans_COM(DisasContext *ctx, arg_COM *a){
 }
 
 static bool trans_COP(DisasContext *ctx, arg_COP *a){
-    //This instruction is processor specific!
-    ctx->base.pc_next += 4;
-    return true;
+    int op = (a->oph << 5) | (a->opm << 1) | a->opl;
+    bool ok;
+
+    //Other coprocessors are processor specific, ignore them
+    if (a->cp != AVR32_FPU_CP) {
+        ctx->base.pc_next += 4;
+        return true;
+    }
+
+    if (op & 1) {
+        ok = gen_fpu_op_d(ctx, op >> 1, a->crd, a->crx, a->cry);
+    } else {
+        ok = gen_fpu_op_s(ctx, op >> 1, a->crd, a->crx, a->cry);
+    }
+    if (ok) {
+        ctx->base.pc_next += 4;
+    }
+    return ok;
 }
 
 static bool trans_CPB(DisasContext *ctx, arg_CPB *a){
+    gen_flush_flags(ctx);
     TCGv res = tcg_temp_new_i32();
     TCGv rd = tcg_temp_new_i32();
     TCGv rs = tcg_temp_new_i32();
@@ -881,6 +1466,7 @@ static bool trans_CPB(DisasContext *ctx, arg_CPB *a){
 }
 
 static bool trans_CPH(DisasContext *ctx, arg_CPH *a){
+    gen_flush_flags(ctx);
     TCGv res = tcg_temp_new_i32();
     TCGv rd = tcg_temp_new_i32();
     TCGv rs = tcg_temp_new_i32();
@@ -914,32 +1500,25 @@ static bool trans_CPH(DisasContext *ctx, arg_CPH *a){
 }
 
 static bool trans_CPW_f1(DisasContext *ctx, arg_CPW_f1 *a){
-    TCGv Rd = tcg_temp_new_i32();
-    TCGv Rs = tcg_temp_new_i32();
-
-    tcg_gen_mov_i32(Rd, cpu_r[a->rd]);
-    tcg_gen_mov_i32(Rs, cpu_r[a->rs]);
+    TCGv res = tcg_temp_new_i32();
 
-    cpw_instruction(Rd, Rs, cpu_sflags);
+    tcg_gen_sub_i32(res, cpu_r[a->rd], cpu_r[a->rs]);
+    gen_sub_cc(ctx, res, cpu_r[a->rd], cpu_r[a->rs]);
 
     ctx->base.pc_next += 2;
     return true;
 }
 
 static bool trans_CPW_f2(DisasContext *ctx, arg_CPW_f2 *a){
-    TCGv Rdt = cpu_r[a->rd];
-
-    TCGv Rd = tcg_temp_new_i32();
-    TCGv Rs = tcg_temp_new_i32();
+    TCGv res = tcg_temp_new_i32();
 
-    tcg_gen_mov_i32(Rd, Rdt);
     int imm = a->imm6;
     if(a->imm6 >> 5 == 1){
         imm |= 0xFFFFFFC0;
     }
-    tcg_gen_movi_i32(Rs, imm);
 
-    cpw_instruction(Rd, Rs, cpu_sflags);
+    tcg_gen_subi_i32(res, cpu_r[a->rd], imm);
+    gen_sub_cc(ctx, res, cpu_r[a->rd], tcg_constant_i32(imm));
 
     ctx->base.pc_next += 2;
     return true;
@@ -955,15 +1534,9 @@ static bool trans_CPW_f3(DisasContext *ctx, arg_CPW_f3 *a){
         mmI |= 0xFFE00000;
     }
 
-    TCGv Rdt = cpu_r[a->rd];
-
-    TCGv Rd = tcg_temp_new_i32();
-    TCGv Rs = tcg_temp_new_i32();
-
-    tcg_gen_mov_i32(Rd, Rdt);
-    tcg_gen_movi_i32(Rs, mmI);
-
-    cpw_instruction(Rd, Rs, cpu_sflags);
+    TCGv res = tcg_temp_new_i32();
+    tcg_gen_subi_i32(res, cpu_r[a->rd], mmI);
+    gen_sub_cc(ctx, res, cpu_r[a->rd], tcg_constant_i32(mmI));
 
     ctx->base.pc_next += 4;
     return true;
@@ -971,6 +1544,7 @@ static bool trans_CPW_f3(DisasContext *ctx, arg_CPW_f3 *a){
 
 //TODO: add more tests
 static bool trans_CPC_f1(DisasContext *ctx, arg_CPC_f1 *a){
+    gen_flush_flags(ctx);
     TCGv res = tcg_temp_new_i32();
     TCGv rd = tcg_temp_new_i32();
     TCGv rs = tcg_temp_new_i32();
@@ -988,6 +1562,7 @@ static bool trans_CPC_f1(DisasContext *ctx, arg_CPC_f1 *a){
 
 //TODO: add more tests
 static bool trans_CPC_f2(DisasContext *ctx, arg_CPC_f2 *a){
+    gen_flush_flags(ctx);
     TCGv res = tcg_temp_new_i32();
     TCGv rd = tcg_temp_new_i32();
     TCGv rs = tcg_temp_new_i32();
@@ -1003,15 +1578,31 @@ static bool trans_CPC_f2(DisasContext *ctx, arg_CPC_f2 *a){
 }
 
 static bool trans_CSRF(DisasContext *ctx, arg_CSRF *a){
-    tcg_gen_movi_i32(cpu_sflags[a->bp5], 0);
     ctx->base.pc_next += 2;
+    if(a->bp5 < AVR32_SR_SPLIT_FLAGS){
+        gen_flush_flags(ctx);
+        tcg_gen_movi_i32(cpu_sflags[a->bp5], 0);
+    }
+    else{
+        tcg_gen_andi_i32(cpu_sr, cpu_sr, ~(1u << a->bp5));
+        gen_exit_after_insn(ctx);
+    }
     return true;
 }
 
 //TODO: add tests
 static bool trans_CSRFCZ(DisasContext *ctx, arg_CSRFCZ *a){
-    tcg_gen_mov_i32(cpu_sflags[sflagC], cpu_sflags[a->bp5]);
-    tcg_gen_mov_i32(cpu_sflags[sflagZ], cpu_sflags[a->bp5]);
+    TCGv bit = tcg_temp_new_i32();
+
+    gen_flush_flags(ctx);
+    if(a->bp5 < AVR32_SR_SPLIT_FLAGS){
+        tcg_gen_mov_i32(bit, cpu_sflags[a->bp5]);
+    }
+    else{
+        tcg_gen_extract_i32(bit, cpu_sr, a->bp5, 1);
+    }
+    tcg_gen_mov_i32(cpu_sflags[sflagC], bit);
+    tcg_gen_mov_i32(cpu_sflags[sflagZ], bit);
 
     ctx->base.pc_next += 2;
     return true;
@@ -1047,8 +1638,7 @@ static bool trans_DIVU(DisasContext *ctx, arg_DIVU *a){
 
 static bool trans_EOR_f1(DisasContext *ctx, arg_EOR_f1 *a){
     tcg_gen_xor_i32(cpu_r[a->rd], cpu_r[a->rd], cpu_r[a->rs]);
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], cpu_r[a->rd], 0);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
+    gen_logic_cc(ctx, cpu_r[a->rd]);
 
     ctx->base.pc_next += 2;
     return true;
@@ -1059,8 +1649,7 @@ static bool trans_EOR_f2(DisasContext *ctx, arg_EOR_f2 *a){
     tcg_gen_shli_i32(temp, cpu_r[a->ry], a->sa5);
     tcg_gen_xor_i32(cpu_r[a->rd], cpu_r[a->rx], temp);
 
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], cpu_r[a->rd], 0);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
+    gen_logic_cc(ctx, cpu_r[a->rd]);
 
     ctx->base.pc_next += 4;
     return true;
@@ -1071,8 +1660,7 @@ static bool trans_EOR_f3(DisasContext *ctx, arg_EOR_f3 *a){
     tcg_gen_shri_i32(temp, cpu_r[a->ry], a->sa5);
     tcg_gen_xor_i32(cpu_r[a->rd], cpu_r[a->rx], temp);
 
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], cpu_r[a->rd], 0);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
+    gen_logic_cc(ctx, cpu_r[a->rd]);
 
     ctx->base.pc_next += 4;
     return true;
@@ -1080,14 +1668,13 @@ static bool trans_EOR_f3(DisasContext *ctx, arg_EOR_f3 *a){
 
 //TODO: add tests
 static bool trans_EOR_cond(DisasContext *ctx, arg_EOR_cond *a){
-    TCGv reg = tcg_temp_new_i32();
-    TCGLabel *exit = gen_new_label();
-    int val = checkCondition(a->cond, reg, cpu_r, cpu_sflags);
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, exit);
+    DisasCompare c;
+    TCGv res = tcg_temp_new_i32();
 
-    tcg_gen_xor_i32(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry]);
+    gen_prepare_cond(ctx, a->cond, &c);
+    tcg_gen_xor_i32(res, cpu_r[a->rx], cpu_r[a->ry]);
+    gen_movcond_rd(ctx, &c, a->rd, res, 4);
 
-    gen_set_label(exit);
     ctx->base.pc_next += 4;
     return true;
 }
@@ -1098,8 +1685,7 @@ static bool trans_EORH(DisasContext *ctx, arg_EORH *a){
 
     tcg_gen_shli_i32(imm, imm, 0x10);
     tcg_gen_xor_i32(cpu_r[a->rd], cpu_r[a->rd], imm);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], cpu_r[a->rd], 0);
+    gen_logic_cc(ctx, cpu_r[a->rd]);
 
 
     ctx->base.pc_next += 4;
@@ -1111,8 +1697,7 @@ static bool trans_EORL(DisasContext *ctx, arg_EORH *a){
     tcg_gen_movi_i32(imm, a->imm16);
 
     tcg_gen_xor_i32(cpu_r[a->rd], cpu_r[a->rd], imm);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], cpu_r[a->rd], 0);
+    gen_logic_cc(ctx, cpu_r[a->rd]);
     ctx->base.pc_next += 4;
     return true;
 }
@@ -1124,8 +1709,10 @@ static bool trans_FRS(DisasContext *ctx, arg_FRS *a){
 }
 
 static bool trans_ICALL(DisasContext *ctx, arg_ICALL *a){
-    tcg_gen_addi_i32(cpu_r[LR_REG], cpu_r[PC_REG], 2);
-    tcg_gen_mov_i32(cpu_r[PC_REG], cpu_r[a->rd]);
+    TCGv dest = tcg_temp_new_i32();
+    tcg_gen_mov_i32(dest, cpu_r[a->rd]);
+    tcg_gen_movi_i32(cpu_r[LR_REG], ctx->base.pc_next + 2);
+    tcg_gen_mov_i32(cpu_r[PC_REG], dest);
 
     ctx->base.is_jmp = DISAS_JUMP;
     ctx->base.pc_next += 2;
@@ -1137,9 +1724,9 @@ static bool trans_LDD_f1(DisasContext *ctx, arg_LDD_f1 *a){
     TCGv rd = cpu_r[a->rd*2];
     TCGv rdp = cpu_r[a->rd*2+1];
 
-    tcg_gen_qemu_ld_i32(rdp, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(rdp, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(ptr, ptr, 4);
-    tcg_gen_qemu_ld_i32(rd, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(rd, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(ptr, ptr, 4);
 
     ctx->base.pc_next += 2;
@@ -1154,10 +1741,10 @@ static bool trans_LDD_f2(DisasContext *ctx, arg_LDD_f2 *a){
     TCGv rdp = cpu_r[a->rd*2+1];
 
     tcg_gen_subi_i32(ptr, ptr, 8);
-    tcg_gen_qemu_ld_i32(rdp, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(rdp, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(ptr, ptr, 4);
 
-    tcg_gen_qemu_ld_i32(rd, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(rd, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_subi_i32(ptr, ptr, 4);
 
     tcg_gen_mov_i32(cpu_r[a->rp], ptr);
@@ -1173,9 +1760,9 @@ static bool trans_LDD_f3(DisasContext *ctx, arg_LDD_f3 *a){
     TCGv rd = cpu_r[a->rd*2];
     TCGv rdp = cpu_r[a->rd*2+1];
 
-    tcg_gen_qemu_ld_i32(rdp, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(rdp, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(ptr, ptr, 4);
-    tcg_gen_qemu_ld_i32(rd, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(rd, ptr, ctx->mem_idx, MO_BEUL);
 
     ctx->base.pc_next += 2;
 
@@ -1197,9 +1784,9 @@ static bool trans_LDD_f4(DisasContext *ctx, arg_LDD_f4 *a){
     TCGv rd = cpu_r[a->rs*2];
     TCGv rdp = cpu_r[a->rs*2+1];
 
-    tcg_gen_qemu_ld_i32(rdp, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(rdp, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(ptr, ptr, 4);
-    tcg_gen_qemu_ld_i32(rd, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(rd, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(ptr, ptr, 4);
 
     ctx->base.pc_next += 4;
@@ -1216,9 +1803,9 @@ static bool trans_LDD_f5(DisasContext *ctx, arg_LDD_f5 *a){
     TCGv rd = cpu_r[a->rd];
     TCGv rdp = cpu_r[a->rd+1];
 
-    tcg_gen_qemu_ld_i32(rdp, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(rdp, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(ptr, ptr, 4);
-    tcg_gen_qemu_ld_i32(rd, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(rd, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(ptr, ptr, 4);
 
     ctx->base.pc_next += 4;
@@ -1235,7 +1822,7 @@ static bool trans_LDsb_f1(DisasContext *ctx, arg_LDsb_f1 *a){
     tcg_gen_movi_i32(ptr, dispI);
     tcg_gen_add_i32(ptr, ptr, cpu_r[a->rp]);
 
-    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, 0, MO_SB);
+    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, ctx->mem_idx, MO_SB);
 
     ctx->base.pc_next += 4;
     return true;
@@ -1248,7 +1835,7 @@ static bool trans_LDsb_f2(DisasContext *ctx, arg_LDsb_f2 *a){
     tcg_gen_shli_i32(ptr, ptr, a->sa);
     tcg_gen_add_i32(ptr, ptr, cpu_r[a->rx]);
 
-    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, 0, MO_SB);
+    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, ctx->mem_idx, MO_SB);
 
     ctx->base.pc_next += 4;
     return true;
@@ -1256,15 +1843,13 @@ static bool trans_LDsb_f2(DisasContext *ctx, arg_LDsb_f2 *a){
 
 //TODO: add tests
 static bool trans_LDsb_cond(DisasContext *ctx, arg_LDsb_cond *a){
-    TCGv reg = tcg_temp_new_i32();
     TCGLabel *exit = gen_new_label();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, exit);
+    gen_brcond_false(ctx, a->cond4, exit);
 
     TCGv ptr = tcg_temp_new_i32();
     tcg_gen_addi_i32(ptr, cpu_r[a->rp], a->disp9);
 
-    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, 0, MO_SB);
+    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, ctx->mem_idx, MO_SB);
 
 
     gen_set_label(exit);
@@ -1273,7 +1858,7 @@ static bool trans_LDsb_cond(DisasContext *ctx, arg_LDsb_cond *a){
 }
 
 static bool trans_LDub_f1(DisasContext *ctx, arg_LDub_f1 *a){
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], cpu_r[a->rp], 0x0, MO_UB);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], cpu_r[a->rp], ctx->mem_idx, MO_UB);
     tcg_gen_addi_i32(cpu_r[a->rp], cpu_r[a->rp], 0x1);
 
     ctx->base.pc_next += 2;
@@ -1281,7 +1866,7 @@ static bool trans_LDub_f1(DisasContext *ctx, arg_LDub_f1 *a){
 }
 
 static bool trans_LDub_f2(DisasContext *ctx, arg_LDub_f2 *a){
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], cpu_r[a->rp], 0x0, MO_UB);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], cpu_r[a->rp], ctx->mem_idx, MO_UB);
     tcg_gen_subi_i32(cpu_r[a->rp], cpu_r[a->rp], 0x1);
 
     ctx->base.pc_next += 2;
@@ -1293,7 +1878,7 @@ static bool trans_LDub_f3(DisasContext *ctx, arg_LDub_f3 *a){
     TCGv ptr = tcg_temp_new_i32();
     tcg_gen_addi_i32(ptr, cpu_r[a->rp], a->disp3);
 
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], ptr, 0x0, MO_UB);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], ptr, ctx->mem_idx, MO_UB);
 
     ctx->base.pc_next += 2;
     return true;
@@ -1308,7 +1893,7 @@ static bool trans_LDUB_f4(DisasContext *ctx, arg_LDUB_f4 *a){
     tcg_gen_movi_i32(ptr, disp);
     tcg_gen_add_i32(ptr, ptr, cpu_r[a->rp]);
 
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], ptr, 0x0, MO_UB);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], ptr, ctx->mem_idx, MO_UB);
 
     ctx->base.pc_next += 4;
     return true;
@@ -1320,7 +1905,7 @@ static bool trans_LDub_f5(DisasContext *ctx, arg_LDub_f5 *a){
     tcg_gen_shli_i32(ptr, cpu_r[a->ry], a->sa);
     tcg_gen_add_i32(ptr, ptr, cpu_r[a->rx]);
 
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], ptr, 0x0, MO_UB);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], ptr, ctx->mem_idx, MO_UB);
 
     ctx->base.pc_next += 4;
     return true;
@@ -1331,16 +1916,13 @@ static bool trans_LDUB_cond(DisasContext *ctx, arg_LDUB_cond *a){
 
     TCGLabel *exit = gen_new_label();
 
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
-
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, exit);
+    gen_brcond_false(ctx, a->cond4, exit);
 
     TCGv ptr = tcg_temp_new_i32();
     tcg_gen_mov_i32(ptr, cpu_r[a->rp]);
     tcg_gen_addi_i32(ptr, ptr, a->disp9);
 
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], ptr, 0x0, MO_UB);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], ptr, ctx->mem_idx, MO_UB);
 
     gen_set_label(exit);
     ctx->base.pc_next += 4;
@@ -1349,7 +1931,7 @@ static bool trans_LDUB_cond(DisasContext *ctx, arg_LDUB_cond *a){
 
 //TODO: add tests
 static bool trans_LDSH_f1(DisasContext *ctx, arg_LDSH_f1 *a){
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], cpu_r[a->rp], 0x0, MO_BESW);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], cpu_r[a->rp], ctx->mem_idx, MO_BESW);
     tcg_gen_addi_i32(cpu_r[a->rp], cpu_r[a->rp], 0x2);
 
     ctx->base.pc_next += 2;
@@ -1359,7 +1941,7 @@ static bool trans_LDSH_f1(DisasContext *ctx, arg_LDSH_f1 *a){
 //TODO: add tests
 static bool trans_LDSH_f2(DisasContext *ctx, arg_LDSH_f2 *a){
     tcg_gen_subi_i32(cpu_r[a->rp], cpu_r[a->rp], 0x2);
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], cpu_r[a->rp], 0x0, MO_BESW);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], cpu_r[a->rp], ctx->mem_idx, MO_BESW);
     ctx->base.pc_next += 2;
     return true;
 }
@@ -1368,7 +1950,7 @@ static bool trans_LDSH_f3(DisasContext *ctx, arg_LDSH_f3 *a){
     TCGv addr = tcg_temp_new_i32();
     tcg_gen_movi_i32(addr, a->disp3 << 1);
     tcg_gen_add_i32(addr, addr, cpu_r[a->rp]);
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, 0x0, MO_BESW);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, ctx->mem_idx, MO_BESW);
 
     ctx->base.pc_next += 2;
     return true;
@@ -1382,7 +1964,7 @@ static bool trans_LDSH_f4(DisasContext *ctx, arg_LDSH_f4 *a){
     }
 
     tcg_gen_addi_i32(addr, cpu_r[a->rp], disp);
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, 0x0, MO_BESW);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, ctx->mem_idx, MO_BESW);
 
     ctx->base.pc_next += 4;
     return true;
@@ -1393,7 +1975,7 @@ static bool trans_LDSH_f5(DisasContext *ctx, arg_LDSH_f5 *a){
 
     tcg_gen_shli_i32(addr, cpu_r[a->ry], a->sa);
     tcg_gen_add_i32(addr, addr, cpu_r[a->rx]);
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, 0x0, MO_BESW);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, ctx->mem_idx, MO_BESW);
 
     ctx->base.pc_next += 4;
     return true;
@@ -1402,16 +1984,13 @@ static bool trans_LDSH_f5(DisasContext *ctx, arg_LDSH_f5 *a){
 static bool trans_LDSH_cond(DisasContext *ctx, arg_LDSH_cond *a){
     TCGLabel *no_load = gen_new_label();
 
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
-
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, no_load);
+    gen_brcond_false(ctx, a->cond4, no_load);
 
     TCGv addr = tcg_temp_new_i32();
     tcg_gen_movi_i32(addr, a->disp9);
     tcg_gen_shli_i32(addr, addr, 1);
     tcg_gen_add_i32(addr, addr, cpu_r[a->rp]);
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, 0x0, MO_BESW);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, ctx->mem_idx, MO_BESW);
 
     gen_set_label(no_load);
 
@@ -1420,7 +1999,7 @@ static bool trans_LDSH_cond(DisasContext *ctx, arg_LDSH_cond *a){
 }
 
 static bool trans_LDUH_f1(DisasContext *ctx, arg_LDUH_f1 *a){
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], cpu_r[a->rp], 0x0, MO_BEUW);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], cpu_r[a->rp], ctx->mem_idx, MO_BEUW);
     tcg_gen_addi_i32(cpu_r[a->rp], cpu_r[a->rp], 2);
 
     ctx->base.pc_next += 2;
@@ -1430,7 +2009,7 @@ static bool trans_LDUH_f1(DisasContext *ctx, arg_LDUH_f1 *a){
 //TODO: add tests
 static bool trans_LDUH_f2(DisasContext *ctx, arg_LDUH_f2 *a){
     tcg_gen_subi_i32(cpu_r[a->rp], cpu_r[a->rp], 2);
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], cpu_r[a->rp], 0x0, MO_BEUW);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], cpu_r[a->rp], ctx->mem_idx, MO_BEUW);
 
     ctx->base.pc_next += 2;
     return true;
@@ -1439,7 +2018,7 @@ static bool trans_LDUH_f2(DisasContext *ctx, arg_LDUH_f2 *a){
 static bool trans_LDUH_f3(DisasContext *ctx, arg_LDUH_f3 *a){
     TCGv addr = tcg_temp_new_i32();
     tcg_gen_addi_i32(addr, cpu_r[a->rp], a->disp3<<1);
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, 0x0, MO_BEUW);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, ctx->mem_idx, MO_BEUW);
 
     ctx->base.pc_next += 2;
     return true;
@@ -1453,7 +2032,7 @@ static bool trans_LDUH_f4(DisasContext *ctx, arg_LDUH_f4 *a){
 
     TCGv addr = tcg_temp_new_i32();
     tcg_gen_addi_i32(addr, cpu_r[a->rp], disp);
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, 0x0, MO_BEUW);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, ctx->mem_idx, MO_BEUW);
 
     ctx->base.pc_next += 4;
     return true;
@@ -1466,7 +2045,7 @@ static bool trans_LDUH_f5(DisasContext *ctx, arg_LDUH_f5 *a){
     tcg_gen_shli_i32(ptr, ptr, a->sa);
     tcg_gen_add_i32(ptr, ptr, cpu_r[a->rx]);
 
-    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, 0, MO_BEUW);
+    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, ctx->mem_idx, MO_BEUW);
 
     ctx->base.pc_next += 4;
     return true;
@@ -1475,16 +2054,13 @@ static bool trans_LDUH_f5(DisasContext *ctx, arg_LDUH_f5 *a){
 static bool trans_LDUH_cond(DisasContext *ctx, arg_LDUH_cond *a){
     TCGLabel *no_load = gen_new_label();
 
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
-
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, no_load);
+    gen_brcond_false(ctx, a->cond4, no_load);
 
     TCGv addr = tcg_temp_new_i32();
     tcg_gen_movi_i32(addr, a->disp9);
     tcg_gen_shli_i32(addr, addr, 1);
     tcg_gen_add_i32(addr, addr, cpu_r[a->rp]);
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, 0x0, MO_BEUW);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, ctx->mem_idx, MO_BEUW);
 
     gen_set_label(no_load);
 
@@ -1494,7 +2070,7 @@ static bool trans_LDUH_cond(DisasContext *ctx, arg_LDUH_cond *a){
 
 
 static bool trans_LDW_f1(DisasContext *ctx, arg_LDW_f1 *a){
-    tcg_gen_qemu_ld_i32(cpu_r[a->rd], cpu_r[a->rp], 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(cpu_r[a->rd], cpu_r[a->rp], ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(cpu_r[a->rp], cpu_r[a->rp], 0x4);
 
     if(a->rd == PC_REG){
@@ -1508,7 +2084,7 @@ static bool trans_LDW_f1(DisasContext *ctx, arg_LDW_f1 *a){
 //TODO: add tests
 static bool trans_LDW_f2(DisasContext *ctx, arg_LDW_f2 *a){
     tcg_gen_subi_i32(cpu_r[a->rp], cpu_r[a->rp], 0x4);
-    tcg_gen_qemu_ld_i32(cpu_r[a->rd], cpu_r[a->rp], 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(cpu_r[a->rd], cpu_r[a->rp], ctx->mem_idx, MO_BEUL);
 
     if(a->rd == PC_REG){
         ctx->base.is_jmp = DISAS_JUMP;
@@ -1523,7 +2099,7 @@ static bool trans_LDW_f3(DisasContext *ctx, arg_LDW_f3 *a){
 
     TCGv ptr = tcg_temp_new_i32();
     tcg_gen_addi_i32(ptr, cpu_r[a->rp], dispI);
-    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, ctx->mem_idx, MO_BEUL);
 
     if(a->rd == PC_REG){
         ctx->base.is_jmp = DISAS_JUMP;
@@ -1543,7 +2119,7 @@ static bool trans_LDW_f4(DisasContext *ctx, arg_LDW_f4 *a){
     TCGv ptr = tcg_temp_new_i32();
     tcg_gen_addi_i32(ptr, cpu_r[a->rp], disp);
 
-    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, ctx->mem_idx, MO_BEUL);
 
     if(a->rd == PC_REG){
         ctx->base.is_jmp = DISAS_JUMP;
@@ -1558,7 +2134,7 @@ static bool trans_LDW_f5(DisasContext *ctx, arg_LDW_f5 *a){
     tcg_gen_shli_i32(ptr, cpu_r[a->ry], a->sa);
     tcg_gen_add_i32(ptr, ptr, cpu_r[a->rx]);
 
-    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, ctx->mem_idx, MO_BEUL);
 
     if(a->rd == PC_REG){
         ctx->base.is_jmp = DISAS_JUMP;
@@ -1598,7 +2174,7 @@ static bool trans_LDW_f6(DisasContext *ctx, arg_LDW_f6 *a){
     tcg_gen_shli_i32(temp, temp, 2);
     tcg_gen_add_i32(ptr, ptr, temp);
 
-    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, ctx->mem_idx, MO_BEUL);
 
     if(a->rd == PC_REG){
         ctx->base.is_jmp = DISAS_JUMP;
@@ -1611,15 +2187,15 @@ static bool trans_LDW_f6(DisasContext *ctx, arg_LDW_f6 *a){
 static bool trans_LDW_cond(DisasContext *ctx, arg_LDW_cond *a){
     int disp = a->disp9 << 2;
     TCGLabel *no_ld = gen_new_label();
-
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
-
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, no_ld);
     TCGv ptr = tcg_temp_new_i32();
-    tcg_gen_movi_i32(ptr, disp);
-    tcg_gen_add_i32(ptr, ptr, cpu_r[a->rp]);
-    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, 0x0, MO_BEUL);
+
+    tcg_gen_addi_i32(ptr, cpu_r[a->rp], disp);
+    if(a->rd == PC_REG){
+        // Fall through to the next insn if the load is not taken
+        tcg_gen_movi_i32(cpu_r[PC_REG], ctx->base.pc_next + 4);
+    }
+    gen_brcond_false(ctx, a->cond4, no_ld);
+    tcg_gen_qemu_ld_i32(cpu_r[a->rd], ptr, ctx->mem_idx, MO_BEUL);
     gen_set_label(no_ld);
     if(a->rd == PC_REG){
         ctx->base.is_jmp = DISAS_JUMP;
@@ -1630,15 +2206,44 @@ static bool trans_LDW_cond(DisasContext *ctx, arg_LDW_cond *a){
 
 // LDC, processor depending instruction
 
+// Coprocessor loads, only the FPU registers exist
+static bool trans_LDC_D(DisasContext *ctx, arg_LDC_D *a){
+    TCGv ptr = tcg_temp_new_i32();
+    TCGv_i64 t = tcg_temp_new_i64();
+
+    if (a->cp != AVR32_FPU_CP) {
+        return false;
+    }
+    tcg_gen_addi_i32(ptr, cpu_r[a->rp], a->disp << 2);
+    tcg_gen_qemu_ld_i64(t, ptr, ctx->mem_idx, MO_BEUQ);
+    gen_st_fpr_d(a->cr3 * 2, t);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_LDC_W(DisasContext *ctx, arg_LDC_W *a){
+    TCGv ptr = tcg_temp_new_i32();
+    TCGv t = tcg_temp_new_i32();
+
+    if (a->cp != AVR32_FPU_CP) {
+        return false;
+    }
+    tcg_gen_addi_i32(ptr, cpu_r[a->rp], a->disp << 2);
+    tcg_gen_qemu_ld_i32(t, ptr, ctx->mem_idx, MO_BEUL);
+    gen_st_fpr(a->cr, t);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
 static bool trans_LDDPC(DisasContext *ctx, arg_LDDPC *a){
     TCGv addr = tcg_temp_new_i32();
     TCGv Rd = cpu_r[a->rd];
-    TCGv PC = cpu_r[PC_REG];
 
-    tcg_gen_andi_tl(addr, PC, 0xFFFFFFFC);
-    tcg_gen_addi_tl(addr, addr, a->disp << 2);
+    tcg_gen_movi_tl(addr, (ctx->base.pc_next & 0xFFFFFFFC) + (a->disp << 2));
 
-    tcg_gen_qemu_ld_tl(Rd, addr, 0, MO_BEUL);
+    tcg_gen_qemu_ld_tl(Rd, addr, ctx->mem_idx, MO_BEUL);
 
     if(a->rd == PC_REG){
         ctx->base.is_jmp = DISAS_JUMP;
@@ -1651,7 +2256,7 @@ static bool trans_LDDSP(DisasContext *ctx, arg_LDDSP *a){
     TCGv addr = tcg_temp_new_i32();
     tcg_gen_andi_i32(addr, cpu_r[SP_REG], 0xFFFFFFFC);
     tcg_gen_addi_i32(addr, addr, a->disp << 2);
-    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, 0, MO_BEUL);
+    tcg_gen_qemu_ld_tl(cpu_r[a->rd], addr, ctx->mem_idx, MO_BEUL);
 
     ctx->base.pc_next += 2;
     return true;
@@ -1671,7 +2276,7 @@ static bool trans_LDINSB(DisasContext *ctx, arg_LDINSB *a){
     tcg_gen_rotli_i32(mask, mask, a->part * 8);
     tcg_gen_and_i32(cpu_r[a->rd], cpu_r[a->rd], mask);
 
-    tcg_gen_qemu_ld_i32(temp, ptr, 0, MO_UB);
+    tcg_gen_qemu_ld_i32(temp, ptr, ctx->mem_idx, MO_UB);
     tcg_gen_shli_i32(temp, temp, a->part * 8);
     tcg_gen_or_i32(cpu_r[a->rd], cpu_r[a->rd], temp);
     tcg_gen_movi_i32(cpu_r[10], a->part);
@@ -1695,7 +2300,7 @@ static bool trans_LDINSH(DisasContext *ctx, arg_LDINSH *a){
     tcg_gen_rotli_i32(mask, mask, a->part * 16);
     tcg_gen_and_i32(cpu_r[a->rd], cpu_r[a->rd], mask);
 
-    tcg_gen_qemu_ld_i32(temp, ptr, 0, MO_UW);
+    tcg_gen_qemu_ld_i32(temp, ptr, ctx->mem_idx, MO_UW);
     tcg_gen_shli_i32(temp, temp, a->part * 16);
     tcg_gen_or_i32(cpu_r[a->rd], cpu_r[a->rd], temp);
     tcg_gen_movi_i32(cpu_r[10], a->part);
@@ -1706,104 +2311,63 @@ static bool trans_LDINSH(DisasContext *ctx, arg_LDINSH *a){
 
 static bool trans_LDM(DisasContext *ctx, arg_LDM *a){
     int reglist = a->list;
-    TCGv loadaddress = tcg_temp_new_i32();
-    tcg_gen_mov_i32(loadaddress, cpu_r[a->rp]);
-    bool setFlags = false;
-
-    if(((reglist >> 15) &1) == 1){
-        if(a->rp == PC_REG){
-            tcg_gen_mov_i32(loadaddress, cpu_r[SP_REG]);
-        }
-        tcg_gen_qemu_ld_tl(cpu_r[PC_REG], loadaddress, 0, MO_BEUL);
-        tcg_gen_addi_i32(loadaddress, loadaddress, 4);
-
-        ctx->base.is_jmp = DISAS_JUMP;
-        if(a->rp == PC_REG){
-            if(((reglist >> 14) & 1) == 0 && ((reglist >> 12) &1) == 0){
-                tcg_gen_movi_i32(cpu_r[12], 0);
-            }
-            else if((reglist >> 14) == 0 && (reglist >> 12) == 1){
-                tcg_gen_movi_i32(cpu_r[12], 1);
-            }
-            else{
-                tcg_gen_movi_i32(cpu_r[12], -1);
-            }
-            setFlags = true;
-        }
-        else{
-            if(((reglist >> 14) &1) ==1){
-                tcg_gen_qemu_ld_tl(cpu_r[LR_REG], loadaddress, 0, MO_BEUL);
-                tcg_gen_addi_i32(loadaddress, loadaddress, 4);
-            }
-            if(((reglist >> 13) &1) ==1){
-                tcg_gen_qemu_ld_tl(cpu_r[SP_REG], loadaddress, 0, MO_BEUL);
-                tcg_gen_addi_i32(loadaddress, loadaddress, 4);
-
-            }
-            if(((reglist >> 12) &1) ==1){
-                tcg_gen_qemu_ld_tl(cpu_r[12], loadaddress, 0, MO_BEUL);
-                tcg_gen_addi_i32(loadaddress, loadaddress, 4);
-            }
-            setFlags = true;
-        }
+    bool pc = (reglist >> PC_REG) & 1;
+    // ldm pc, {..., pc} pops from SP and returns a value in R12
+    bool ret = pc && a->rp == PC_REG;
+    int rp = a->rp == PC_REG ? SP_REG : a->rp;
+    TCGv base = tcg_temp_new_i32();
+    int regs[16];
+    int n = 0;
+
+    // Rp may be in the list, keep its old value as the base
+    tcg_gen_mov_i32(base, cpu_r[rp]);
+
+    if(ret){
+        tcg_gen_movi_i32(cpu_r[12],
+                         multi_ret_value((reglist >> LR_REG) & 1,
+                                         (reglist >> 12) & 1));
+        reglist &= ~((1 << LR_REG) | (1 << SP_REG) | (1 << 12));
     }
-    else{
-        if(((reglist >> 14) &1) ==1){
-            tcg_gen_qemu_ld_tl(cpu_r[LR_REG], loadaddress, 0, MO_BEUL);
-            tcg_gen_addi_i32(loadaddress, loadaddress, 4);
-        }
-        if(((reglist >> 13) &1) ==1){
-            tcg_gen_qemu_ld_tl(cpu_r[SP_REG], loadaddress, 0, MO_BEUL);
-            tcg_gen_addi_i32(loadaddress, loadaddress, 4);
 
-        }
-        if(((reglist >> 12) &1)==1){
-            tcg_gen_qemu_ld_tl(cpu_r[12], loadaddress, 0, MO_BEUL);
-            tcg_gen_addi_i32(loadaddress, loadaddress, 4);
+    // The highest register is at the lowest address
+    for(int i = 15; i >= 0; i--){
+        if(((reglist >> i) & 1) == 1){
+            regs[n++] = i;
         }
     }
+    gen_ld_multi(ctx, base, regs, n);
 
-    for(int i = 11; i>= 0; i--){
-        if(((reglist >> i) & 1)  == 1){
-            tcg_gen_qemu_ld_tl(cpu_r[i], loadaddress, 0, MO_BEUL);
-            tcg_gen_addi_i32(loadaddress, loadaddress, 4);
-        }
-    }
     if(a->op == 1){
-        if(a->rp == PC_REG){
-            tcg_gen_mov_i32(cpu_r[SP_REG], loadaddress);
-        }
-        else{
-            tcg_gen_mov_i32(cpu_r[a->rp], loadaddress);
-        }
+        tcg_gen_addi_i32(cpu_r[rp], base, 4 * n);
     }
 
-    if(setFlags){
+    if(pc){
+        ctx->base.is_jmp = DISAS_JUMP;
         tcg_gen_movi_i32(cpu_sflags[sflagV], 0);
         tcg_gen_movi_i32(cpu_sflags[sflagC], 0);
-        TCGv res = tcg_temp_new_i32();
-        tcg_gen_mov_i32(res, cpu_r[12]);
-        tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0);
-        tcg_gen_shri_i32(cpu_sflags[sflagN], res, 31);
+        gen_set_logic_cc(ctx, cpu_r[12]);
     }
 
-
     ctx->base.pc_next += 4;
     return true;
 }
 
 //TODO: add tests
 static bool trans_LDMTS(DisasContext *ctx, arg_LDMTS *a){
-    TCGv addr = tcg_temp_new_i32();
-    tcg_gen_mov_i32(addr, cpu_r[a->rp]);
+    TCGv base = tcg_temp_new_i32();
+    int regs[16];
+    int n = 0;
 
+    tcg_gen_mov_i32(base, cpu_r[a->rp]);
     for(int i = 15; i >= 0; i--){
-        if((a->list >> i) == 1){
-            tcg_gen_qemu_ld_tl(cpu_r[i], addr, 0, MO_BEUL);
+        if(((a->list >> i) & 1) == 1){
+            regs[n++] = i;
         }
     }
+    gen_ld_multi(ctx, base, regs, n);
+
     if(a->op){
-        tcg_gen_mov_i32(cpu_r[a->rp], addr);
+        tcg_gen_addi_i32(cpu_r[a->rp], base, 4 * n);
     }
 
     ctx->base.pc_next += 4;
@@ -1825,7 +2389,7 @@ static bool trans_LDSWPSH(DisasContext *ctx, arg_LDSWPSH *a){
     disp = disp << 1;
     tcg_gen_addi_i32(addr, cpu_r[a->rp], disp);
 
-    tcg_gen_qemu_ld_tl(temp, addr, 0, MO_BEUW);
+    tcg_gen_qemu_ld_tl(temp, addr, ctx->mem_idx, MO_BEUW);
     tcg_gen_andi_i32(lower, temp, 0x000000FF);
     tcg_gen_shli_i32(lower, lower, 0x8);
     tcg_gen_shri_i32(upper, temp, 0x8);
@@ -1853,7 +2417,7 @@ static bool trans_LDSWPUH(DisasContext *ctx, arg_LDSWPUH *a){
     disp = disp << 1;
     tcg_gen_addi_i32(addr, cpu_r[a->rp], disp);
 
-    tcg_gen_qemu_ld_tl(temp, addr, 0, MO_BEUW);
+    tcg_gen_qemu_ld_tl(temp, addr, ctx->mem_idx, MO_BEUW);
     tcg_gen_andi_i32(lower, temp, 0x000000FF);
     tcg_gen_shli_i32(lower, lower, 0x8);
     tcg_gen_shri_i32(upper, temp, 0x8);
@@ -1884,7 +2448,7 @@ static bool trans_LDSWPW(DisasContext *ctx, arg_LDSWPW *a){
     disp = disp << 2;
     tcg_gen_addi_i32(addr, cpu_r[a->rp], disp);
 
-    tcg_gen_qemu_ld_tl(temp, addr, 0, MO_BEUL);
+    tcg_gen_qemu_ld_tl(temp, addr, ctx->mem_idx, MO_BEUL);
     tcg_gen_andi_i32(lower, temp, 0x000000FF);
     tcg_gen_andi_i32(upper, temp, 0x0000FF00);
     tcg_gen_andi_i32(high, temp, 0x00FF0000);
@@ -1941,6 +2505,7 @@ static void lslr_set_flags(TCGv shamt, TCGv res, TCGv op, bool isLSR){
 }
 
 static bool trans_LSL_f1(DisasContext *ctx, arg_LSL_f1 *a){
+    gen_flush_flags(ctx);
     TCGv rx = tcg_temp_new_i32();
     tcg_gen_mov_i32(rx, cpu_r[a->rx]);
     TCGv Ry = tcg_temp_new_i32();
@@ -1957,6 +2522,7 @@ static bool trans_LSL_f1(DisasContext *ctx, arg_LSL_f1 *a){
 }
 
 static bool trans_LSL_f2(DisasContext *ctx, arg_LSL_f2 *a){
+    gen_flush_flags(ctx);
     int amount = a->bp4 << 1;
     amount |= a->bp1;
 
@@ -1976,6 +2542,7 @@ static bool trans_LSL_f2(DisasContext *ctx, arg_LSL_f2 *a){
 }
 
 static bool trans_LSL_f3(DisasContext *ctx, arg_LSL_f3 *a){
+    gen_flush_flags(ctx);
     TCGv res = tcg_temp_new_i32();
     TCGv Rs = tcg_temp_new_i32();
     TCGv sa = tcg_temp_new_i32();
@@ -1992,6 +2559,7 @@ static bool trans_LSL_f3(DisasContext *ctx, arg_LSL_f3 *a){
 }
 
 static bool trans_LSR_f1(DisasContext *ctx, arg_LSR_f1 *a){
+    gen_flush_flags(ctx);
     TCGv rx = tcg_temp_new_i32();
     tcg_gen_mov_i32(rx, cpu_r[a->rx]);
     TCGv Ry = tcg_temp_new_i32();
@@ -2010,6 +2578,7 @@ static bool trans_LSR_f1(DisasContext *ctx, arg_LSR_f1 *a){
 }
 
 static bool trans_LSR_f2(DisasContext *ctx, arg_LSR_f2 *a){
+    gen_flush_flags(ctx);
     int amount = a->bp4 << 1;
     amount |= a->bp1;
 
@@ -2029,6 +2598,7 @@ static bool trans_LSR_f2(DisasContext *ctx, arg_LSR_f2 *a){
 }
 
 static bool trans_LSR_f3(DisasContext *ctx, arg_LSR_f3 *a){
+    gen_flush_flags(ctx);
     TCGv res = tcg_temp_new_i32();
     TCGv Rs = tcg_temp_new_i32();
     TCGv sa = tcg_temp_new_i32();
@@ -2054,95 +2624,51 @@ static bool trans_MAC(DisasContext *ctx, arg_MAC *a){
     return true;
 }
 
+// (Rd+1:Rd)[63:16] += product, Rd[15:0] = 0
 static bool trans_MACHHD(DisasContext *ctx, arg_MACHHD *a){
-    TCGv_i64 operand1 = tcg_temp_new_i64();
-    TCGv_i64 operand2 = tcg_temp_new_i64();
-    TCGv_i64 rdp = tcg_temp_new_i64();
-    TCGv_i64 rd = tcg_temp_new_i64();
-    TCGv_i64 rx = tcg_temp_new_i64();
-    TCGv_i64 ry = tcg_temp_new_i64();
-    TCGv_i64 res = tcg_temp_new_i64();
-    TCGv_i64 dwr = tcg_temp_new_i64();
-    tcg_gen_extu_i32_i64(rdp, cpu_r[a->rd+1]);
-    tcg_gen_extu_i32_i64(rd, cpu_r[a->rd]);
-    tcg_gen_extu_i32_i64(rx, cpu_r[a->rx]);
-    tcg_gen_extu_i32_i64(ry, cpu_r[a->ry]);
-
-    if(a->x == 1){
-        tcg_gen_shri_i64(operand1, rx, 16);
-        tcg_gen_ext16s_i64(operand1, operand1);
-    }
-    else{
-        tcg_gen_andi_i64(operand1, rx, 0x0000FFFF);
-        tcg_gen_ext16s_i64(operand1, operand1);
-    }
-    if(a->y == 1){
-        tcg_gen_shri_i64(operand2, ry, 16);
-        tcg_gen_ext16s_i64(operand2, operand2);
-    }
-    else{
-        tcg_gen_andi_i64(operand2, ry, 0x0000FFFF);
-        tcg_gen_ext16s_i64(operand2, operand2);
-    }
+    TCGv prod = tcg_temp_new_i32();
+    TCGv op2 = tcg_temp_new_i32();
+    TCGv_i64 prod64 = tcg_temp_new_i64();
+    TCGv_i64 acc = tcg_temp_new_i64();
 
-    tcg_gen_mul_i64(res, operand1, operand2);
+    gen_sext_half(prod, cpu_r[a->rx], a->x);
+    gen_sext_half(op2, cpu_r[a->ry], a->y);
+    tcg_gen_mul_i32(prod, prod, op2);
 
-    tcg_gen_mov_i64(dwr, rdp);
-    tcg_gen_shli_i64(dwr, dwr, 32);
-    tcg_gen_or_i64(dwr, dwr, rd);
-    tcg_gen_shri_i64(dwr, dwr, 16);
-    tcg_gen_add_i64(dwr, dwr, res);
-    tcg_gen_shli_i64(dwr, dwr, 16);
-    tcg_gen_extr_i64_i32(cpu_r[a->rd], cpu_r[a->rd+1], dwr);
+    tcg_gen_concat_i32_i64(acc, cpu_r[a->rd], cpu_r[a->rd+1]);
+    tcg_gen_andi_i64(acc, acc, ~0xffffULL);
+    tcg_gen_ext_i32_i64(prod64, prod);
+    tcg_gen_shli_i64(prod64, prod64, 16);
+    tcg_gen_add_i64(acc, acc, prod64);
+    tcg_gen_extr_i64_i32(cpu_r[a->rd], cpu_r[a->rd+1], acc);
 
     ctx->base.pc_next += 4;
     return true;
 }
 
 static bool trans_MACHHW(DisasContext *ctx, arg_MACHHW *a){
-    TCGv operand1 = tcg_temp_new_i32();
-    TCGv operand2 = tcg_temp_new_i32();
-    TCGv rd = tcg_temp_new_i32();
-
-    if(a->x == 1){
-        tcg_gen_shri_i32(operand1, cpu_r[a->rx], 16);
-        tcg_gen_ext16s_i32(operand1, operand1);
-    }
-    else{
-        tcg_gen_andi_i32(operand1, cpu_r[a->rx], 0x0000FFFF);
-        tcg_gen_ext16s_i32(operand1, operand1);
-    }
-    if(a->y == 1){
-        tcg_gen_shri_i32(operand2, cpu_r[a->ry], 16);
-        tcg_gen_ext16s_i32(operand2, operand2);
-    }
-    else{
-        tcg_gen_andi_i32(operand2, cpu_r[a->ry], 0x0000FFFF);
-        tcg_gen_ext16s_i32(operand2, operand2);
-    }
+    TCGv op1 = tcg_temp_new_i32();
+    TCGv op2 = tcg_temp_new_i32();
 
-    tcg_gen_mov_i32(rd, cpu_r[a->rd]);
-    tcg_gen_mul_i32(cpu_r[a->rd], operand1, operand2);
-    tcg_gen_add_i32(cpu_r[a->rd], cpu_r[a->rd], rd);
+    gen_sext_half(op1, cpu_r[a->rx], a->x);
+    gen_sext_half(op2, cpu_r[a->ry], a->y);
+    tcg_gen_mul_i32(op1, op1, op2);
+    tcg_gen_add_i32(cpu_r[a->rd], cpu_r[a->rd], op1);
 
     ctx->base.pc_next += 4;
     return true;
 }
 
 static bool trans_MACSD(DisasContext *ctx, arg_MACSD*a){
-    TCGv_i64 rdp = tcg_temp_new_i64();
-    TCGv_i64 rd = tcg_temp_new_i64();
     TCGv_i64 acc = tcg_temp_new_i64();
     TCGv_i64 prod64 = tcg_temp_new_i64();
     TCGv_i64 res = tcg_temp_new_i64();
     TCGv_i64 rx = tcg_temp_new_i64();
     TCGv_i64 ry = tcg_temp_new_i64();
-    tcg_gen_ext_i32_i64(rdp, cpu_r[a->rd+1]);
-    tcg_gen_ext_i32_i64(rd, cpu_r[a->rd]);
+    // Only the operands are signed, Rd is the low word of the accumulator
+    tcg_gen_concat_i32_i64(acc, cpu_r[a->rd], cpu_r[a->rd+1]);
     tcg_gen_ext_i32_i64(rx, cpu_r[a->rx]);
     tcg_gen_ext_i32_i64(ry, cpu_r[a->ry]);
-    tcg_gen_shli_i64(acc, rdp, 32);
-    tcg_gen_add_i64(acc, acc, rd);
 
     tcg_gen_mul_i64(prod64, rx, ry);
 
@@ -2153,29 +2679,26 @@ static bool trans_MACSD(DisasContext *ctx, arg_MACSD*a){
     return true;
 }
 
+/*
+ * Fractional multiply-accumulate: Rd = SSAT(Rd + SSAT(op1 * op2 << 1)).
+ * The doubled product only overflows for -1.0 * -1.0.
+ */
 static bool trans_MACSATHHW(DisasContext *ctx, arg_MACSATHHW *a) {
-    TCGv operand1 = tcg_temp_new_i32();
-    TCGv operand2 = tcg_temp_new_i32();
+    TCGv prod = tcg_temp_new_i32();
+    TCGv op2 = tcg_temp_new_i32();
+    TCGv ovf = tcg_temp_new_i32();
 
-    //TODO: Move segment to helper function. Also in other translation functions.
-    if(a->x == 1){
-        tcg_gen_shri_i32(operand1, cpu_r[a->rx], 16);
-        tcg_gen_ext16s_i32(operand1, operand1);
-    }
-    else{
-        tcg_gen_andi_i32(operand1, cpu_r[a->rx], 0x0000FFFF);
-        tcg_gen_ext16s_i32(operand1, operand1);
-    }
-    if(a->y == 1){
-        tcg_gen_shri_i32(operand2, cpu_r[a->ry], 16);
-        tcg_gen_ext16s_i32(operand2, operand2);
-    }
-    else{
-        tcg_gen_andi_i32(operand2, cpu_r[a->ry], 0x0000FFFF);
-        tcg_gen_ext16s_i32(operand2, operand2);
-    }
+    gen_sext_half(prod, cpu_r[a->rx], a->x);
+    gen_sext_half(op2, cpu_r[a->ry], a->y);
+    tcg_gen_mul_i32(prod, prod, op2);
+
+    tcg_gen_setcondi_i32(TCG_COND_EQ, ovf, prod, 0x40000000);
+    tcg_gen_shli_i32(prod, prod, 1);
+    tcg_gen_movcond_i32(TCG_COND_NE, prod, ovf, tcg_constant_i32(0),
+                        tcg_constant_i32(INT32_MAX), prod);
+    tcg_gen_or_i32(cpu_sflags[sflagQ], cpu_sflags[sflagQ], ovf);
 
-    gen_helper_macsathhw(cpu_env, tcg_constant_i32(a->rd), operand1, operand2);
+    gen_ssadd_q(cpu_r[a->rd], cpu_r[a->rd], prod);
 
     ctx->base.pc_next += 4;
     return true;
@@ -2208,28 +2731,13 @@ static bool trans_MACUD(DisasContext *ctx, arg_MACUD *a){
 //TODO: implement MACWH.D insn
 
 static bool trans_MAX(DisasContext *ctx, arg_MAX *a){
-    TCGLabel *if_1 = gen_new_label();
-    TCGLabel *else_1 = gen_new_label();
-    TCGLabel *exit = gen_new_label();
-
-    tcg_gen_brcond_i32(TCG_COND_GT, cpu_r[a->rx], cpu_r[a->ry], if_1);
-    tcg_gen_br(else_1);
-
-    gen_set_label(if_1);
-    tcg_gen_mov_i32(cpu_r[a->rd], cpu_r[a->rx]);
-    tcg_gen_br(exit);
-
-    gen_set_label(else_1);
-    tcg_gen_mov_i32(cpu_r[a->rd], cpu_r[a->ry]);
-
-    gen_set_label(exit);
+    tcg_gen_smax_i32(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry]);
 
     ctx->base.pc_next += 4;
     return true;
 }
 
 static bool trans_MCALL(DisasContext *ctx, arg_MCALL *a){
-    tcg_gen_addi_i32(cpu_r[LR_REG], cpu_r[PC_REG], 0x4);
     TCGv PC = cpu_r[PC_REG];
 
     TCGv Rp = tcg_temp_new_i32();
@@ -2246,7 +2754,8 @@ static bool trans_MCALL(DisasContext *ctx, arg_MCALL *a){
     tcg_gen_shli_i32(disp, disp, 2);
 
     tcg_gen_add_i32(Rp, Rp, disp);
-    tcg_gen_qemu_ld_tl(PC, Rp, 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_tl(PC, Rp, ctx->mem_idx, MO_BEUL);
+    tcg_gen_movi_i32(cpu_r[LR_REG], ctx->base.pc_next + 4);
 
 
     ctx->base.is_jmp = DISAS_JUMP;
@@ -2263,13 +2772,13 @@ static bool trans_MEMC(DisasContext *ctx, arg_MEMC *a)
 
     tcg_gen_movi_i32(addr, a->imm15);
     tcg_gen_shli_i32(addr, addr, 2);
-    tcg_gen_qemu_ld_i32(mem_word, addr, 0, MO_UW);
+    tcg_gen_qemu_ld_i32(mem_word, addr, ctx->mem_idx, MO_UW);
 
     tcg_gen_movi_i32(mask, 0xFFFFFFFE);
     tcg_gen_rotli_i32(mask, mask, a->bp5);
     tcg_gen_and_i32(mem_word, mem_word, mask);
 
-    tcg_gen_qemu_st_i32(mem_word, addr, 0, MO_UW);
+    tcg_gen_qemu_st_i32(mem_word, addr, ctx->mem_idx, MO_UW);
 
     ctx->base.pc_next += 4;
     return true;
@@ -2289,39 +2798,23 @@ static bool trans_MEMT_bp5_imm15(DisasContext *ctx, arg_MEMT_bp5_imm15 *a)
 
 static bool trans_MFSR(DisasContext *ctx, arg_MFSR *a){
     TCGv sr = tcg_temp_new_i32();
+    ctx->base.pc_next += 4;
     if((a->sr)== 0){
-        tcg_gen_movi_i32(sr, 0);
-
-        for(int i= 31; i>= 0; i--){
-            tcg_gen_shli_i32(sr, sr, 1);
-            tcg_gen_add_i32(sr, sr, cpu_sflags[i]);
-        }
+        gen_read_sr(ctx, sr);
+    }
+    else if(a->sr == AVR32_SYSR_COUNT){
+        gen_timer_io_start(ctx);
+        gen_helper_mfsr_count(sr, cpu_env);
     }
     else{
-        tcg_gen_mov_i32(sr, cpu_sysr[a->sr]);
+        gen_ld_sysr(sr, a->sr);
     }
     tcg_gen_mov_i32(cpu_r[a->rd], sr);
-
-    ctx->base.pc_next += 4;
     return true;
 }
 
 static bool trans_MIN(DisasContext *ctx, arg_MIN *a){
-    TCGLabel *if_1 = gen_new_label();
-    TCGLabel *else_1 = gen_new_label();
-    TCGLabel *exit = gen_new_label();
-
-    tcg_gen_brcond_i32(TCG_COND_LT, cpu_r[a->rx], cpu_r[a->ry], if_1);
-    tcg_gen_br(else_1);
-
-    gen_set_label(if_1);
-    tcg_gen_mov_i32(cpu_r[a->rd], cpu_r[a->rx]);
-    tcg_gen_br(exit);
-
-    gen_set_label(else_1);
-    tcg_gen_mov_i32(cpu_r[a->rd], cpu_r[a->ry]);
-
-    gen_set_label(exit);
+    tcg_gen_smin_i32(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry]);
 
     ctx->base.pc_next += 4;
     return true;
@@ -2373,37 +2866,21 @@ static bool trans_MOV_f3(DisasContext *ctx, arg_MOV_f3 *a){
 }
 
 static bool trans_MOVc_f1(DisasContext *ctx, arg_MOVc_f1 *a){
-    TCGLabel *no_move = gen_new_label();
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
+    DisasCompare c;
 
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, no_move);
-    tcg_gen_mov_i32(cpu_r[a->rd], cpu_r[a->rs]);
+    gen_prepare_cond(ctx, a->cond4, &c);
+    gen_movcond_rd(ctx, &c, a->rd, cpu_r[a->rs], 4);
 
-    gen_set_label(no_move);
-    if(a->rd == PC_REG){
-        ctx->base.is_jmp = DISAS_JUMP;
-    }
     ctx->base.pc_next += 4;
     return true;
 }
 
 static bool trans_MOVc_f2(DisasContext *ctx, arg_MOVc_f2 *a){
-    int imm = sign_extend_8(a->imm8);
-
-
-    TCGLabel *no_move = gen_new_label();
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
+    DisasCompare c;
 
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, no_move);
-    tcg_gen_movi_i32(cpu_r[a->rd], imm);
+    gen_prepare_cond(ctx, a->cond4, &c);
+    gen_movcond_rd(ctx, &c, a->rd, tcg_constant_i32(sign_extend_8(a->imm8)), 4);
 
-    gen_set_label(no_move);
-
-    if(a->rd == PC_REG){
-        ctx->base.is_jmp = DISAS_JUMP;
-    }
     ctx->base.pc_next += 4;
     return true;
 }
@@ -2425,22 +2902,45 @@ static bool trans_MTDR (DisasContext *ctx, arg_MTDR  *a){
 }
 
 static bool trans_MTSR (DisasContext *ctx, arg_MTSR  *a){
-    TCGv s_reg = cpu_sysr[a->sr];
     TCGv rs = cpu_r[a->rs];
 
-    if (a->sr == 0){
-        TCGv temp = tcg_temp_new_i32();
-        tcg_gen_mov_i32(temp, rs);
-        for (int i= 0; i< 32; i++){
-            tcg_gen_mov_i32(cpu_sflags[i], temp);
-            tcg_gen_andi_i32(cpu_sflags[i], cpu_sflags[i], 0x1);
-            tcg_gen_shri_i32(temp, temp, 1);
-        }
+    ctx->base.pc_next += 4;
+    if (ctx->avr32b && a->sr >= AVR32_SYSR_TLBEHI &&
+        a->sr <= AVR32_SYSR_TLBARHI && !gen_check_priv(ctx)){
+        return true;
+    }
+    if (a->sr == 0 && ctx->avr32b){
+        // A mode change swaps the shadow registers
+        gen_helper_write_sr(cpu_env, rs);
+        set_cc_op(ctx, CC_OP_FLAGS);
+        gen_exit_after_insn(ctx);
+    }
+    else if (a->sr == 0){
+        gen_write_sr(ctx, rs);
+        gen_exit_after_insn(ctx);
+    }
+    else if (a->sr == AVR32_SYSR_COUNT){
+        gen_timer_io_start(ctx);
+        gen_helper_mtsr_count(cpu_env, rs);
+    }
+    else if (a->sr == AVR32_SYSR_COMPARE){
+        gen_timer_io_start(ctx);
+        gen_helper_mtsr_compare(cpu_env, rs);
+    }
+    else if (a->sr >= AVR32_SYSR_MPUAR0 && a->sr <= AVR32_SYSR_MPUCR){
+        gen_helper_mtsr_mpu(cpu_env, tcg_constant_i32(a->sr), rs);
+        // The rights of the code that follows may have changed
+        gen_exit_after_insn(ctx);
+    }
+    else if (ctx->avr32b &&
+             (a->sr == AVR32_SYSR_TLBEHI || a->sr == AVR32_SYSR_MMUCR)){
+        gen_helper_mtsr_mmu(cpu_env, tcg_constant_i32(a->sr), rs);
+        // So may the mapping
+        gen_exit_after_insn(ctx);
     }
     else{
-        tcg_gen_mov_i32(s_reg, rs);
+        gen_st_sysr(a->sr, rs);
     }
-    ctx->base.pc_next += 4;
     return true;
 }
 
@@ -2467,22 +2967,9 @@ static bool trans_MUL_f3(DisasContext *ctx, arg_MUL_f3 *a){
 static bool trans_MULHHW(DisasContext *ctx, arg_MULHHW *a){
     TCGv op1 = tcg_temp_new_i32();
     TCGv op2 = tcg_temp_new_i32();
-    if(a->x == 1){
-        tcg_gen_shri_i32(op1, cpu_r[a->rx], 0x10);
-    }
-    else{
-        tcg_gen_andi_i32(op1, cpu_r[a->rx], 0x0000FFFF);
-    }
-    tcg_gen_ext16s_i32(op1, op1);
-
-    if(a->y == 1){
-        tcg_gen_shri_i32(op2, cpu_r[a->ry], 0x10);
-    }
-    else{
-        tcg_gen_andi_i32(op2, cpu_r[a->ry], 0x0000FFFF);
-    }
-    tcg_gen_ext16s_i32(op2, op2);
 
+    gen_sext_half(op1, cpu_r[a->rx], a->x);
+    gen_sext_half(op2, cpu_r[a->ry], a->y);
     tcg_gen_mul_i32(cpu_r[a->rd], op1, op2);
 
     ctx->base.pc_next +=4;
@@ -2500,6 +2987,7 @@ static bool trans_MULUD(DisasContext *ctx, arg_MULUD *a){
 }
 
 static bool trans_MUSFR(DisasContext *ctx, arg_MUSFR *a){
+    gen_flush_flags(ctx);
     tcg_gen_mov_i32(cpu_sflags[sflagC], cpu_r[a->rs]);
     tcg_gen_andi_i32(cpu_sflags[sflagC], cpu_sflags[sflagC], 0x1);
 
@@ -2520,6 +3008,7 @@ static bool trans_MUSFR(DisasContext *ctx, arg_MUSFR *a){
 }
 
 static bool trans_MUSTR(DisasContext *ctx, arg_MUSTR *a){
+    gen_flush_flags(ctx);
     TCGv temp = tcg_temp_new_i32();
 
     tcg_gen_mov_i32(temp, cpu_sflags[sflagV]);
@@ -2541,24 +3030,57 @@ static bool trans_MUSTR(DisasContext *ctx, arg_MUSTR *a){
     return true;
 }
 
+static bool trans_MVCR_D(DisasContext *ctx, arg_MVCR_D *a){
+    // r3 = 7 is the pair LR:PC, a write to PC is not supported, as for .W
+    if (a->cp != AVR32_FPU_CP || a->r3 * 2 + 1 == PC_REG) {
+        return false;
+    }
+    gen_ld_fpr(cpu_r[a->r3 * 2], a->cr3 * 2);
+    gen_ld_fpr(cpu_r[a->r3 * 2 + 1], a->cr3 * 2 + 1);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_MVCR_W(DisasContext *ctx, arg_MVCR_W *a){
+    if (a->cp != AVR32_FPU_CP || a->r == PC_REG) {
+        return false;
+    }
+    gen_ld_fpr(cpu_r[a->r], a->cr);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_MVRC_D(DisasContext *ctx, arg_MVRC_D *a){
+    if (a->cp != AVR32_FPU_CP) {
+        return false;
+    }
+    gen_st_fpr(a->cr3 * 2, cpu_r[a->r3 * 2]);
+    gen_st_fpr(a->cr3 * 2 + 1, cpu_r[a->r3 * 2 + 1]);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_MVRC_W(DisasContext *ctx, arg_MVRC_W *a){
+    if (a->cp != AVR32_FPU_CP) {
+        return false;
+    }
+    gen_st_fpr(a->cr, cpu_r[a->r]);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
 static bool trans_NEG(DisasContext *ctx, arg_NEG *a){
-    TCGv zero = tcg_temp_new_i32();
-    TCGv rd = tcg_temp_new_i32();
+    TCGv zero = tcg_constant_i32(0);
     TCGv res = tcg_temp_new_i32();
 
-    tcg_gen_movi_i32(zero, 0);
-    tcg_gen_mov_i32(rd, cpu_r[a->rd]);
-    tcg_gen_sub_i32(res, zero, rd);
+    tcg_gen_neg_i32(res, cpu_r[a->rd]);
+    gen_sub_cc(ctx, res, zero, cpu_r[a->rd]);
     tcg_gen_mov_i32(cpu_r[a->rd], res);
 
-    tcg_gen_shri_i32(cpu_sflags[sflagN], res, 31);
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0);
-    tcg_gen_shri_i32(res, res, 31);
-    tcg_gen_shri_i32(rd, rd, 31);
-
-    tcg_gen_and_i32(cpu_sflags[sflagV], rd, res);
-    tcg_gen_or_i32(cpu_sflags[sflagC], rd, res);
-
     ctx->base.pc_next += 2;
     return true;
 }
@@ -2573,8 +3095,7 @@ static bool trans_OR_f1(DisasContext *ctx, arg_OR_f1 *a){
     tcg_gen_or_i32(cpu_r[a->rd], cpu_r[a->rd], cpu_r[a->rs]);
     TCGv res = tcg_temp_new_i32();
     tcg_gen_mov_i32(res, cpu_r[a->rd]);
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], res, 31);
+    gen_logic_cc(ctx, res);
 
     ctx->base.pc_next += 2;
     return true;
@@ -2588,8 +3109,7 @@ static bool trans_OR_f2(DisasContext *ctx, arg_OR_f2 *a){
 
     TCGv res = tcg_temp_new_i32();
     tcg_gen_mov_i32(res, cpu_r[a->rd]);
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], res, 31);
+    gen_logic_cc(ctx, res);
 
     ctx->base.pc_next += 4;
     return true;
@@ -2603,24 +3123,20 @@ static bool trans_OR_f3(DisasContext *ctx, arg_OR_f2 *a){
 
     TCGv res = tcg_temp_new_i32();
     tcg_gen_mov_i32(res, cpu_r[a->rd]);
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], res, 31);
+    gen_logic_cc(ctx, res);
 
     ctx->base.pc_next += 4;
     return true;
 }
 
 static bool trans_OR_cond(DisasContext *ctx, arg_OR_cond *a){
-    TCGLabel *no_op = gen_new_label();
-
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
-
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, no_op);
+    DisasCompare c;
+    TCGv res = tcg_temp_new_i32();
 
-    tcg_gen_or_i32(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry]);
+    gen_prepare_cond(ctx, a->cond4, &c);
+    tcg_gen_or_i32(res, cpu_r[a->rx], cpu_r[a->ry]);
+    gen_movcond_rd(ctx, &c, a->rd, res, 4);
 
-    gen_set_label(no_op);
     ctx->base.pc_next += 4;
     return true;
 }
@@ -2631,8 +3147,7 @@ static bool trans_ORH(DisasContext *ctx, arg_ORH *a){
     tcg_gen_shli_i32(imm, imm, 16);
     tcg_gen_or_i32(cpu_r[a->rd], cpu_r[a->rd], imm);
 
-    tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], cpu_r[a->rd], 0);
+    gen_logic_cc(ctx, cpu_r[a->rd]);
 
 
     ctx->base.pc_next += 4;
@@ -2644,98 +3159,301 @@ static bool trans_ORL(DisasContext *ctx, arg_ORH *a){
     tcg_gen_movi_i32(imm, a->imm16);
     tcg_gen_or_i32(cpu_r[a->rd], cpu_r[a->rd], imm);
 
-    tcg_gen_shri_i32(cpu_sflags[sflagN], cpu_r[a->rd], 31);
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], cpu_r[a->rd], 0);
+    gen_logic_cc(ctx, cpu_r[a->rd]);
 
     ctx->base.pc_next += 4;
     return true;
 }
 
-static bool trans_POPM(DisasContext *ctx, arg_POPM *a){
-    bool setFlags = false;
+/*
+ * Packed SIMD. The wrapping lane adds and subtracts use the SWAR expansions
+ * of the gvec code, everything else goes lane by lane through gen_packed().
+ * Flags are not affected.
+ */
 
-    if (((a->list >> 8) & 1) == 1 && (((a->list >> 0) & 1) == 1)){
-        tcg_gen_qemu_ld_tl(cpu_r[PC_REG], cpu_r[SP_REG], 0, MO_BEUL);
-        tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
-        ctx->base.is_jmp = DISAS_JUMP;
+static bool trans_PADD_H(DisasContext *ctx, arg_PADD_H *a){
+    tcg_gen_vec_add16_i32(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry]);
 
-        if (((a->list >> 6) & 1) == 0 && ((a->list >> 7) & 1) == 0){
-            tcg_gen_movi_i32(cpu_r[12], 0);
-        }
-        else if (((a->list >> 6) & 1) == 1 && ((a->list >> 7) & 1) == 0){
-            tcg_gen_movi_i32(cpu_r[12], 1);
-        }
-        else{
-            tcg_gen_movi_i32(cpu_r[12], -1);
-        }
-        setFlags = true;
-    }
-    else{
-        if(((a->list >> 8) & 1) == 1){
-            tcg_gen_qemu_ld_tl(cpu_r[PC_REG], cpu_r[SP_REG], 0, MO_BEUL);
-            tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
-            ctx->base.is_jmp = DISAS_JUMP;
-        }
-        if(((a->list >> 7) & 1) == 1){
-            tcg_gen_qemu_ld_tl(cpu_r[LR_REG], cpu_r[SP_REG], 0, MO_BEUL);
-            tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
+    ctx->base.pc_next += 4;
+    return true;
+}
 
-        }
-        if(((a->list >> 6) & 1) == 1){
-            tcg_gen_qemu_ld_tl(cpu_r[12], cpu_r[SP_REG], 0, MO_BEUL);
-            tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
+static bool trans_PSUB_H(DisasContext *ctx, arg_PSUB_H *a){
+    tcg_gen_vec_sub16_i32(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry]);
 
-        }
-        if(((a->list >> 8) & 1) == 1){
-            setFlags = true;
-        }
-    }
+    ctx->base.pc_next += 4;
+    return true;
+}
 
-    if(((a->list >> 5) & 1) == 1){
-        tcg_gen_qemu_ld_tl(cpu_r[11], cpu_r[SP_REG], 0, MO_BEUL);
-        tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
+static bool trans_PADD_B(DisasContext *ctx, arg_PADD_B *a){
+    tcg_gen_vec_add8_i32(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry]);
 
-    }
-    if(((a->list >> 4) & 1) == 1){
-        tcg_gen_qemu_ld_tl(cpu_r[10], cpu_r[SP_REG], 0, MO_BEUL);
-        tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
-    }
+    ctx->base.pc_next += 4;
+    return true;
+}
 
-    if(((a->list >> 3) & 1) == 1){
-        tcg_gen_qemu_ld_tl(cpu_r[9], cpu_r[SP_REG], 0, MO_BEUL);
-        tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
-        tcg_gen_qemu_ld_tl(cpu_r[8], cpu_r[SP_REG], 0, MO_BEUL);
-        tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
-    }
+static bool trans_PSUB_B(DisasContext *ctx, arg_PSUB_B *a){
+    tcg_gen_vec_sub8_i32(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry]);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PADDX_H(DisasContext *ctx, arg_PADDX_H *a){
+    TCGv ry = tcg_temp_new_i32();
+
+    tcg_gen_rotli_i32(ry, cpu_r[a->ry], 16);
+    tcg_gen_vec_add16_i32(cpu_r[a->rd], cpu_r[a->rx], ry);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PSUBX_H(DisasContext *ctx, arg_PSUBX_H *a){
+    TCGv ry = tcg_temp_new_i32();
+
+    tcg_gen_rotli_i32(ry, cpu_r[a->ry], 16);
+    tcg_gen_vec_sub16_i32(cpu_r[a->rd], cpu_r[a->rx], ry);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PADDS_SH(DisasContext *ctx, arg_PADDS_SH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, true, false, true,
+               tcg_gen_add_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PADDS_UH(DisasContext *ctx, arg_PADDS_UH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, false, false, true,
+               tcg_gen_add_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PADDS_SB(DisasContext *ctx, arg_PADDS_SB *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 8, true, false, true,
+               tcg_gen_add_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PADDS_UB(DisasContext *ctx, arg_PADDS_UB *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 8, false, false, true,
+               tcg_gen_add_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PADDXS_SH(DisasContext *ctx, arg_PADDXS_SH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, true, true, true,
+               tcg_gen_add_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PADDXS_UH(DisasContext *ctx, arg_PADDXS_UH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, false, true, true,
+               tcg_gen_add_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PADDH_SH(DisasContext *ctx, arg_PADDH_SH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, true, false, false,
+               gen_lane_addh);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PADDH_UB(DisasContext *ctx, arg_PADDH_UB *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 8, false, false, false,
+               gen_lane_addh);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PADDXH_SH(DisasContext *ctx, arg_PADDXH_SH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, true, true, false,
+               gen_lane_addh);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PSUBS_SH(DisasContext *ctx, arg_PSUBS_SH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, true, false, true,
+               tcg_gen_sub_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PSUBS_UH(DisasContext *ctx, arg_PSUBS_UH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, false, false, true,
+               tcg_gen_sub_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PSUBS_SB(DisasContext *ctx, arg_PSUBS_SB *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 8, true, false, true,
+               tcg_gen_sub_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PSUBS_UB(DisasContext *ctx, arg_PSUBS_UB *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 8, false, false, true,
+               tcg_gen_sub_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PSUBXS_SH(DisasContext *ctx, arg_PSUBXS_SH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, true, true, true,
+               tcg_gen_sub_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PSUBXS_UH(DisasContext *ctx, arg_PSUBXS_UH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, false, true, true,
+               tcg_gen_sub_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PSUBH_SH(DisasContext *ctx, arg_PSUBH_SH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, true, false, false,
+               gen_lane_subh);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PSUBH_UB(DisasContext *ctx, arg_PSUBH_UB *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 8, false, false, false,
+               gen_lane_subh);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PSUBXH_SH(DisasContext *ctx, arg_PSUBXH_SH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, true, true, false,
+               gen_lane_subh);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PAVG_SH(DisasContext *ctx, arg_PAVG_SH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, true, false, false,
+               gen_lane_avg);
 
-    if(((a->list >> 2) & 1) == 1){
-        tcg_gen_qemu_ld_tl(cpu_r[7], cpu_r[SP_REG], 0, MO_BEUL);
-        tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
-        tcg_gen_qemu_ld_tl(cpu_r[6], cpu_r[SP_REG], 0, MO_BEUL);
-        tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
-        tcg_gen_qemu_ld_tl(cpu_r[5], cpu_r[SP_REG], 0, MO_BEUL);
-        tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
-        tcg_gen_qemu_ld_tl(cpu_r[4], cpu_r[SP_REG], 0, MO_BEUL);
-        tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PAVG_UB(DisasContext *ctx, arg_PAVG_UB *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 8, false, false, false,
+               gen_lane_avg);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PMAX_SH(DisasContext *ctx, arg_PMAX_SH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, true, false, false,
+               tcg_gen_smax_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PMAX_UB(DisasContext *ctx, arg_PMAX_UB *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 8, false, false, false,
+               tcg_gen_smax_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PMIN_SH(DisasContext *ctx, arg_PMIN_SH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 16, true, false, false,
+               tcg_gen_smin_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PMIN_UB(DisasContext *ctx, arg_PMIN_UB *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry], 8, false, false, false,
+               tcg_gen_smin_i32);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PABS_SB(DisasContext *ctx, arg_PABS_SB *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rs], cpu_r[a->rs], 8, true, false, false,
+               gen_lane_abs);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_PABS_SH(DisasContext *ctx, arg_PABS_SH *a){
+    gen_packed(cpu_r[a->rd], cpu_r[a->rs], cpu_r[a->rs], 16, true, false, false,
+               gen_lane_abs);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_POPM(DisasContext *ctx, arg_POPM *a){
+    int list = a->list >> 1;
+    bool pc = (list >> 7) & 1;
+    bool ret = pc && (a->list & 1);
+    int push[16], regs[16];
+    int n;
+
+    if(ret){
+        // LR and R12 are not popped, R12 returns a value instead
+        tcg_gen_movi_i32(cpu_r[12],
+                         multi_ret_value((list >> 6) & 1, (list >> 5) & 1));
+        list &= ~((1 << 6) | (1 << 5));
     }
-    if(((a->list >> 1) & 1) == 1){
-        tcg_gen_qemu_ld_tl(cpu_r[3], cpu_r[SP_REG], 0, MO_BEUL);
-        tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
-        tcg_gen_qemu_ld_tl(cpu_r[2], cpu_r[SP_REG], 0, MO_BEUL);
-        tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
-        tcg_gen_qemu_ld_tl(cpu_r[1], cpu_r[SP_REG], 0, MO_BEUL);
-        tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
-        tcg_gen_qemu_ld_tl(cpu_r[0], cpu_r[SP_REG], 0, MO_BEUL);
-        tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
+
+    // Popped in the reverse order of PUSHM
+    n = pushm_list_regs(list, push);
+    for(int i = 0; i < n; i++){
+        regs[i] = push[n - 1 - i];
     }
+    gen_ld_multi(ctx, cpu_r[SP_REG], regs, n);
+    tcg_gen_addi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 4 * n);
 
-    if(setFlags){
+    if(pc){
+        ctx->base.is_jmp = DISAS_JUMP;
         tcg_gen_movi_i32(cpu_sflags[sflagV], 0);
         tcg_gen_movi_i32(cpu_sflags[sflagC], 0);
-        TCGv res = tcg_temp_new_i32();
-        tcg_gen_mov_i32(res, cpu_r[12]);
-        tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0);
-        tcg_gen_shri_i32(cpu_sflags[sflagN], res, 31);
+        gen_set_logic_cc(ctx, cpu_r[12]);
     }
 
     ctx->base.pc_next += 2;
@@ -2743,53 +3461,16 @@ static bool trans_POPM(DisasContext *ctx, arg_POPM *a){
 }
 
 static bool trans_PUSHM(DisasContext *ctx, arg_PUSHM *a){
-    TCGv sp = cpu_r[SP_REG];
-    if (((a->list >> 0) & 1) == 1){
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[0], sp, 0x0, MO_BEUL);
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[1], sp, 0x0, MO_BEUL);
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[2], sp, 0x0, MO_BEUL);
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[3], sp, 0x0, MO_BEUL);
-    }
-    if (((a->list >> 1) & 1) == 1){
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[4], sp, 0x0, MO_BEUL);
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[5], sp, 0x0, MO_BEUL);
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[6], sp, 0x0, MO_BEUL);
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[7], sp, 0x0, MO_BEUL);
-    }
-    if (((a->list >> 2) & 1) == 1) {
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[8], sp, 0x0, MO_BEUL);
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[9], sp, 0x0, MO_BEUL);
-    }
-    if (((a->list >> 3) & 1) == 1) {
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[10], sp, 0x0, MO_BEUL);
-    }
-    if (((a->list >> 4) & 1) == 1) {
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[11], sp, 0x0, MO_BEUL);
-    }
-    if (((a->list >> 5) & 1) == 1) {
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[12], sp, 0x0, MO_BEUL);
-    }
-    if (((a->list >> 6) & 1) == 1) {
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[LR_REG], sp, 0x0, MO_BEUL);
-    }
-    if (((a->list >> 7) & 1) == 1) {
-        tcg_gen_subi_i32(sp, sp, 0x4);
-        tcg_gen_qemu_st_tl(cpu_r[PC_REG], sp, 0x0, MO_BEUL);
+    int regs[16];
+    TCGv vals[16];
+    int n = pushm_list_regs(a->list, regs);
+
+    for(int i = 0; i < n; i++){
+        vals[i] = regs[i] == PC_REG ?
+                  tcg_constant_i32(ctx->base.pc_next) : cpu_r[regs[i]];
     }
+    gen_st_multi(ctx, cpu_r[SP_REG], vals, n, -4, -4);
+    tcg_gen_subi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 4 * n);
 
     ctx->base.pc_next += 2;
     return true;
@@ -2803,10 +3484,10 @@ static bool trans_RCALL_f1(DisasContext *ctx, arg_RCALL_f1 *a){
     }
     disp = disp << 1;
 
-    tcg_gen_addi_i32(cpu_r[AVR32A_LR_REG], cpu_r[AVR32A_PC_REG], 2);
-    tcg_gen_addi_i32(cpu_r[AVR32A_PC_REG], cpu_r[AVR32A_PC_REG], disp);
+    tcg_gen_movi_i32(cpu_r[AVR32A_LR_REG], ctx->base.pc_next + 2);
+    gen_goto_tb(ctx, 0, ctx->base.pc_next + disp);
 
-    ctx->base.is_jmp = DISAS_JUMP;
+    ctx->base.is_jmp = DISAS_NORETURN;
     ctx->base.pc_next += 2;
     return true;
 }
@@ -2819,10 +3500,10 @@ static bool trans_RCALL_f2(DisasContext *ctx, arg_RCALL_f2 *a){
         disp |= 0xFFE00000;
     }
     disp = disp << 1;
-    tcg_gen_addi_i32(cpu_r[AVR32A_LR_REG], cpu_r[AVR32A_PC_REG], 2);
-    tcg_gen_addi_i32(cpu_r[AVR32A_PC_REG], cpu_r[AVR32A_PC_REG], disp);
+    tcg_gen_movi_i32(cpu_r[AVR32A_LR_REG], ctx->base.pc_next + 4);
+    gen_goto_tb(ctx, 0, ctx->base.pc_next + disp);
 
-    ctx->base.is_jmp = DISAS_JUMP;
+    ctx->base.is_jmp = DISAS_NORETURN;
     ctx->base.pc_next += 4;
     return true;
 }
@@ -2830,12 +3511,8 @@ static bool trans_RCALL_f2(DisasContext *ctx, arg_RCALL_f2 *a){
 static bool trans_RET(DisasContext *ctx, arg_RET *a){
     TCGLabel *no_return = gen_new_label();
 
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
-
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, no_return);
+    gen_brcond_false(ctx, a->cond4, no_return);
 
-    TCGLabel *leave = gen_new_label();
     if(a->rd != LR_REG && a->rd != SP_REG && a->rd != PC_REG){
         tcg_gen_mov_i32(cpu_r[12], cpu_r[a->rd]);
     }
@@ -2856,73 +3533,73 @@ static bool trans_RET(DisasContext *ctx, arg_RET *a){
     tcg_gen_mov_i32(cpu_sflags[sflagN], r12);
     tcg_gen_movi_i32(cpu_sflags[sflagC], 0);
     tcg_gen_movi_i32(cpu_sflags[sflagV], 0);
+    // Only on this path, the fall-through keeps the lazy flags of ctx->cc_op
+    tcg_gen_movi_i32(cpu_cc_op, CC_OP_FLAGS);
 
     tcg_gen_mov_i32(cpu_r[PC_REG], cpu_r[LR_REG]);
-    tcg_gen_br(leave);
+    tcg_gen_lookup_and_goto_ptr();
 
     gen_set_label(no_return);
-    tcg_gen_addi_i32(cpu_r[PC_REG], cpu_r[PC_REG], 2);
-
-    gen_set_label(leave);
-    ctx->base.is_jmp = DISAS_JUMP;
+    ctx->base.is_jmp = DISAS_CHAIN;
     ctx->base.pc_next += 2;
     return true;
 }
 
 static bool trans_RETE(DisasContext *ctx, arg_RETE *a){
+    gen_flush_flags(ctx);
+    if (ctx->avr32b) {
+        gen_helper_rete(cpu_env);
+        set_cc_op(ctx, CC_OP_FLAGS);
+        tcg_gen_movi_i32(cpu_sflags[sflagL], 0);
+        ctx->base.is_jmp = DISAS_EXIT;
+        ctx->base.pc_next += 2;
+        return true;
+    }
+
     TCGLabel *if_1 = gen_new_label();
     TCGLabel *exit = gen_new_label();
 
     TCGv SP = cpu_r[SP_REG];
 
     TCGv sr = tcg_temp_new_i32();
-    tcg_gen_qemu_ld_i32(sr, SP, 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(sr, SP, ctx->mem_idx, MO_BEUL);
 
     tcg_gen_addi_i32(SP, SP, 0x4);
 
-    tcg_gen_qemu_ld_i32(cpu_r[PC_REG], SP, 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(cpu_r[PC_REG], SP, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(SP, SP, 0x4);
 
 
     TCGv sr_m = tcg_temp_new_i32();
     // set sr_m to SR[M2:M0]
-    tcg_gen_mov_i32(sr_m, cpu_sflags[24]);
-    tcg_gen_shli_i32(sr_m, sr_m, 1);
-    tcg_gen_add_i32(sr_m, sr_m, cpu_sflags[23]);
-    tcg_gen_shli_i32(sr_m, sr_m, 1);
-    tcg_gen_add_i32(sr_m, sr_m, cpu_sflags[22]);
-
+    gen_read_sr_mode(sr_m);
 
-    for(int i= 0; i< 32; i++){
-        tcg_gen_shri_i32(cpu_sflags[i], sr, i);
-        tcg_gen_andi_i32(cpu_sflags[i], cpu_sflags[i], 0x1);
-    }
+    gen_write_sr(ctx, sr);
 
-    // Check if SR[M2:M0] >= 001
-    tcg_gen_brcondi_i32(TCG_COND_EQ, sr_m, 2, if_1);
-    tcg_gen_brcondi_i32(TCG_COND_EQ, sr_m, 3, if_1);
-    tcg_gen_brcondi_i32(TCG_COND_EQ, sr_m, 5, if_1);
+    // Returning from INT0-INT3, pop the registers stacked on entry
+    tcg_gen_subi_i32(sr_m, sr_m, AVR32_MODE_INT0);
+    tcg_gen_brcondi_i32(TCG_COND_LEU, sr_m, AVR32_MODE_INT3 - AVR32_MODE_INT0, if_1);
     tcg_gen_br(exit);
 
     // if
     gen_set_label(if_1);
 
-    tcg_gen_qemu_ld_i32(cpu_r[LR_REG], SP, 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(cpu_r[LR_REG], SP, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(SP, SP, 0x4);
 
-    tcg_gen_qemu_ld_i32(cpu_r[12], SP, 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(cpu_r[12], SP, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(SP, SP, 0x4);
 
-    tcg_gen_qemu_ld_i32(cpu_r[11], SP, 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(cpu_r[11], SP, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(SP, SP, 0x4);
 
-    tcg_gen_qemu_ld_i32(cpu_r[10], SP, 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(cpu_r[10], SP, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(SP, SP, 0x4);
 
-    tcg_gen_qemu_ld_i32(cpu_r[9], SP, 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(cpu_r[9], SP, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(SP, SP, 0x4);
 
-    tcg_gen_qemu_ld_i32(cpu_r[8], SP, 0x0, MO_BEUL);
+    tcg_gen_qemu_ld_i32(cpu_r[8], SP, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(SP, SP, 0x4);
 
     // exit
@@ -2930,15 +3607,14 @@ static bool trans_RETE(DisasContext *ctx, arg_RETE *a){
 
     tcg_gen_movi_i32(cpu_sflags[sflagL], 0);
 
-    ctx->env->intsrc = 0;
-    ctx->env->intlevel = 0;
-
-    ctx->base.is_jmp = DISAS_JUMP;
+    // The restored SR may unmask a pending interrupt
+    ctx->base.is_jmp = DISAS_EXIT;
     ctx->base.pc_next += 2;
     return true;
 }
 
 static bool trans_RETS(DisasContext *ctx, arg_RETS *a){
+    gen_flush_flags(ctx);
     TCGLabel *if_1 = gen_new_label();
     TCGLabel *if_1_else_if = gen_new_label();
     TCGLabel *if_1_else = gen_new_label();
@@ -2947,11 +3623,7 @@ static bool trans_RETS(DisasContext *ctx, arg_RETS *a){
     TCGv sr_m = tcg_temp_new_i32();
 
     // set sr_m to SR[M2:M0]
-    tcg_gen_mov_i32(sr_m, cpu_sflags[24]);
-    tcg_gen_shli_i32(sr_m, sr_m, 1);
-    tcg_gen_add_i32(sr_m, sr_m, cpu_sflags[23]);
-    tcg_gen_shli_i32(sr_m, sr_m, 1);
-    tcg_gen_add_i32(sr_m, sr_m, cpu_sflags[22]);
+    gen_read_sr_mode(sr_m);
 
     // Check if SR[M2:M0] == 001
     tcg_gen_brcondi_i32(TCG_COND_EQ, sr_m, 0, if_1);
@@ -2969,15 +3641,18 @@ static bool trans_RETS(DisasContext *ctx, arg_RETS *a){
     TCGv sr = tcg_temp_new_i32();
     TCGv SP = cpu_r[SP_REG];
 
-    tcg_gen_qemu_ld_i32(sr, SP, 0x0, MO_BEUL);
-    tcg_gen_addi_i32(SP, SP, 0x4);
-    for(int i= 0; i< 32; i++){
-        tcg_gen_shri_i32(cpu_sflags[i], sr, i);
-        tcg_gen_andi_i32(cpu_sflags[i], cpu_sflags[i], 0x1);
-    }
+    if (ctx->avr32b) {
+        gen_ld_sysr(sr, AVR32_SYSR_RSR(AVR32_MODE_SUP));
+        gen_write_sr(ctx, sr);
+        gen_ld_sysr(cpu_r[PC_REG], AVR32_SYSR_RAR(AVR32_MODE_SUP));
+    } else {
+        tcg_gen_qemu_ld_i32(sr, SP, ctx->mem_idx, MO_BEUL);
+        tcg_gen_addi_i32(SP, SP, 0x4);
+        gen_write_sr(ctx, sr);
 
-    tcg_gen_qemu_ld_i32(cpu_r[PC_REG], SP, 0x0, MO_BEUL);
-    tcg_gen_addi_i32(SP, SP, 0x4);
+        tcg_gen_qemu_ld_i32(cpu_r[PC_REG], SP, ctx->mem_idx, MO_BEUL);
+        tcg_gen_addi_i32(SP, SP, 0x4);
+    }
     tcg_gen_br(exit);
 
     //else
@@ -2986,7 +3661,7 @@ static bool trans_RETS(DisasContext *ctx, arg_RETS *a){
 
     // exit
     gen_set_label(exit);
-    ctx->base.is_jmp = DISAS_JUMP;
+    ctx->base.is_jmp = DISAS_EXIT;
 
     ctx->base.pc_next += 2;
     return true;
@@ -3000,14 +3675,15 @@ static bool trans_RJMP(DisasContext *ctx, arg_RJMP *a){
     }
     disp = disp << 1;
 
-    tcg_gen_addi_i32(cpu_r[PC_REG], cpu_r[PC_REG], disp);
+    gen_goto_tb(ctx, 0, ctx->base.pc_next + disp);
 
-    ctx->base.is_jmp = DISAS_JUMP;
+    ctx->base.is_jmp = DISAS_NORETURN;
     ctx->base.pc_next += 2;
     return true;
 }
 
 static bool trans_ROL(DisasContext *ctx, arg_ROL *a){
+    gen_flush_flags(ctx);
     TCGv tempC = tcg_temp_new_i32();
     TCGv res = tcg_temp_new_i32();
 
@@ -3025,6 +3701,7 @@ static bool trans_ROL(DisasContext *ctx, arg_ROL *a){
 }
 
 static bool trans_ROR(DisasContext *ctx, arg_ROR *a){
+    gen_flush_flags(ctx);
     TCGv tempC = tcg_temp_new_i32();
     tcg_gen_andi_i32(tempC, cpu_r[a->rd], 0x00000001);
     tcg_gen_shri_i32(cpu_r[a->rd], cpu_r[a->rd], 1);
@@ -3040,46 +3717,11 @@ static bool trans_ROR(DisasContext *ctx, arg_ROR *a){
 }
 
 static bool trans_RSUB_f1(DisasContext *ctx, arg_RSUB_f1 *a){
-    TCGv rd = cpu_r[a->rd];
-    TCGv rs = cpu_r[a->rs];
-
-    TCGv temp = tcg_temp_new_i32();
-    TCGv left = tcg_temp_new_i32();
-    TCGv right = tcg_temp_new_i32();
     TCGv res = tcg_temp_new_i32();
-    TCGv op1 = tcg_temp_new_i32();
-    TCGv op2 = tcg_temp_new_i32();
-
-    tcg_gen_mov_i32(op1, rs);
-    tcg_gen_mov_i32(op2, rd);
-
-    tcg_gen_sub_i32(rd, rs, rd);
-    tcg_gen_mov_i32(res, rd);
-
-    // Z flag
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0);
-
-    //N-flag
-    tcg_gen_shri_i32(res, res, 31);
-    tcg_gen_mov_i32(cpu_sflags[sflagN], res);
-
-    //V-Flag
-    tcg_gen_shri_i32(op1, op1, 31);
-    tcg_gen_shri_i32(op2, op2, 31);
-
-    tcg_gen_andc_i32(left, op1, op2);
-    tcg_gen_andc_i32(left, left, res);
-
-    tcg_gen_andc_i32(right, op2, op1);
-    tcg_gen_and_i32(right, right, res);
-    tcg_gen_or_i32(cpu_sflags[sflagV], left, right);
 
-    // C-Flag
-    tcg_gen_andc_i32(left, op2, op1);
-    tcg_gen_and_i32(temp, op2, res);
-    tcg_gen_andc_i32(right, res, op1);
-    tcg_gen_or_i32(temp, temp, left);
-    tcg_gen_or_i32(cpu_sflags[sflagC], temp, right);
+    tcg_gen_sub_i32(res, cpu_r[a->rs], cpu_r[a->rd]);
+    gen_sub_cc(ctx, res, cpu_r[a->rs], cpu_r[a->rd]);
+    tcg_gen_mov_i32(cpu_r[a->rd], res);
 
     ctx->base.pc_next += 2;
     return true;
@@ -3089,70 +3731,24 @@ static bool trans_RSUB_f2(DisasContext *ctx, arg_RSUB_f2 *a){
     int imm8 = a->imm8;
     imm8 = sign_extend_8(imm8);
 
-    TCGv rd = cpu_r[a->rd];
-    TCGv rs = cpu_r[a->rs];
-    TCGv imm = tcg_temp_new_i32();
-    TCGv temp = tcg_temp_new_i32();
-    TCGv left = tcg_temp_new_i32();
-    TCGv right = tcg_temp_new_i32();
+    TCGv imm = tcg_constant_i32(imm8);
     TCGv res = tcg_temp_new_i32();
-    TCGv op1 = tcg_temp_new_i32();
-    TCGv op2 = tcg_temp_new_i32();
-
-    tcg_gen_movi_i32(imm, imm8);
-    tcg_gen_mov_i32(op1, imm);
-    tcg_gen_mov_i32(op2, rs);
-
-    tcg_gen_sub_i32(rd, imm, rs);
-    tcg_gen_mov_i32(res, rd);
-
-    // Z flag
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0);
-
-    //N-flag
-    tcg_gen_shri_i32(res, res, 31);
-    tcg_gen_mov_i32(cpu_sflags[sflagN], res);
-
-    //V-Flag
-    tcg_gen_shri_i32(op1, op1, 31);
-    tcg_gen_shri_i32(op2, op2, 31);
-
-    tcg_gen_andc_i32(left, op1, op2);
-    tcg_gen_andc_i32(left, left, res);
-
-    tcg_gen_andc_i32(right, op2, op1);
-    tcg_gen_and_i32(right, right, res);
-    tcg_gen_or_i32(cpu_sflags[sflagV], left, right);
 
-    // C-Flag
-    tcg_gen_andc_i32(left, op2, op1);
-    tcg_gen_and_i32(temp, op2, res);
-    tcg_gen_andc_i32(right, res, op1);
-    tcg_gen_or_i32(temp, temp, left);
-    tcg_gen_or_i32(cpu_sflags[sflagC], temp, right);
+    tcg_gen_sub_i32(res, imm, cpu_r[a->rs]);
+    gen_sub_cc(ctx, res, imm, cpu_r[a->rs]);
+    tcg_gen_mov_i32(cpu_r[a->rd], res);
 
     ctx->base.pc_next += 4;
     return true;
 }
 
 static bool trans_RSUBc(DisasContext *ctx, arg_RSUBc *a){
-    TCGLabel *end = gen_new_label();
-
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
-
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, end);
-
-    int imm = sign_extend_8(a->imm8);
-    TCGv imm8 = tcg_temp_new_i32();
-    tcg_gen_movi_i32(imm8, imm);
-    tcg_gen_sub_i32(cpu_r[a->rd], imm8, cpu_r[a->rd]);
-
+    DisasCompare c;
+    TCGv res = tcg_temp_new_i32();
 
-    gen_set_label(end);
-    if(a->rd == PC_REG){
-        ctx->base.is_jmp = DISAS_JUMP;
-    }
+    gen_prepare_cond(ctx, a->cond4, &c);
+    tcg_gen_subfi_i32(res, sign_extend_8(a->imm8), cpu_r[a->rd]);
+    gen_movcond_rd(ctx, &c, a->rd, res, 4);
 
     ctx->base.pc_next += 4;
     return true;
@@ -3214,6 +3810,7 @@ static bool trans_SATU(DisasContext *ctx, arg_SATU *a){
 }
 
 static bool trans_SBC(DisasContext *ctx, arg_SBC *a){
+    gen_flush_flags(ctx);
     TCGv res = tcg_temp_new_i32();
     TCGv rx = tcg_temp_new_i32();
     TCGv ry = tcg_temp_new_i32();
@@ -3260,6 +3857,7 @@ static bool trans_SBC(DisasContext *ctx, arg_SBC *a){
 }
 
 static bool trans_SBR(DisasContext *ctx, arg_SBR *a){
+    gen_flush_flags(ctx);
     TCGv bp = tcg_temp_new_i32();
     tcg_gen_movi_i32(bp, a->bp4);
     tcg_gen_shli_i32(bp, bp, 1);
@@ -3277,16 +3875,16 @@ static bool trans_SBR(DisasContext *ctx, arg_SBR *a){
 }
 
 static bool trans_SCALL(DisasContext *ctx, arg_SCALL *a){
+    gen_flush_flags(ctx);
     TCGLabel *if_1 = gen_new_label();
     TCGLabel *if_1_else = gen_new_label();
     TCGLabel *exit = gen_new_label();
 
     TCGv sr_m = tcg_temp_new_i32();
     TCGv temp = tcg_temp_new_i32();
-    tcg_gen_shli_i32(sr_m, cpu_sysr[24], 2);
-    tcg_gen_shli_i32(temp, cpu_sysr[23], 1);
-    tcg_gen_or_i32(sr_m, sr_m, temp);
-    tcg_gen_or_i32(sr_m, sr_m, cpu_sysr[22]);
+    TCGv evba = tcg_temp_new_i32();
+    gen_read_sr_mode(sr_m);
+    gen_ld_sysr(evba, AVR32_SYSR_EVBA);
 
 
     tcg_gen_brcondi_i32(TCG_COND_EQ, sr_m, 0, if_1);
@@ -3297,32 +3895,31 @@ static bool trans_SCALL(DisasContext *ctx, arg_SCALL *a){
     gen_set_label(if_1);
 
     TCGv sr = tcg_temp_new_i32();
-    tcg_gen_movi_i32(sr, 0);
+    gen_read_sr(ctx, sr);
 
-    tcg_gen_addi_i32(temp, cpu_r[PC_REG], 0x2);
-    tcg_gen_subi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
-    tcg_gen_qemu_st_i32(temp, cpu_r[SP_REG], 0x0, MO_BEUL);
+    tcg_gen_movi_i32(temp, ctx->base.pc_next + 2);
+    if (ctx->avr32b) {
+        gen_st_sysr(AVR32_SYSR_RAR(AVR32_MODE_SUP), temp);
+        gen_st_sysr(AVR32_SYSR_RSR(AVR32_MODE_SUP), sr);
+    } else {
+        tcg_gen_subi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
+        tcg_gen_qemu_st_i32(temp, cpu_r[SP_REG], ctx->mem_idx, MO_BEUL);
 
-    for(int i= 0; i< 32; i++){
-        tcg_gen_mov_i32(temp, cpu_sflags[i]);
-        tcg_gen_shli_i32(sr, cpu_sflags[i], i);
-        tcg_gen_or_i32(sr, sr, cpu_sflags[i]);
+        tcg_gen_subi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
+        tcg_gen_qemu_st_i32(sr, cpu_r[SP_REG], ctx->mem_idx, MO_BEUL);
     }
-    tcg_gen_subi_i32(cpu_r[SP_REG], cpu_r[SP_REG], 0x4);
-    tcg_gen_qemu_st_i32(sr, cpu_r[SP_REG], 0x0, MO_BEUL);
 
 
-    tcg_gen_addi_i32(cpu_r[PC_REG], cpu_sysr[1], 0x100);
-    tcg_gen_movi_i32(cpu_sflags[22], 0x1);
-    tcg_gen_movi_i32(cpu_sflags[23], 0x0);
-    tcg_gen_movi_i32(cpu_sflags[24], 0x0);
+    tcg_gen_addi_i32(cpu_r[PC_REG], evba, 0x100);
+    tcg_gen_andi_i32(cpu_sr, cpu_sr, ~AVR32_SR_M_MASK);
+    tcg_gen_ori_i32(cpu_sr, cpu_sr, AVR32_MODE_SUP << AVR32_SR_M_SHIFT);
 
     tcg_gen_br(exit);
 
     // else
     gen_set_label(if_1_else);
     tcg_gen_movi_i32(cpu_r[LR_REG], ctx->base.pc_next + 2);
-    tcg_gen_addi_i32(cpu_r[PC_REG], cpu_sysr[1], 0x100);
+    tcg_gen_addi_i32(cpu_r[PC_REG], evba, 0x100);
 
     gen_set_label(exit);
     ctx->base.is_jmp = DISAS_JUMP;
@@ -3332,6 +3929,7 @@ static bool trans_SCALL(DisasContext *ctx, arg_SCALL *a){
 
 
 static bool trans_SCR(DisasContext *ctx, arg_SCR *a){
+    gen_flush_flags(ctx);
     TCGv res = tcg_temp_new_i32();
     TCGv res31 = tcg_temp_new_i32();
     TCGv rd31 = tcg_temp_new_i32();
@@ -3359,33 +3957,78 @@ static bool trans_SCR(DisasContext *ctx, arg_SCR *a){
     return true;
 }
 
-//TODO: implement
+// Halt until an interrupt, see helper_sleep()
 static bool trans_SLEEP(DisasContext *ctx, arg_SLEEP *a)
 {
-    return false;
+    // op8[7] set: SR[GM] is cleared atomically with entering sleep
+    if(a->op8 & 0x80){
+        tcg_gen_andi_i32(cpu_sr, cpu_sr, ~AVR32_SR_GM);
+    }
+
+    ctx->base.pc_next += 4;
+    tcg_gen_movi_tl(cpu_r[PC_REG], ctx->base.pc_next);
+    gen_helper_sleep(cpu_env);
+    ctx->base.is_jmp = DISAS_NORETURN;
+    return true;
 }
 
 static bool trans_SR(DisasContext *ctx, arg_SR *a){
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
+    DisasCompare c;
 
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_r[a->rd], reg, val);
+    gen_prepare_cond(ctx, a->cond4, &c);
+    tcg_gen_setcond_i32(c.cond, cpu_r[a->rd], c.v1, c.v2);
 
     ctx->base.pc_next += 2;
     return true;
 }
 
 static bool trans_SSRF(DisasContext *ctx, arg_SSRF *a){
-    tcg_gen_movi_i32(cpu_sflags[a->bp5], 0x1);
+    if(a->bp5 < AVR32_SR_SPLIT_FLAGS){
+        gen_flush_flags(ctx);
+        tcg_gen_movi_i32(cpu_sflags[a->bp5], 0x1);
+    }
+    else{
+        tcg_gen_ori_i32(cpu_sr, cpu_sr, 1u << a->bp5);
+    }
 
     ctx->base.pc_next += 2;
     return true;
 }
 
+static bool trans_STC_D(DisasContext *ctx, arg_STC_D *a){
+    TCGv ptr = tcg_temp_new_i32();
+    TCGv_i64 t = tcg_temp_new_i64();
+
+    if (a->cp != AVR32_FPU_CP) {
+        return false;
+    }
+    tcg_gen_addi_i32(ptr, cpu_r[a->rp], a->disp << 2);
+    gen_ld_fpr_d(t, a->cr3 * 2);
+    tcg_gen_qemu_st_i64(t, ptr, ctx->mem_idx, MO_BEUQ);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
+static bool trans_STC_W(DisasContext *ctx, arg_STC_W *a){
+    TCGv ptr = tcg_temp_new_i32();
+    TCGv t = tcg_temp_new_i32();
+
+    if (a->cp != AVR32_FPU_CP) {
+        return false;
+    }
+    tcg_gen_addi_i32(ptr, cpu_r[a->rp], a->disp << 2);
+    gen_ld_fpr(t, a->cr);
+    tcg_gen_qemu_st_i32(t, ptr, ctx->mem_idx, MO_BEUL);
+
+    ctx->base.pc_next += 4;
+    return true;
+}
+
 static bool trans_STB_f1(DisasContext *ctx, arg_STB_f1 *a){
     TCGv ptr = cpu_r[a->rp];
     TCGv rs = cpu_r[a->rs];
-    tcg_gen_qemu_st_tl(rs, ptr, 0, MO_UB);
+    tcg_gen_qemu_st_tl(rs, ptr, ctx->mem_idx, MO_UB);
     tcg_gen_addi_i32(cpu_r[a->rp], cpu_r[a->rp], 1);
 
     ctx->base.pc_next += 2;
@@ -3396,7 +4039,7 @@ static bool trans_STB_f2(DisasContext *ctx, arg_STB_f2 *a){
     TCGv ptr = cpu_r[a->rp];
     TCGv rs = cpu_r[a->rs];
     tcg_gen_subi_i32(ptr, ptr, 0x1);
-    tcg_gen_qemu_st_tl(rs, ptr, 0, MO_UB);
+    tcg_gen_qemu_st_tl(rs, ptr, ctx->mem_idx, MO_UB);
 
     ctx->base.pc_next += 2;
     return true;
@@ -3408,7 +4051,7 @@ static bool trans_STB_f3(DisasContext *ctx, arg_STB_f3 *a){
     tcg_gen_addi_i32(ptr, cpu_r[a->rp], a->disp3);
     TCGv rs = cpu_r[a->rd];
 
-    tcg_gen_qemu_st_tl(rs, ptr, 0, MO_UB);
+    tcg_gen_qemu_st_tl(rs, ptr, ctx->mem_idx, MO_UB);
 
     ctx->base.pc_next += 2;
     return true;
@@ -3423,7 +4066,7 @@ static bool trans_STB_f4(DisasContext *ctx, arg_STB_f4 *a){
     tcg_gen_addi_i32(ptr, cpu_r[a->rp], disp);
     TCGv rs = cpu_r[a->rs];
 
-    tcg_gen_qemu_st_tl(rs, ptr, 0, MO_UB);
+    tcg_gen_qemu_st_tl(rs, ptr, ctx->mem_idx, MO_UB);
 
     ctx->base.pc_next += 4;
     return true;
@@ -3434,7 +4077,7 @@ static bool trans_STB_f5(DisasContext *ctx, arg_STB_f5 *a){
     tcg_gen_shli_i32(ptr, cpu_r[a->ry], a->sa);
     tcg_gen_add_i32(ptr, ptr, cpu_r[a->rx]);
 
-    tcg_gen_qemu_st_tl(cpu_r[a->rd], ptr, 0, MO_UB);
+    tcg_gen_qemu_st_tl(cpu_r[a->rd], ptr, ctx->mem_idx, MO_UB);
 
     ctx->base.pc_next += 4;
     return true;
@@ -3443,13 +4086,11 @@ static bool trans_STB_f5(DisasContext *ctx, arg_STB_f5 *a){
 static bool trans_STBc(DisasContext *ctx, arg_STBc *a){
     TCGLabel *exit = gen_new_label();
 
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, exit);
+    gen_brcond_false(ctx, a->cond4, exit);
 
     TCGv ptr = tcg_temp_new_i32();
     tcg_gen_addi_i32(ptr, cpu_r[a->rp], a->disp9);
-    tcg_gen_qemu_st_tl(cpu_r[a->rd], ptr, 0, MO_UB);
+    tcg_gen_qemu_st_tl(cpu_r[a->rd], ptr, ctx->mem_idx, MO_UB);
 
     gen_set_label(exit);
     ctx->base.pc_next += 4;
@@ -3461,9 +4102,9 @@ static bool trans_STD_f1(DisasContext *ctx, arg_STD_f1 *a){
     TCGv rs = cpu_r[a->rs*2];
     TCGv rsp = cpu_r[a->rs*2 + 1];
 
-    tcg_gen_qemu_st_i32(rsp, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_st_i32(rsp, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(ptr, ptr, 4);
-    tcg_gen_qemu_st_i32(rs, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_st_i32(rs, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(ptr, ptr, 4);
 
     ctx->base.pc_next += 2;
@@ -3477,9 +4118,9 @@ static bool trans_STD_f2(DisasContext *ctx, arg_STD_f2 *a){
     TCGv rsp = cpu_r[a->rs*2 + 1];
 
     tcg_gen_subi_i32(ptr, ptr, 0x4);
-    tcg_gen_qemu_st_i32(rs, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_st_i32(rs, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_subi_i32(ptr, ptr, 0x4);
-    tcg_gen_qemu_st_i32(rsp, ptr, 0, MO_BEUL);
+    tcg_gen_qemu_st_i32(rsp, ptr, ctx->mem_idx, MO_BEUL);
 
     ctx->base.pc_next += 2;
     return true;
@@ -3493,9 +4134,9 @@ static bool trans_STD_f3(DisasContext *ctx, arg_STD_f3 *a){
 
     tcg_gen_mov_i32(ptr, cpu_r[a->rp]);
 
-    tcg_gen_qemu_st_tl(rsp, ptr, 0x0, MO_BEUL);
+    tcg_gen_qemu_st_tl(rsp, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_tl(ptr, ptr, 4);
-    tcg_gen_qemu_st_i32(rs, ptr, 0x0, MO_BEUL);
+    tcg_gen_qemu_st_i32(rs, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(ptr, ptr, 4);
 
     ctx->base.pc_next += 4;
@@ -3518,9 +4159,9 @@ static bool trans_STD_f4(DisasContext *ctx, arg_STD_f4 *a){
     tcg_gen_movi_i32(disp, dispI);
     tcg_gen_add_i32(ptr, cpu_r[a->rp], disp);
 
-    tcg_gen_qemu_st_tl(rsp, ptr, 0x0, MO_BEUL);
+    tcg_gen_qemu_st_tl(rsp, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_tl(ptr, ptr, 4);
-    tcg_gen_qemu_st_i32(rs, ptr, 0x0, MO_BEUL);
+    tcg_gen_qemu_st_i32(rs, ptr, ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(ptr, ptr, 4);
 
     ctx->base.pc_next += 4;
@@ -3530,7 +4171,7 @@ static bool trans_STD_f4(DisasContext *ctx, arg_STD_f4 *a){
 //TODO: Add STD format 5.
 
 static bool trans_STH_f1(DisasContext *ctx, arg_STH_f1 *a){
-    tcg_gen_qemu_st_tl(cpu_r[a->rs], cpu_r[a->rp], 0x0, MO_BEUW);
+    tcg_gen_qemu_st_tl(cpu_r[a->rs], cpu_r[a->rp], ctx->mem_idx, MO_BEUW);
     tcg_gen_addi_i32(cpu_r[a->rp], cpu_r[a->rp], 2);
 
     ctx->base.pc_next += 2;
@@ -3539,7 +4180,7 @@ static bool trans_STH_f1(DisasContext *ctx, arg_STH_f1 *a){
 
 static bool trans_STH_f2(DisasContext *ctx, arg_STH_f2 *a){
     tcg_gen_subi_i32(cpu_r[a->rp], cpu_r[a->rp], 2);
-    tcg_gen_qemu_st_tl(cpu_r[a->rs], cpu_r[a->rp], 0x0, MO_BEUW);
+    tcg_gen_qemu_st_tl(cpu_r[a->rs], cpu_r[a->rp], ctx->mem_idx, MO_BEUW);
 
     ctx->base.pc_next += 2;
     return true;
@@ -3549,7 +4190,7 @@ static bool trans_STH_f3(DisasContext *ctx, arg_STH_f3 *a){
     TCGv addr = tcg_temp_new_i32();
     tcg_gen_addi_i32(addr, cpu_r[a->rp], a->disp3 << 1);
 
-    tcg_gen_qemu_st_tl(cpu_r[a->rd], addr, 0x0, MO_BEUW);
+    tcg_gen_qemu_st_tl(cpu_r[a->rd], addr, ctx->mem_idx, MO_BEUW);
 
     ctx->base.pc_next += 2;
     return true;
@@ -3564,7 +4205,7 @@ static bool trans_STH_f4(DisasContext *ctx, arg_STH_f4 *a){
     tcg_gen_addi_i32(addr, cpu_r[a->rp], disp);
     TCGv rs = cpu_r[a->rs];
 
-    tcg_gen_qemu_st_tl(rs, addr, 0x0, MO_BEUW);
+    tcg_gen_qemu_st_tl(rs, addr, ctx->mem_idx, MO_BEUW);
 
 
     ctx->base.pc_next += 4;
@@ -3577,7 +4218,7 @@ static bool trans_STH_f5(DisasContext *ctx, arg_STH_f5 *a){
     tcg_gen_add_i32(addr, addr, cpu_r[a->rx]);
     TCGv rs = cpu_r[a->rd];
 
-    tcg_gen_qemu_st_tl(rs, addr, 0x0, MO_BEUW);
+    tcg_gen_qemu_st_tl(rs, addr, ctx->mem_idx, MO_BEUW);
 
 
     ctx->base.pc_next += 4;
@@ -3587,13 +4228,11 @@ static bool trans_STH_f5(DisasContext *ctx, arg_STH_f5 *a){
 static bool trans_STHc(DisasContext *ctx, arg_STHc *a){
     TCGLabel *exit = gen_new_label();
 
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, exit);
+    gen_brcond_false(ctx, a->cond4, exit);
 
     TCGv ptr = tcg_temp_new_i32();
     tcg_gen_addi_i32(ptr, cpu_r[a->rp], a->disp9 << 1);
-    tcg_gen_qemu_st_tl(cpu_r[a->rd], ptr, 0x0, MO_BEUW);
+    tcg_gen_qemu_st_tl(cpu_r[a->rd], ptr, ctx->mem_idx, MO_BEUW);
 
     gen_set_label(exit);
     ctx->base.pc_next += 4;
@@ -3612,34 +4251,29 @@ static bool trans_STDSP(DisasContext *ctx, arg_STDSP *a){
 
     tcg_gen_add_i32(ptr, ptr, disp);
 
-    tcg_gen_qemu_st_i32(cpu_r[a->rd], ptr, 0x0, MO_BEUL);
+    tcg_gen_qemu_st_i32(cpu_r[a->rd], ptr, ctx->mem_idx, MO_BEUL);
 
     ctx->base.pc_next += 2;
     return true;
 }
 
 static bool trans_STM(DisasContext *ctx, arg_STM *a){
-    int regFlag = 0;
-    TCGv addr = tcg_temp_new_i32();
-    tcg_gen_mov_i32(addr, cpu_r[a->rp]);
-    if(a->op == 1){
-        for (int i = 0; i <= 15; i++){
-            regFlag = a->list >> i & 1;
-            if(regFlag == 1){
-                tcg_gen_subi_i32(addr, addr, 0x4);
-                tcg_gen_qemu_st_tl(cpu_r[i], addr, 0x00, MO_BEUL);
-            }
+    TCGv vals[16];
+    int n = 0;
+
+    for (int i = 0; i <= 15; i++){
+        if(((a->list >> i) & 1) == 1){
+            vals[n++] = cpu_r[i];
         }
-        tcg_gen_mov_i32(cpu_r[a->rp], addr);
+    }
+
+    if(a->op == 1){
+        // --Rp, R0 ends up at the highest address
+        gen_st_multi(ctx, cpu_r[a->rp], vals, n, -4, -4);
+        tcg_gen_subi_i32(cpu_r[a->rp], cpu_r[a->rp], 4 * n);
     }
     else{
-        for (int i = 0; i <= 15; i++){
-            regFlag = a->list >> i & 1;
-            if(regFlag == 1){
-                tcg_gen_qemu_st_tl(cpu_r[i], addr, 0x00, MO_BEUL);
-                tcg_gen_addi_i32(addr, addr, 0x4);
-            }
-        }
+        gen_st_multi(ctx, cpu_r[a->rp], vals, n, 0, 4);
     }
 
     ctx->base.pc_next += 4;
@@ -3647,7 +4281,7 @@ static bool trans_STM(DisasContext *ctx, arg_STM *a){
 }
 
 static bool trans_STW_f1(DisasContext *ctx, arg_STW_f1 *a){
-    tcg_gen_qemu_st_tl(cpu_r[a->rs], cpu_r[a->rp], 0, MO_BEUL);
+    tcg_gen_qemu_st_tl(cpu_r[a->rs], cpu_r[a->rp], ctx->mem_idx, MO_BEUL);
     tcg_gen_addi_i32(cpu_r[a->rp], cpu_r[a->rp], 4);
 
     ctx->base.pc_next += 2;
@@ -3656,7 +4290,7 @@ static bool trans_STW_f1(DisasContext *ctx, arg_STW_f1 *a){
 
 static bool trans_STW_f2(DisasContext *ctx, arg_STW_f2 *a){
     tcg_gen_subi_i32(cpu_r[a->rp], cpu_r[a->rp], 4);
-    tcg_gen_qemu_st_tl(cpu_r[a->rs], cpu_r[a->rp], 0, MO_BEUL);
+    tcg_gen_qemu_st_tl(cpu_r[a->rs], cpu_r[a->rp], ctx->mem_idx, MO_BEUL);
 
     ctx->base.pc_next += 2;
     return true;
@@ -3665,7 +4299,7 @@ static bool trans_STW_f2(DisasContext *ctx, arg_STW_f2 *a){
 static bool trans_STW_f3(DisasContext *ctx, arg_STW_f3 *a){
     TCGv addr = tcg_temp_new_i32();
     tcg_gen_addi_i32(addr, cpu_r[a->rp], a->disp4<<2);
-    tcg_gen_qemu_st_tl(cpu_r[a->rs], addr, 0, MO_BEUL);
+    tcg_gen_qemu_st_tl(cpu_r[a->rs], addr, ctx->mem_idx, MO_BEUL);
 
     ctx->base.pc_next += 2;
     return true;
@@ -3682,7 +4316,7 @@ static bool trans_STW_f4(DisasContext *ctx, arg_STW_f4 *a){
     TCGv addr = tcg_temp_new_i32();
     tcg_gen_addi_i32(addr, cpu_r[a->rp], disp);
 
-    tcg_gen_qemu_st_tl(cpu_r[a->rs], addr, 0, MO_BEUL);
+    tcg_gen_qemu_st_tl(cpu_r[a->rs], addr, ctx->mem_idx, MO_BEUL);
 
     ctx->base.pc_next += 4;
     return true;
@@ -3693,7 +4327,7 @@ static bool trans_STW_f5(DisasContext *ctx, arg_STW_f5 *a){
     tcg_gen_shli_i32(addr, cpu_r[a->ry], a->sa);
     tcg_gen_add_i32(addr, addr, cpu_r[a->rx]);
 
-    tcg_gen_qemu_st_tl(cpu_r[a->rd], addr, 0, MO_BEUL);
+    tcg_gen_qemu_st_tl(cpu_r[a->rd], addr, ctx->mem_idx, MO_BEUL);
 
     ctx->base.pc_next += 4;
     return true;
@@ -3702,13 +4336,10 @@ static bool trans_STW_f5(DisasContext *ctx, arg_STW_f5 *a){
 static bool trans_STWcond(DisasContext *ctx, arg_STWcond *a){
     TCGLabel *leave = gen_new_label();
 
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
-
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, leave);
+    gen_brcond_false(ctx, a->cond4, leave);
     TCGv addr = tcg_temp_new_i32();
     tcg_gen_addi_i32(addr, cpu_r[a->rp], a->disp9 <<2 );
-    tcg_gen_qemu_st_tl(cpu_r[a->rd], addr, 0, MO_BEUL);
+    tcg_gen_qemu_st_tl(cpu_r[a->rd], addr, ctx->mem_idx, MO_BEUL);
 
     gen_set_label(leave);
 
@@ -3717,43 +4348,11 @@ static bool trans_STWcond(DisasContext *ctx, arg_STWcond *a){
 }
 
 static bool trans_SUB_f1(DisasContext *ctx, arg_SUB_f1 *a){
-    TCGv op1 = tcg_temp_new_i32();
-    TCGv op2 = tcg_temp_new_i32();
-    tcg_gen_mov_i32(op1, cpu_r[a->rd]);
-    tcg_gen_mov_i32(op2, cpu_r[a->rs]);
-
-    TCGv left = tcg_temp_new_i32();
-    TCGv middel = tcg_temp_new_i32();
-    TCGv right = tcg_temp_new_i32();
     TCGv res = tcg_temp_new_i32();
-    tcg_gen_sub_i32(res, op1, op2);
-    tcg_gen_mov_i32(cpu_r[a->rd], res);
-
-    // Z-Flag
-    tcg_gen_setcondi_tl(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0); // Zf = Res == 0
-
-    tcg_gen_shri_i32(res, res, 31);
-    tcg_gen_shri_i32(op1, op1, 31);
-    tcg_gen_shri_i32(op2, op2, 31);
-
-    //V-Flag
-    tcg_gen_andc_i32(left, op1, op2);
-    tcg_gen_andc_i32(left, left, res);
-    tcg_gen_and_i32(right, op2, res);
-    tcg_gen_andc_i32(right, right, op1);
-    tcg_gen_or_i32(cpu_sflags[sflagV], left, right);
-
-    //N-Flag
-    tcg_gen_mov_i32(cpu_sflags[sflagN], res);
-
-    //C-Flag
-    tcg_gen_andc_i32(left, op2, op1);
-    tcg_gen_and_i32(middel, op2, res);
-    tcg_gen_andc_i32(right, res, op1);
-
-    tcg_gen_or_i32(left, left, middel);
-    tcg_gen_or_i32(cpu_sflags[sflagC], left, right);
 
+    tcg_gen_sub_i32(res, cpu_r[a->rd], cpu_r[a->rs]);
+    gen_sub_cc(ctx, res, cpu_r[a->rd], cpu_r[a->rs]);
+    tcg_gen_mov_i32(cpu_r[a->rd], res);
 
     ctx->base.pc_next += 2;
     return true;
@@ -3761,94 +4360,34 @@ static bool trans_SUB_f1(DisasContext *ctx, arg_SUB_f1 *a){
 
 static bool trans_SUB_f2(DisasContext *ctx, arg_SUB_f2 *a){
     //Format 2
-    TCGv op1 = tcg_temp_new_i32();
     TCGv op2 = tcg_temp_new_i32();
-    tcg_gen_shli_i32(op2, cpu_r[a->ry], a->sa);
-
-    tcg_gen_mov_i32(op1, cpu_r[a->rx]);
-
-    TCGv left = tcg_temp_new_i32();
-    TCGv middel = tcg_temp_new_i32();
-    TCGv right = tcg_temp_new_i32();
     TCGv res = tcg_temp_new_i32();
-    tcg_gen_sub_i32(res, op1, op2);
-    tcg_gen_sub_i32(cpu_r[a->rd], op1, op2);
-
-    tcg_gen_setcondi_tl(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0); // Zf = Res == 0
-
-    tcg_gen_shri_i32(res, res, 31);
-    tcg_gen_shri_i32(op1, op1, 31);
-    tcg_gen_shri_i32(op2, op2, 31);
-
-    //V-Flag
-    tcg_gen_andc_i32(left, op1, op2);
-    tcg_gen_andc_i32(left, left, res);
-    tcg_gen_and_i32(right, op2, res);
-    tcg_gen_andc_i32(right, right, op1);
-    tcg_gen_or_i32(cpu_sflags[sflagV], left, right);
-
-    //N-Flag
-    tcg_gen_mov_i32(cpu_sflags[sflagN], res);
 
-    //C-Flag
-    tcg_gen_andc_i32(left, op2, op1);
-    tcg_gen_and_i32(middel, op2, res);
-    tcg_gen_andc_i32(right, res, op1);
-
-    tcg_gen_or_i32(left, left, middel);
-    tcg_gen_or_i32(cpu_sflags[sflagC], left, right);
+    tcg_gen_shli_i32(op2, cpu_r[a->ry], a->sa);
+    tcg_gen_sub_i32(res, cpu_r[a->rx], op2);
+    gen_sub_cc(ctx, res, cpu_r[a->rx], op2);
+    tcg_gen_mov_i32(cpu_r[a->rd], res);
 
     ctx->base.pc_next += 4;
     return true;
 }
 
 static bool trans_SUB_f3(DisasContext *ctx, arg_SUB_f3 *a){
-    TCGv op1 = tcg_temp_new_i32();
-    TCGv op2 = tcg_temp_new_i32();
-    tcg_gen_mov_i32(op1, cpu_r[a->rd]);
-
+    int imm;
     if(a->rd == SP_REG){
-        int imm = a->imm8 << 2;
+        imm = a->imm8 << 2;
         if((imm >> 9) == 1){
             imm |= 0xFFFFFC00;
         }
-        tcg_gen_movi_i32(op2, imm);
     }
     else{
-        int imm = sign_extend_8(a->imm8);
-        tcg_gen_movi_i32(op2, imm);
+        imm = sign_extend_8(a->imm8);
     }
 
-    TCGv left = tcg_temp_new_i32();
-    TCGv middel = tcg_temp_new_i32();
-    TCGv right = tcg_temp_new_i32();
     TCGv res = tcg_temp_new_i32();
-    tcg_gen_sub_i32(res, op1, op2);
+    tcg_gen_subi_i32(res, cpu_r[a->rd], imm);
+    gen_sub_cc(ctx, res, cpu_r[a->rd], tcg_constant_i32(imm));
     tcg_gen_mov_i32(cpu_r[a->rd], res);
-    tcg_gen_setcondi_tl(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0); // Zf = Res == 0
-
-
-    tcg_gen_shri_i32(res, res, 31);
-    tcg_gen_shri_i32(op1, op1, 31);
-    tcg_gen_shri_i32(op2, op2, 31);
-
-    //V-Flag
-    tcg_gen_andc_i32(left, op1, op2);
-    tcg_gen_andc_i32(left, left, res);
-    tcg_gen_and_i32(right, op2, res);
-    tcg_gen_andc_i32(right, right, op1);
-    tcg_gen_or_i32(cpu_sflags[sflagV], left, right);
-
-    //N-Flag
-    tcg_gen_mov_i32(cpu_sflags[sflagN], res);
-
-    //C-Flag
-    tcg_gen_andc_i32(left, op2, op1);
-    tcg_gen_and_i32(middel, op2, res);
-    tcg_gen_andc_i32(right, res, op1);
-
-    tcg_gen_or_i32(left, left, middel);
-    tcg_gen_or_i32(cpu_sflags[sflagC], left, right);
 
     ctx->base.pc_next += 2;
     return true;
@@ -3864,41 +4403,10 @@ static bool trans_SUB_f4(DisasContext *ctx, arg_SUB_f4 *a){
         imm |= 0xFFF00000;
     }
 
-    TCGv op1 = tcg_temp_new_i32();
-    TCGv op2 = tcg_temp_new_i32();
-    tcg_gen_mov_i32(op1, cpu_r[a->rd]);
-    tcg_gen_movi_i32(op2, imm);
-
-    TCGv left = tcg_temp_new_i32();
-    TCGv middel = tcg_temp_new_i32();
-    TCGv right = tcg_temp_new_i32();
     TCGv res = tcg_temp_new_i32();
-    tcg_gen_sub_i32(res, op1, op2);
-    tcg_gen_sub_i32(cpu_r[a->rd], op1, op2);
-    tcg_gen_setcondi_tl(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0); // Zf = Res == 0
-
-    tcg_gen_shri_i32(res, res, 31);
-    tcg_gen_shri_i32(op1, op1, 31);
-    tcg_gen_shri_i32(op2, op2, 31);
-
-    //V-Flag
-    tcg_gen_andc_i32(left, op1, op2);
-    tcg_gen_andc_i32(left, left, res);
-    tcg_gen_and_i32(right, op2, res);
-    tcg_gen_andc_i32(right, right, op1);
-    tcg_gen_or_i32(cpu_sflags[sflagV], left, right);
-
-    //N-Flag
-    tcg_gen_mov_i32(cpu_sflags[sflagN], res);
-
-    //C-Flag
-    tcg_gen_andc_i32(left, op2, op1);
-    tcg_gen_and_i32(middel, op2, res);
-    tcg_gen_andc_i32(right, res, op1);
-
-    tcg_gen_or_i32(left, left, middel);
-    tcg_gen_or_i32(cpu_sflags[sflagC], left, right);
-
+    tcg_gen_subi_i32(res, cpu_r[a->rd], imm);
+    gen_sub_cc(ctx, res, cpu_r[a->rd], tcg_constant_i32(imm));
+    tcg_gen_mov_i32(cpu_r[a->rd], res);
 
     ctx->base.pc_next += 4;
     return true;
@@ -3912,40 +4420,10 @@ static bool trans_SUB_f5(DisasContext *ctx, arg_SUB_f5 *a){
         imm = imm|0xFFFF0000;
     }
 
-    TCGv op1 = tcg_temp_new_i32();
-    TCGv op2 = tcg_temp_new_i32();
-    tcg_gen_mov_i32(op1, cpu_r[a->rs]);
-    tcg_gen_movi_i32(op2, imm);
-
-    TCGv left = tcg_temp_new_i32();
-    TCGv middel = tcg_temp_new_i32();
-    TCGv right = tcg_temp_new_i32();
     TCGv res = tcg_temp_new_i32();
-    tcg_gen_sub_i32(res, op1, op2);
-    tcg_gen_sub_i32(cpu_r[a->rd], op1, op2);
-    tcg_gen_setcondi_tl(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0); // Zf = Res == 0
-
-    tcg_gen_shri_i32(res, res, 31);
-    tcg_gen_shri_i32(op1, op1, 31);
-    tcg_gen_shri_i32(op2, op2, 31);
-
-    //V-Flag
-    tcg_gen_andc_i32(left, op1, op2);
-    tcg_gen_andc_i32(left, left, res);
-    tcg_gen_and_i32(right, op2, res);
-    tcg_gen_andc_i32(right, right, op1);
-    tcg_gen_or_i32(cpu_sflags[sflagV], left, right);
-
-    //N-Flag
-    tcg_gen_mov_i32(cpu_sflags[sflagN], res);
-
-    //C-Flag
-    tcg_gen_andc_i32(left, op2, op1);
-    tcg_gen_and_i32(middel, op2, res);
-    tcg_gen_andc_i32(right, res, op1);
-
-    tcg_gen_or_i32(left, left, middel);
-    tcg_gen_or_i32(cpu_sflags[sflagC], left, right);
+    tcg_gen_subi_i32(res, cpu_r[a->rs], imm);
+    gen_sub_cc(ctx, res, cpu_r[a->rs], tcg_constant_i32(imm));
+    tcg_gen_mov_i32(cpu_r[a->rd], res);
 
     ctx->base.pc_next += 4;
     return true;
@@ -3953,74 +4431,67 @@ static bool trans_SUB_f5(DisasContext *ctx, arg_SUB_f5 *a){
 
 //TODO: check if f needs to be set or not, as manual has contradictory statements
 static bool trans_SUBc_f1(DisasContext *ctx, arg_SUBc_f1 *a){
-    TCGLabel *if1 = gen_new_label();
-    TCGLabel *exit = gen_new_label();
-
+    DisasCompare c;
     TCGv rd = tcg_temp_new_i32();
+    TCGv k = tcg_constant_i32(sign_extend_8(a->imm8));
     TCGv res = tcg_temp_new_i32();
-    TCGv left = tcg_temp_new_i32();
-    TCGv right = tcg_temp_new_i32();
-    TCGv k = tcg_temp_new_i32();
 
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, exit);
-
-    // if
-    gen_set_label(if1);
-    tcg_gen_subi_i32(res, cpu_r[a->rd], a->imm8);
-    tcg_gen_mov_i32(rd, cpu_r[a->rd]);
-    tcg_gen_movi_i32(k, sign_extend_8(a->imm8));
-    tcg_gen_mov_i32(cpu_r[a->rd], res);
+    if(a->f == 0){
+        gen_prepare_cond(ctx, a->cond4, &c);
+        tcg_gen_sub_i32(res, cpu_r[a->rd], k);
+        gen_movcond_rd(ctx, &c, a->rd, res, 4);
 
-    if(a->f == 1){
-        //z-flag
-        tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0);
-        //n-flag
-        tcg_gen_shri_i32(res, res, 31);
-        tcg_gen_mov_i32(cpu_sflags[sflagN], res);
+        ctx->base.pc_next += 4;
+        return true;
+    }
 
-        //v-flag
-        tcg_gen_shri_i32(rd, rd, 31);
-        tcg_gen_shri_i32(k, k, 31);
+    // The flags are only updated if the condition holds
+    TCGv take = tcg_temp_new_i32();
+    TCGv t = tcg_temp_new_i32();
 
-        tcg_gen_andc_i32(left, rd, k);
-        tcg_gen_andc_i32(left, left, res);
-        tcg_gen_andc_i32(right, k, rd);
-        tcg_gen_and_i32(right, right, res);
-        tcg_gen_or_i32(cpu_sflags[sflagV], left, right);
+    gen_flush_flags(ctx);
+    gen_prepare_cond(ctx, a->cond4, &c);
+    tcg_gen_setcond_i32(c.cond, take, c.v1, c.v2);
 
-        //c-flag
-        tcg_gen_andc_i32(left, k, rd);
-        tcg_gen_and_i32(right, k, res);
-        tcg_gen_or_i32(left, left, right);
-        tcg_gen_andc_i32(right, res, rd);
-        tcg_gen_or_i32(cpu_sflags[sflagC], left, right);
-    }
+    tcg_gen_mov_i32(rd, cpu_r[a->rd]);
+    tcg_gen_sub_i32(res, rd, k);
+
+    c.cond = TCG_COND_NE;
+    c.v1 = take;
+    c.v2 = tcg_constant_i32(0);
+
+    tcg_gen_setcondi_i32(TCG_COND_EQ, t, res, 0);
+    tcg_gen_movcond_i32(TCG_COND_NE, cpu_sflags[sflagZ], take, c.v2, t, cpu_sflags[sflagZ]);
+    tcg_gen_shri_i32(t, res, 31);
+    tcg_gen_movcond_i32(TCG_COND_NE, cpu_sflags[sflagN], take, c.v2, t, cpu_sflags[sflagN]);
+    tcg_gen_setcond_i32(TCG_COND_LTU, t, rd, k);
+    tcg_gen_movcond_i32(TCG_COND_NE, cpu_sflags[sflagC], take, c.v2, t, cpu_sflags[sflagC]);
+    tcg_gen_xor_i32(t, rd, k);
+    tcg_gen_xor_i32(rd, rd, res);
+    tcg_gen_and_i32(t, t, rd);
+    tcg_gen_shri_i32(t, t, 31);
+    tcg_gen_movcond_i32(TCG_COND_NE, cpu_sflags[sflagV], take, c.v2, t, cpu_sflags[sflagV]);
+
+    gen_movcond_rd(ctx, &c, a->rd, res, 4);
 
-    gen_set_label(exit);
     ctx->base.pc_next += 4;
     return true;
 }
 
 static bool trans_SUBc_f2(DisasContext *ctx, arg_SUBc_f2 *a){
-    TCGLabel *if1 = gen_new_label();
-    TCGLabel *exit = gen_new_label();
-
-    TCGv reg = tcg_temp_new_i32();
-    int val = checkCondition(a->cond4, reg, cpu_r, cpu_sflags);
-    tcg_gen_brcondi_i32(TCG_COND_NE, reg, val, exit);
+    DisasCompare c;
+    TCGv res = tcg_temp_new_i32();
 
-    // if
-    gen_set_label(if1);
-    tcg_gen_sub_i32(cpu_r[a->rd], cpu_r[a->rx], cpu_r[a->ry]);
+    gen_prepare_cond(ctx, a->cond4, &c);
+    tcg_gen_sub_i32(res, cpu_r[a->rx], cpu_r[a->ry]);
+    gen_movcond_rd(ctx, &c, a->rd, res, 4);
 
-    gen_set_label(exit);
     ctx->base.pc_next += 4;
     return true;
 }
 
 static bool trans_TNBZ(DisasContext *ctx, arg_TNBZ *a){
+    gen_flush_flags(ctx);
     TCGv rdl = tcg_temp_new_i32();
     TCGv rdml = tcg_temp_new_i32();
     TCGv rdmr = tcg_temp_new_i32();
@@ -4056,12 +4527,50 @@ static bool trans_TNBZ(DisasContext *ctx, arg_TNBZ *a){
     return true;
 }
 
+// AVR32B TLB maintenance, privileged, operates on TLBEHI/TLBELO and MMUCR
+static bool trans_TLBR(DisasContext *ctx, arg_TLBR *a){
+    if (!ctx->avr32b) {
+        return false;
+    }
+    ctx->base.pc_next += 2;
+    if (!gen_check_priv(ctx)) {
+        return true;
+    }
+    gen_helper_tlbr(cpu_env);
+    return true;
+}
+
+static bool trans_TLBS(DisasContext *ctx, arg_TLBS *a){
+    if (!ctx->avr32b) {
+        return false;
+    }
+    ctx->base.pc_next += 2;
+    if (!gen_check_priv(ctx)) {
+        return true;
+    }
+    gen_helper_tlbs(cpu_env);
+    return true;
+}
+
+static bool trans_TLBW(DisasContext *ctx, arg_TLBW *a){
+    if (!ctx->avr32b) {
+        return false;
+    }
+    ctx->base.pc_next += 2;
+    if (!gen_check_priv(ctx)) {
+        return true;
+    }
+    gen_helper_tlbw(cpu_env);
+    // The entry may map the code that follows
+    gen_exit_after_insn(ctx);
+    return true;
+}
+
 static bool trans_TST(DisasContext *ctx, arg_TST *a){
     TCGv res = tcg_temp_new_i32();
     tcg_gen_and_i32(res, cpu_r[a->rd], cpu_r[a->rs]);
 
-    tcg_gen_setcondi_i32(TCG_COND_EQ, cpu_sflags[sflagZ], res, 0);
-    tcg_gen_shri_i32(cpu_sflags[sflagN], res, 31);
+    gen_logic_cc(ctx, res);
 
     ctx->base.pc_next += 2;
     return true;
@@ -4073,6 +4582,10 @@ static void avr32_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cs){
     ctx->env = env;
 
     ctx->pc = ctx->base.pc_first;
+    ctx->page_start = ctx->base.pc_first & TARGET_PAGE_MASK;
+    ctx->cc_op = CC_OP_DYNAMIC;
+    ctx->mem_idx = ctx->base.tb->flags & AVR32_TBFLAG_MMU_IDX;
+    ctx->avr32b = ctx->base.tb->flags & AVR32_TBFLAG_AVR32B;
 }
 
 static void avr32_tr_tb_start(DisasContextBase *db, CPUState *cs){
@@ -4084,16 +4597,53 @@ static void avr32_tr_insn_start(DisasContextBase *dcbase, CPUState *cs){
     tcg_gen_insn_start(ctx->base.pc_next);
 }
 
+/*
+ * PC is not written to env for every insn, insn_start records it for
+ * unwinding and exits store it explicitly. Insns that read r15 as a generic
+ * operand still need it, so check every register field position used by
+ * the formats: [28:25], [19:16] (register pairs at [19:17]) and [3:0] for
+ * extended insns, plus the PC bit of the STM register list. False
+ * positives only cost a store.
+ */
+static bool insn_may_read_pc(uint32_t insn){
+    if (extract32(insn, 25, 4) == PC_REG || extract32(insn, 17, 3) == 7) {
+        return true;
+    }
+    if ((insn >> 29) != 7) {
+        return false;
+    }
+    if (extract32(insn, 0, 4) == PC_REG) {
+        return true;
+    }
+    // STM, list[15] is PC
+    return (insn & 0xfdf00000) == 0xe9c00000 && extract32(insn, 15, 1);
+}
+
 static void avr32_tr_translate_insn(DisasContextBase *dcbase, CPUState *cs){
     DisasContext *ctx = container_of(dcbase, DisasContext, base);
     uint32_t insn;
 
-    tcg_gen_movi_tl(cpu_r[PC_REG], ctx->base.pc_next);
-
     insn = decode_insn_load(ctx);
+    if (insn_may_read_pc(insn)) {
+        tcg_gen_movi_tl(cpu_r[PC_REG], ctx->base.pc_next);
+    }
     if (!decode_insn(ctx, insn)) {
-        error_report("[AVR32-TCG] avr32_tr_translate_insn, illegal instr, pc: 0x%04x\n", ctx->base.pc_next);
+        qemu_log_mask(LOG_GUEST_ERROR, "[AVR32-TCG] illegal instr 0x%08x, "
+                      "pc: 0x%08x\n", insn, (uint32_t)ctx->base.pc_next);
+        // Vectored through EVBA + 0x020 with PC still at the insn
         gen_helper_raise_illegal_instruction(cpu_env);
+        ctx->base.is_jmp = DISAS_NORETURN;
+        // Keep the TB from being empty, the insn itself is never executed
+        ctx->base.pc_next += 2;
+    }
+
+    /*
+     * A TB may only span two pages. An insn starting in the first page may
+     * straddle into the second one, but no insn may start there.
+     */
+    if (ctx->base.is_jmp == DISAS_NEXT &&
+        ctx->base.pc_next - ctx->page_start >= TARGET_PAGE_SIZE) {
+        ctx->base.is_jmp = DISAS_TOO_MANY;
     }
 }
 
@@ -4103,7 +4653,7 @@ static void avr32_tr_tb_stop(DisasContextBase *dcbase, CPUState *cs){
         case DISAS_NEXT:
             break;
         case DISAS_TOO_MANY:
-            gen_goto_tb(ctx, 1, ctx->base.pc_next);
+            gen_goto_tb(ctx, 0, ctx->base.pc_next);
             break;
         case DISAS_NORETURN:
             break;
@@ -4112,8 +4662,7 @@ static void avr32_tr_tb_stop(DisasContextBase *dcbase, CPUState *cs){
             break;
         case DISAS_CHAIN:
             gen_goto_tb(ctx, 1, ctx->base.pc_next);
-            tcg_gen_movi_tl(cpu_r[PC_REG], ctx->base.pc_next);
-            /* fall through */
+            break;
         case DISAS_EXIT:
             tcg_gen_exit_tb(NULL, 0);
             break;
@@ -4127,7 +4676,7 @@ static void avr32_tr_disas_log(const DisasContextBase *dcbase,
                              CPUState *cs, FILE *logfile)
 {
     fprintf(logfile, "IN: %s\n", lookup_symbol(dcbase->pc_first));
-    target_disas(logfile, cs, dcbase->pc_first, dcbase->tb->size);
+    avr32_disas_log(logfile, cs, dcbase->pc_first, dcbase->tb->size);
 }
 
 static const TranslatorOps avr32_tr_ops = {
@@ -0,0 +1,79 @@
+/*
+ * Shared definitions for the AVR32 bare-metal tests. The tests run on the
+ * avr32example-board, main returns 0 in r12 on success. AVR32_AP7000 is
+ * defined for the AVR32B tests on the avr32example-ap7000-board.
+ */
+
+/* Peripherals of the avr32example-board */
+#define USART0_BASE         0xffff1400
+#define USART_CR            0x00
+#define USART_CSR           0x14
+#define USART_THR           0x1c
+#define USART_CR_TXEN       0x40
+#define USART_CSR_TXRDY     0x02
+
+#define INTC_BASE           0xffff0800
+#define INTC_IPR(group)     (4 * (group))
+
+#define TESTDEV_BASE        0xfffef000
+#define TESTDEV_EXIT        0x00
+#define TESTDEV_RESET       0x04
+
+#ifdef AVR32_AP7000
+/* Flash and SRAM through the uncached P2 segment */
+#define FLASH_BASE          0xa0000000
+#define SRAM_BASE           0xa4000000
+#define SRAM_PHYS           0x24000000
+#define SRAM_END            0xa4008000
+#else
+#define FLASH_BASE          0xd0000000
+#define SRAM_BASE           0x00000000
+#define SRAM_END            0x00010000
+#endif
+#define FLASH_SIZE          0x00100000
+#define FLASH_PAGE_SIZE     512
+
+#define FLASHC_BASE         0xfffe1400
+#define FLASHC_FCMD         0x04
+#define FLASHC_FSR          0x08
+#define FCMD_WP             1
+#define FCMD_EP             2
+#define FCMD_CPB            3
+#define FCMD_PAGEN_SHIFT    8
+#define FCMD_KEY_HI         0xa500
+
+/* System registers, by address */
+#define SYSREG_EVBA         0x004
+#define SYSREG_ACBA         0x008
+#define SYSREG_COUNT        0x108
+#define SYSREG_COMPARE      0x10c
+#define SYSREG_TLBEHI       0x110
+#define SYSREG_TLBELO       0x114
+#define SYSREG_TLBEAR       0x11c
+#define SYSREG_MMUCR        0x120
+
+#define MMUCR_E             0x01
+#define MMUCR_S             0x10
+#define TLBELO_G            0x100
+#define TLBELO_AP_PRIV_RW   (2 << 4)
+#define TLBELO_SZ_4K        (1 << 2)
+#define TLBELO_D            0x02
+
+#define SR_GM_BIT           16
+
+/* Offsets from EVBA */
+#define EVBA_DTLB_MISS_R    0x060
+#define EVBA_SCALL          0x100
+#define EVBA_IRQ            0x104
+
+/* Load a 32 bit constant or address */
+#define LI(reg, val)        \
+    mov reg, lo(val);       \
+    orh reg, hi(val)
+
+/* r12 = 1 and branch to label unless reg == val, clobbers tmp */
+#define CHECK(reg, tmp, val, label) \
+    LI(tmp, val);                   \
+    mov r12, 1;                     \
+    cp.w reg, tmp;                  \
+    brne label
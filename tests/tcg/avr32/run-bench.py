@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+#
+# Run the AVR32 bare-metal tests as benchmarks
+#
+# Every test is run in three configurations, so no measurement disturbs
+# another:
+#
+#  - plain, for the wall clock time and the PASS/FAIL status
+#  - with the bb plugin, for executed instructions and translation blocks
+#  - with in_asm logging and the exec_tb_exit trace event, for the number
+#    of translations and of returns from generated code to the main loop
+#
+# The tests are deterministic apart from test_irq, whose interrupts are
+# paced by the virtual clock.
+#
+# MIPS divides the instruction count by the guest run time. That is the
+# wall time of the plain run minus the start-up time of QEMU, measured as
+# the fastest plain run of the --startup firmware, which returns from
+# main at once. Without --startup the wall time is used as is, which
+# understates MIPS for short tests.
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+
+MACHINE = 'avr32example-board'
+
+
+class Result:
+    def __init__(self, name):
+        self.name = name
+        self.passed = False
+        self.seconds = None
+        self.startup = 0.0
+        self.insns = None
+        self.blocks = None
+        self.tbs = None
+        self.exits = None
+
+    @property
+    def guest_seconds(self):
+        if self.seconds is None:
+            return None
+        return self.seconds - self.startup
+
+    @property
+    def mips(self):
+        guest = self.guest_seconds
+        if self.insns is None or guest is None or guest <= 0:
+            return None
+        return self.insns / guest / 1e6
+
+    @property
+    def exit_rate(self):
+        # Share of executed blocks that left generated code
+        if self.exits is None or not self.blocks:
+            return None
+        return self.exits / self.blocks
+
+    def as_dict(self):
+        return {
+            'passed': self.passed,
+            'seconds': self.seconds,
+            'guest_seconds': self.guest_seconds,
+            'insns': self.insns,
+            'mips': self.mips,
+            'tbs': self.tbs,
+            'exits': self.exits,
+            'exit_rate': self.exit_rate,
+        }
+
+
+def run_qemu(args, firmware, extra, tmpdir):
+    cmd = [args.qemu, '-M', MACHINE, '-display', 'none', '-monitor', 'none',
+           '-serial', 'file:' + os.path.join(tmpdir, 'serial.out')]
+    cmd += extra
+    cmd += ['-bios', firmware]
+    start = time.perf_counter()
+    proc = subprocess.run(cmd, stdout=subprocess.DEVNULL,
+                          stderr=subprocess.DEVNULL, timeout=args.timeout)
+    return proc.returncode, time.perf_counter() - start
+
+
+def read_log(path):
+    with open(path, errors='replace') as f:
+        return f.read()
+
+
+def best_time(args, firmware, tmpdir):
+    """Fastest of --repeat plain runs, None if any of them fails"""
+    best = None
+    for _ in range(args.repeat):
+        status, seconds = run_qemu(args, firmware, [], tmpdir)
+        if status != 0:
+            return None
+        if best is None or seconds < best:
+            best = seconds
+    return best
+
+
+def startup_time(args):
+    with tempfile.TemporaryDirectory() as tmpdir:
+        seconds = best_time(args, args.startup, tmpdir)
+    if seconds is None:
+        sys.exit('%s: start-up firmware failed' % args.startup)
+    return seconds
+
+
+def bench(args, firmware, startup):
+    res = Result(os.path.basename(firmware))
+    res.startup = startup
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        log = os.path.join(tmpdir, 'qemu.log')
+
+        res.seconds = best_time(args, firmware, tmpdir)
+        res.passed = res.seconds is not None
+        if not res.passed:
+            return res
+
+        if args.plugin:
+            run_qemu(args, firmware,
+                     ['-plugin', args.plugin + ',inline=on',
+                      '-d', 'plugin', '-D', log], tmpdir)
+            m = re.search(r"bb's: (\d+), insns: (\d+)", read_log(log))
+            if m:
+                res.blocks = int(m.group(1))
+                res.insns = int(m.group(2))
+
+        run_qemu(args, firmware,
+                 ['-d', 'in_asm', '-trace', 'exec_tb_exit', '-D', log],
+                 tmpdir)
+        text = read_log(log)
+        res.tbs = len(re.findall(r'^IN:', text, re.M))
+        # Zero means the trace backend is not "log"
+        res.exits = len(re.findall(r'\bexec_tb_exit\b', text)) or None
+
+    return res
+
+
+def fmt(value, spec):
+    return '-' if value is None else format(value, spec)
+
+
+def report(results, startup):
+    print('start-up time %.3f s, %s' %
+          (startup, 'subtracted from guest time' if startup
+           else 'not measured, MIPS use the wall time'))
+    print('%-18s %6s %9s %9s %9s %8s %8s %10s %8s' %
+          ('test', 'status', 'time [s]', 'guest [s]', 'insns [M]', 'MIPS',
+           'TBs', 'exit_tb', 'exit/TB'))
+    for r in results:
+        print('%-18s %6s %9s %9s %9s %8s %8s %10s %8s' %
+              (r.name, 'PASS' if r.passed else 'FAIL',
+               fmt(r.seconds, '.3f'), fmt(r.guest_seconds, '.3f'),
+               fmt(None if r.insns is None else r.insns / 1e6, '.1f'),
+               fmt(r.mips, '.1f'), fmt(r.tbs, 'd'), fmt(r.exits, 'd'),
+               fmt(r.exit_rate, '.2%')))
+
+
+def compare(results, baseline, tolerance):
+    """Return the tests that got slower than the baseline allows"""
+    slower = []
+    for r in results:
+        old = baseline.get(r.name, {}).get('mips')
+        if old and r.mips is not None and r.mips < old * (1 - tolerance):
+            print('%s: %.1f MIPS, baseline %.1f MIPS' % (r.name, r.mips, old),
+                  file=sys.stderr)
+            slower.append(r.name)
+    return slower
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Run the AVR32 bare-metal tests as benchmarks')
+    parser.add_argument('--qemu', required=True,
+                        help='qemu-system-avr32 binary')
+    parser.add_argument('--plugin',
+                        help='path of libbb.so, enables instruction counts')
+    parser.add_argument('--repeat', type=int, default=3,
+                        help='timed runs per test, the fastest one counts')
+    parser.add_argument('--timeout', type=int, default=120)
+    parser.add_argument('--startup',
+                        help='firmware that exits at once, its run time is '
+                             'subtracted as QEMU start-up time')
+    parser.add_argument('--json', help='write the results to this file')
+    parser.add_argument('--baseline',
+                        help='results of an earlier --json run to compare to')
+    parser.add_argument('--tolerance', type=float, default=0.1,
+                        help='allowed MIPS loss against the baseline')
+    parser.add_argument('tests', nargs='+', help='test firmware images')
+    args = parser.parse_args()
+
+    startup = startup_time(args) if args.startup else 0.0
+    results = [bench(args, t, startup) for t in args.tests]
+    report(results, startup)
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump({r.name: r.as_dict() for r in results}, f, indent=2)
+
+    failed = [r.name for r in results if not r.passed]
+    if args.baseline:
+        with open(args.baseline) as f:
+            failed += compare(results, json.load(f), args.tolerance)
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())